@@ -91,7 +91,12 @@ MAKE_COMMAND(LoadDataset,
 
     genex::dataset_metadata_t info;
     
-    info = gGenexAPI.loadDataset(name, filePath, separators, maxNumRow, startCol, hasNameCol);
+    auto numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    TIME_COMMAND(
+      info = gGenexAPI.loadDataset(
+        name, filePath, separators, maxNumRow, startCol, hasNameCol, numThreads);
+    )
 
     cout << "Dataset loaded                         " << endl
               << "  Name:        " << info.name       << endl
@@ -109,7 +114,11 @@ MAKE_COMMAND(LoadDataset,
   "Usage: load <name> <filePath> [<separators> [<maxNumRow> [<startCol> [<hasNameCol>]]]]    \n"
   "  name       - Name of the dataset. This name is used to referred to the                  \n"
   "               dataset later. Space is not allowed.                                       \n"
-  "  filePath   - Path to a text file containing the dataset                                 \n"
+  "  filePath   - Path to a text file containing the dataset. Files ending with '.gz' are   \n"
+  "               gzip-compressed, files ending with '.z' or '.zlib' are zlib-compressed.    \n"
+  "               Use '-' to read from the standard input.                                   \n"
+  "               A directory or a glob pattern (e.g. 'data/*.csv') loads all matching      \n"
+  "               files, in parallel, into one dataset. Rows are named after their files.    \n"
   "  separators - A list of characters used to separate values in the file.                  \n"
   "               Use \"\\s\" to specify space. (default: \"\\s\")                           \n"
   "  maxNumRow  - Maximum number of rows will be read from the file. If this                 \n"
@@ -131,8 +140,12 @@ MAKE_COMMAND(SaveDataset,
     auto filePath = args[2];
     auto separators = args.size() > 3 ? args[3] : " ";
     boost::replace_all(separators, "\\s", " ");
-    
-    gGenexAPI.saveDataset(name, filePath, separators[0]);
+    bool binary = separators == "binary";
+    auto numThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    TIME_COMMAND(
+      gGenexAPI.saveDataset(name, filePath, separators[0], numThreads, binary);
+    )
 
     cout << "Saved dataset " << name << " to " << filePath << endl;
 
@@ -144,7 +157,9 @@ MAKE_COMMAND(SaveDataset,
   "Usage: save <name> <filePath> [<separator>]                             \n"
   "  name      - Name of the dataset to be saved                           \n"
   "  filePath  - Path to the saved file                                    \n"
-  "  separator - A character used to separate values in the file.          \n"
+  "  separator - A character used to separate values in the file. Use     \n"
+  "              \"binary\" to save the dataset in the binary format, which \n"
+  "              keeps full precision and can be loaded back with 'load'. \n"
   "              (default: \"\\s\")                                        \n"
   )
 
@@ -299,39 +314,224 @@ MAKE_COMMAND(Distance,
   "               loaded distance. Default to euclidean.                                               \n"
   )
 
+/**
+ *  Parses grouping options given as <key>=<value> arguments. Returns false
+ *  and prints the reason on an unknown key or a malformed value.
+ */
+bool parseGroupOptions(const vector<string>& args, int from, genex::group_options_t& options)
+{
+  for (int i = from; i < args.size(); i++)
+  {
+    auto eq = args[i].find('=');
+    if (eq == string::npos) {
+      cout << "Error! Expected <key>=<value> but got " << args[i] << endl;
+      return false;
+    }
+    auto key = args[i].substr(0, eq);
+    auto value = args[i].substr(eq + 1);
+    try {
+      if (key == "threads") {
+        options.numThreads = stoi(value);
+      }
+      else if (key == "deterministic") {
+        options.deterministic = stoi(value) != 0;
+      }
+      else if (key == "whole") {
+        options.wholeSeriesOnly = stoi(value) != 0;
+      }
+      else if (key == "index") {
+        options.centroidIndex = stoi(value) != 0;
+      }
+      else if (key == "triangle") {
+        options.triangleBounds = stoi(value) != 0;
+      }
+      else if (key == "incremental") {
+        options.incremental = stoi(value) != 0;
+      }
+      else if (key == "batched") {
+        options.batched = stoi(value) != 0;
+      }
+      else if (key == "ordered") {
+        options.ordered = stoi(value) != 0;
+      }
+      else if (key == "stride") {
+        options.stride = stoi(value);
+      }
+      else if (key == "sample") {
+        options.sampleRatio = stod(value);
+      }
+      else if (key == "seed") {
+        options.sampleSeed = stoul(value);
+      }
+      else if (key == "buckets") {
+        options.bucketRatio = stod(value);
+      }
+      else if (key == "lsh") {
+        options.lshTables = stoi(value);
+      }
+      else if (key == "lshwidth") {
+        options.lshWidth = stod(value);
+      }
+      else if (key == "lshverify") {
+        options.lshVerify = stoi(value) != 0;
+      }
+      else if (key == "refine") {
+        options.refineIterations = stoi(value);
+      }
+      else if (key == "super") {
+        options.superGroupRatio = stod(value);
+      }
+      else if (key == "levels") {
+        // Comma separated thresholds
+        std::istringstream thresholds(value);
+        string threshold;
+        options.levelThresholds.clear();
+        while (std::getline(thresholds, threshold, ',')) {
+          options.levelThresholds.push_back(stod(threshold));
+        }
+      }
+      else if (key == "lazy") {
+        options.lazy = stoi(value) != 0;
+      }
+      else if (key == "prefetch") {
+        options.lazyPrefetch = stoi(value);
+      }
+      else {
+        cout << "Error! Unknown grouping option " << key << endl;
+        return false;
+      }
+    }
+    catch (std::logic_error&) {
+      cout << "Error! Invalid value for grouping option " << key << endl;
+      return false;
+    }
+  }
+  return true;
+}
+
 MAKE_COMMAND(GroupDataset,
   {
-    if (tooFewArgs(args, 2) || tooManyArgs(args, 3))
+    if (tooFewArgs(args, 2))
     {
       return false;
     }
 
     auto name = args[1];
     genex::data_t threshold = stod(args[2]);
-    auto distance_name = args.size() == 4 ? args[3] : "euclidean";
+    auto hasDistance = args.size() > 3 && args[3].find('=') == string::npos;
+    auto distance_name = hasDistance ? args[3] : "euclidean";
+
+    genex::group_options_t options;
+    options.numThreads = std::max(1u, std::thread::hardware_concurrency());
+    if (!parseGroupOptions(args, hasDistance ? 4 : 3, options))
+    {
+      return false;
+    }
 
     int count = -1;
-    auto maxThreads = std::thread::hardware_concurrency();
-    cout << "Grouping using " << maxThreads << " threads." << endl;
+    cout << "Grouping using " << options.numThreads << " threads." << endl;
     
     TIME_COMMAND(
-      count = gGenexAPI.groupDataset(name, threshold, distance_name, maxThreads);
+      count = gGenexAPI.groupDataset(name, threshold, distance_name, options);
     )
 
     cout << "Dataset " << name << " is now grouped" << endl;
     cout << "Number of Groups: " << count << endl;
+    auto stats = gGenexAPI.getGroupStats(name);
+    cout << "Distances computed: " << stats.comparisons
+         << " (" << stats.points << " points compared)" << endl;
+    if (options.sampleRatio > 0) {
+      cout << "Groups from the sample: " << stats.sampledGroups
+           << ", created afterwards: " << count - stats.sampledGroups << endl;
+    }
+    if (options.lshTables > 0 && options.lshVerify) {
+      cout << "Assignments differing from a full scan: " << stats.differingAssignments
+           << " of " << stats.verifiedAssignments << endl;
+    }
+    if (options.refineIterations > 0) {
+      auto meanRadius = [](double sum, long groups) { return groups > 0 ? sum / groups : 0; };
+      cout << "Before refinement: " << stats.unrefinedGroups << " groups, mean radius "
+           << meanRadius(stats.unrefinedRadius, stats.unrefinedGroups)
+           << ", grouped in " << stats.groupingSeconds << "s" << endl;
+      cout << "After refinement: " << count << " groups, mean radius "
+           << meanRadius(stats.refinedRadius, count)
+           << ", refined in " << stats.refinementSeconds << "s" << endl;
+    }
+    if (options.superGroupRatio > 1) {
+      cout << "Super-groups: " << stats.superGroups << endl;
+    }
+    if (!options.levelThresholds.empty()) {
+      cout << "Levels above the groups: " << options.levelThresholds.size()
+           << ", choose one with 'level'" << endl;
+    }
+    if (options.lazy) {
+      cout << "Lengths are grouped when first queried" << endl;
+    }
     return true;
   },
 
   "Group a dataset in memory.",
 
-  "Usage: group <name> <threshold> [<distance>]                           \n"
+  "Usage: group <name> <threshold> [<distance>] [<option>=<value> ...]    \n"
   "  name      - Name of the dataset being grouped. Use 'list dataset' to \n"
   "              retrieve the list of loaded datasets.                    \n"
   "  threshold - Threshold for grouping.                                  \n"
   "  distance  - The string identifier of a distance. Distance ends with  \n"
   "              '_dtw' cannot be used. Use 'list distance' to retrieve   \n"
   "              the list of loaded distance. Default to euclidean.       \n"
+  "  Options:                                                             \n"
+  "    threads=<n>         - Number of threads. Default to the number of  \n"
+  "                          hardware threads.                            \n"
+  "    deterministic=<0|1> - Produce the same groups as single-threaded   \n"
+  "                          grouping. Default to 0.                      \n"
+  "    whole=<0|1>         - Group the whole series length only. Default  \n"
+  "                          to 0.                                        \n"
+  "    index=<0|1>         - Index centroids in a VP-tree when the        \n"
+  "                          distance is a metric. Default to 1.          \n"
+  "    triangle=<0|1>      - Skip centroid comparisons with the triangle  \n"
+  "                          inequality when the distance is a metric.    \n"
+  "                          Default to 1.                                \n"
+  "    incremental=<0|1>   - Group lengths in increasing order, seeding   \n"
+  "                          each subsequence with the group of its       \n"
+  "                          prefix. Default to 0.                        \n"
+  "    batched=<0|1>       - Match subsequences to centroids in batches   \n"
+  "                          of dot products with the euclidean distance. \n"
+  "                          Default to 0.                                \n"
+  "    ordered=<0|1>       - Compare each subsequence with the group of   \n"
+  "                          its previous start first, then with the      \n"
+  "                          centroids of closest mean. Default to 0.     \n"
+  "    stride=<s>          - Group only the starts at multiples of s and  \n"
+  "                          search around the members of the best groups \n"
+  "                          when querying. Default to 1.                 \n"
+  "    sample=<ratio>      - Choose centroids from this fraction of the   \n"
+  "                          subsequences, then match the others in       \n"
+  "                          parallel. Faster, but groups differ from     \n"
+  "                          full grouping. Default to 0 (off).           \n"
+  "    seed=<n>            - Seed drawing the sample. Default to 0.       \n"
+  "    buckets=<ratio>     - Group the lengths from l to l * ratio        \n"
+  "                          together, resampled to l. Default to 1 (off).\n"
+  "    lsh=<n>             - Compare subsequences only with the centroids \n"
+  "                          sharing a bucket in one of n random-         \n"
+  "                          projection hash tables, with the euclidean   \n"
+  "                          distance. Approximate. Default to 0 (off).   \n"
+  "    lshwidth=<w>        - Width of the hash buckets, relative to the   \n"
+  "                          threshold. Default to 2.                     \n"
+  "    lshverify=<0|1>     - Count the assignments that differ from a     \n"
+  "                          scan of all centroids. Default to 0.         \n"
+  "    refine=<n>          - Move each centroid to the medoid of its group\n"
+  "                          and group again, n times. Tighter groups,    \n"
+  "                          longer grouping. Default to 0 (off).         \n"
+  "    super=<ratio>       - Cluster the centroids into super-groups of   \n"
+  "                          ratio times the group radius, visited first  \n"
+  "                          by queries. Default to 1 (off).              \n"
+  "    levels=<t1,t2,...>  - Also build nested levels of coarser groups at \n"
+  "                          these increasing thresholds, which queries   \n"
+  "                          can search instead (see 'level').            \n"
+  "    lazy=<0|1>          - Group each length the first time a query     \n"
+  "                          needs it, in the background. Default to 0.   \n"
+  "    prefetch=<n>        - With lazy, also group the lengths needed by  \n"
+  "                          queries up to n longer or shorter. Default   \n"
+  "                          to 1.                                        \n"
   )
 
 MAKE_COMMAND(SaveGroups,
@@ -391,6 +591,30 @@ MAKE_COMMAND(LoadGroups,
   "  path - Where to save the groups.                                     \n"
   )
 
+MAKE_COMMAND(Level,
+  {
+    if (tooFewArgs(args, 2) || tooManyArgs(args, 2))
+    {
+      return false;
+    }
+
+    auto name = args[1];
+    auto level = stoi(args[2]);
+
+    gGenexAPI.setQueryLevel(name, level);
+
+    cout << "Queries on dataset " << name << " now search level " << level << endl;
+    return true;
+  },
+
+  "Choose the level of groups searched by queries.",
+
+  "Usage: level <name> <level>                                            \n"
+  "  name  - Name of a dataset grouped with the levels option.            \n"
+  "  level - 0 for the groups, or a level of coarser groups. Higher       \n"
+  "          levels are faster but may miss the best matches.             \n"
+)
+
 MAKE_COMMAND(Normalize,
   {
     if (tooFewArgs(args, 1) || tooManyArgs(args, 1))
@@ -400,7 +624,7 @@ MAKE_COMMAND(Normalize,
 
     auto name = args[1];
 
-    gGenexAPI.normalizeDataset(name);
+    gGenexAPI.normalizeDataset(name, std::max(1u, std::thread::hardware_concurrency()));
 
     cout << "Dataset " << name << " is now normalized" << endl;
     return true;
@@ -680,6 +904,7 @@ map<string, Command*> commands = {
   {"group", &cmdGroupDataset},
   {"saveGroups", &cmdSaveGroups},
   {"loadGroups", &cmdLoadGroups},  
+  {"level", &cmdLevel},
   {"normalize", &cmdNormalize},
   {"sim", &cmdSim},
   {"ksim", &cmdKSim},
@@ -24,7 +24,8 @@ dataset_metadata_t GenexAPI::loadDataset(const string& name
                                         , const string& separators
                                         , int maxNumRow
                                         , int startCol
-                                        , bool hasNameCol)
+                                        , bool hasNameCol
+                                        , int numThreads)
 {
   // Check if name is already used
   if (this->_loadedDatasets.find(name) != this->_loadedDatasets.end())
@@ -34,7 +35,15 @@ dataset_metadata_t GenexAPI::loadDataset(const string& name
 
   auto newSet = new GroupableTimeSeriesSet();
   try {
-    newSet->loadData(filePath, maxNumRow, startCol, separators, hasNameCol);
+    if (TimeSeriesSet::isMultiFilePath(filePath)) {
+      newSet->loadDataFiles(filePath, maxNumRow, startCol, separators, hasNameCol, numThreads);
+    }
+    else if (TimeSeriesSet::isBinaryDataFile(filePath)) {
+      newSet->loadDataBinary(filePath);
+    }
+    else {
+      newSet->loadData(filePath, maxNumRow, startCol, separators, hasNameCol);
+    }
   } 
   catch (GenexException& e)
   {
@@ -48,10 +57,19 @@ dataset_metadata_t GenexAPI::loadDataset(const string& name
   return this->getDatasetInfo(name);
 }
 
-void GenexAPI::saveDataset(const string& name, const string& filePath, char separator)
+void GenexAPI::saveDataset(const string& name
+                           , const string& filePath
+                           , char separator
+                           , int numThreads
+                           , bool binary)
 {
   this->_checkDatasetName(name);
-  this->_loadedDatasets[name]->saveData(filePath, separator);
+  if (binary) {
+    this->_loadedDatasets[name]->saveDataBinary(filePath);
+  }
+  else {
+    this->_loadedDatasets[name]->saveData(filePath, separator, numThreads);
+  }
 }
 
 void GenexAPI::unloadDataset(const string& name)
@@ -140,10 +158,16 @@ TimeSeries GenexAPI::getTimeSeries(const string& name, int idx, int start, int e
 }
 
 
-std::pair<data_t, data_t> GenexAPI::normalizeDataset(const string& name)
+std::pair<data_t, data_t> GenexAPI::normalizeDataset(const string& name, int numThreads)
+{
+  this->_checkDatasetName(name);
+  return this->_loadedDatasets[name]->normalize(numThreads);
+}
+
+void GenexAPI::computeDatasetStatistics(const string& name, int numThreads)
 {
   this->_checkDatasetName(name);
-  return this->_loadedDatasets[name]->normalize();
+  this->_loadedDatasets[name]->computeStatistics(numThreads);
 }
 
 int GenexAPI::groupDataset(
@@ -154,6 +178,19 @@ int GenexAPI::groupDataset(
     distance_name, threshold, numThreads, wholeSeriesOnly);
 }
 
+int GenexAPI::groupDataset(
+  const string& name, data_t threshold, const string& distance_name, const group_options_t& options)
+{
+  this->_checkDatasetName(name);
+  return this->_loadedDatasets[name]->groupAllLengths(distance_name, threshold, options);
+}
+
+group_stats_t GenexAPI::getGroupStats(const string& name)
+{
+  this->_checkDatasetName(name);
+  return this->_loadedDatasets[name]->getGroupStats();
+}
+
 void GenexAPI::saveGroups(const string& name, const string& path)
 {
   this->_checkDatasetName(name);
@@ -184,6 +221,12 @@ void GenexAPI::setWarpingBandRatio(double ratio)
   genex::setWarpingBandRatio(ratio);
 }
 
+void GenexAPI::setQueryLevel(const string& name, int level)
+{
+  this->_checkDatasetName(name);
+  this->_loadedDatasets[name]->setQueryLevel(level);
+}
+
 candidate_time_series_t GenexAPI::getBestMatch(const string& target_name, const string& query_name,
                                                int index, int start, int end)
 {
@@ -226,6 +269,8 @@ void GenexAPI::preparePAA(const string& name, int blockSize) {
     wrapper = new PAAWrapper(*(this->_loadedDatasets[name]));
     this->_paaWrappers[name] = wrapper;
   }
+  // Block averages are computed from prefix sums
+  this->_loadedDatasets[name]->setKeepPrefixSums(true);
   wrapper->generatePAAMatrix(blockSize);
 }
 
@@ -77,10 +77,12 @@ public:
    *  the same number of columns. If the number of lines exceeds maxNumRow, only
    *  maxNumRow lines are read and the rest is discarded. If maxNumRow is larger than 
    *  or equal to the actual number of lines, or maxNumRow is not positive, all lines 
-   *  are read.
+   *  are read. Binary datasets written by saveDataset are detected automatically, in
+   *  which case the remaining arguments are ignored.
    *
    *  @param name name of the dataset
-   *  @param filePath path to a text file
+   *  @param filePath path to a text file. Files ending with ".gz", ".z" or ".zlib"
+   *         are decompressed while being read and "-" reads from the standard input
    *  @param separator a string containing possible separator characters for values
    *         in a line
    *  @param maxNumRow maximum number of rows to be read. If this value is not positive,
@@ -88,6 +90,9 @@ public:
    *  @param startCol columns before startCol, in 0-based index, are discarded
    *  @param hasNameCol whether the first column (starting from startCol) is the one
    *         with names for each time series
+   *  @param numThreads number of threads parsing the files if filePath is a
+   *         directory or a glob pattern. All files found are combined into one
+   *         dataset, see TimeSeriesSet::loadDataFiles
    *
    *  @return a dataset_metadata_t struct containing metadata of the dataset
    *
@@ -98,7 +103,8 @@ public:
                                  , const string& separators = " "
                                  , int maxNumRow = 0
                                  , int startCol = 0
-                                 , bool hasNameCol = false);
+                                 , bool hasNameCol = false
+                                 , int numThreads = 1);
 
   /*
    *  @brief saves data from memory to a file
@@ -106,10 +112,17 @@ public:
    *  @param name name of the dataset
    *  @param filePath path to a text file
    *  @param separator a character to separate entries in the file
+   *  @param numThreads number of threads formatting the text file
+   *  @param binary if set to true, the dataset is saved in the binary format and
+   *         the separator is ignored
    *
    *  @throw GenexException if cannot read from the given file
    */
-  void saveDataset(const string& name, const string& filePath, char separator);                           
+  void saveDataset(const string& name
+                   , const string& filePath
+                   , char separator
+                   , int numThreads = 1
+                   , bool binary = false);
 
   /**
    *  @brief unloads a dataset at given name
@@ -183,10 +196,19 @@ public:
    *  across the whole dataset.
    *
    *  @param name name of the dataset to be normalized
+   *  @param numThreads number of threads used to normalize the dataset
    *  @return a pair (min, max) - the minimum and maximum value across
    *          the whole dataset before being normalized.
    */
-  std::pair<data_t, data_t> normalizeDataset(const string& name);
+  std::pair<data_t, data_t> normalizeDataset(const string& name, int numThreads = 1);
+
+  /**
+   *  @brief computes and keeps statistics of every time series in a dataset
+   *
+   *  @param name name of the dataset
+   *  @param numThreads number of threads used to compute the statistics
+   */
+  void computeDatasetStatistics(const string& name, int numThreads = 1);
 
   /**
    *  @brief groups a dataset
@@ -194,6 +216,7 @@ public:
    *  @param name name of the dataset to be grouped
    *  @param threshold the threshold to use when creating the group
    *  @param distanceName the distance to use when grouping the data
+   *  @param numThreads number of threads used to group
    *  @param wholeSeriesOnly if set to true group the largest length only
    *  @return the number of groups created
    */
@@ -203,6 +226,28 @@ public:
                    , int numThreads = 1
                    , bool wholeSeriesOnly = false);
 
+  /**
+   *  @brief groups a dataset
+   *
+   *  @param name name of the dataset to be grouped
+   *  @param threshold the threshold to use when creating the group
+   *  @param distanceName the distance to use when grouping the data
+   *  @param options number of threads, lengths to group and determinism
+   *  @return the number of groups created
+   */
+  int groupDataset(const string& name
+                   , data_t threshold
+                   , const string& distanceName
+                   , const group_options_t& options);
+
+  /**
+   *  @brief returns the work done to group a dataset
+   *
+   *  @param name name of the dataset
+   *  @return subsequences grouped, distances computed and points compared
+   */
+  group_stats_t getGroupStats(const string& name);
+
    /**
    *  @brief save all groups of a dataset to a file
    *  
@@ -256,6 +301,18 @@ public:
    */
   void setWarpingBandRatio(double ratio);
 
+  /**
+   *  @brief chooses the level of the groups of a dataset searched by queries
+   *
+   *  Level 0 holds the groups and levels above hold coarser groups built at
+   *  the level thresholds given when grouping (see group_options_t). Higher
+   *  levels answer faster but may miss the best matches.
+   *
+   *  @param name name of the grouped dataset
+   *  @param level the level searched by getBestMatch and getKBestMatches
+   */
+  void setQueryLevel(const string& name, int level);
+
   /**
    *  @brief gets a single similar time series to the query
    *
@@ -21,29 +21,43 @@ GroupableTimeSeriesSet::~GroupableTimeSeriesSet()
 
 int GroupableTimeSeriesSet::groupAllLengths(
   const std::string& distanceName, data_t threshold, int numThreads, bool wholeSeriesOnly)
+{
+  group_options_t options;
+  options.numThreads = numThreads;
+  options.wholeSeriesOnly = wholeSeriesOnly;
+  return this->groupAllLengths(distanceName, threshold, options);
+}
+
+int GroupableTimeSeriesSet::groupAllLengths(
+  const std::string& distanceName, data_t threshold, const group_options_t& options)
 {
   if (!this->isLoaded())
   {
     throw GenexException("No data to group");
   }
+  if (options.numThreads <= 0) {
+    throw GenexException("Number of threads must be positive");    
+  }
 
   // clear old groups
   reset();
 
-  this->groupsAllLengthSet = new GlobalGroupSpace(*this);
-  int cntGroups;
-  if (numThreads == 1) {
-    cntGroups = this->groupsAllLengthSet->group(
-      distanceName, threshold, wholeSeriesOnly);
-  }
-  else if (numThreads > 1) {
-    cntGroups = this->groupsAllLengthSet->groupMultiThreaded(
-      distanceName, threshold, numThreads, wholeSeriesOnly);
+  // Window statistics of z-normalized distances come from prefix sums
+  if (isZNormalizedDistance(distanceName)) {
+    this->setKeepPrefixSums(true);
   }
-  else {
-    throw GenexException("Number of threads must be positive");    
+
+  this->groupsAllLengthSet = new GlobalGroupSpace(*this);
+  return this->groupsAllLengthSet->group(distanceName, threshold, options);
+}
+
+std::pair<data_t, data_t> GroupableTimeSeriesSet::normalize(int numThreads)
+{
+  auto range = TimeSeriesSet::normalize(numThreads);
+  if (this->isGrouped()) {
+    this->groupsAllLengthSet->refreshCentroids();
   }
-  return cntGroups;
+  return range;
 }
 
 bool GroupableTimeSeriesSet::isGrouped() const
@@ -60,6 +74,14 @@ int GroupableTimeSeriesSet::getTotalNumberOfGroups() const
   return 0;
 }
 
+group_stats_t GroupableTimeSeriesSet::getGroupStats() const
+{
+  if (this->isGrouped())
+  {
+    return this->groupsAllLengthSet->getGroupStats();
+  }
+  return group_stats_t();
+}
 
 string GroupableTimeSeriesSet::getDistanceName() const
 {
@@ -92,6 +114,8 @@ void GroupableTimeSeriesSet::saveGroupsOld(const string& path, bool groupSizeOnl
     throw GenexException("No group found");
   }
 
+  // Lazily grouped lengths no query has visited are saved too
+  this->groupsAllLengthSet->buildAllSpaces();
   ofstream fout(path);
   if (fout)
   {
@@ -141,6 +165,14 @@ int GroupableTimeSeriesSet::loadGroupsOld(const string& path)
   return numberOfGroups;
 }
 
+void GroupableTimeSeriesSet::setQueryLevel(int level)
+{
+  if (!this->isGrouped()) {
+    throw GenexException("Dataset is not grouped");
+  }
+  this->groupsAllLengthSet->setQueryLevel(level);
+}
+
 candidate_time_series_t GroupableTimeSeriesSet::getBestMatch(const TimeSeries& query) const
 {
   if (this->groupsAllLengthSet) //not nullptr
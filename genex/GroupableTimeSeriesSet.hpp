@@ -39,12 +39,32 @@ public:
                       data_t threshold,
                       int numThreads,
                       bool wholeSeriesOnly);
+
+  /**
+   *  @brief groups the datset into similarity groups
+   *
+   *  @param distanceName the distance to use for comparing similarity
+   *  @param threshold to use for determing the bound of similarity
+   *  @param options number of threads, lengths to group and determinism
+   *
+   *  @return the number of groups created
+   */
+  int groupAllLengths(const std::string& distanceName,
+                      data_t threshold,
+                      const group_options_t& options);
   
   /**
    *  @brief deletes and clears the groups
    */
   void reset();
 
+  /**
+   *  @brief normalizes the dataset (see TimeSeriesSet::normalize)
+   *
+   *  Centroids of existing groups are copied from the dataset again.
+   */
+  std::pair<data_t, data_t> normalize(int numThreads = 1) override;
+
   /**
    *  @brief check if the dataset is grouped
    */
@@ -54,9 +74,17 @@ public:
    *  @brief returns name of the distance used for grouping
    */
   int getTotalNumberOfGroups() const;  
+  group_stats_t getGroupStats() const;
   string getDistanceName() const;
   data_t getThreshold() const;
 
+  /**
+   *  @brief chooses the level searched by queries (see GlobalGroupSpace::setQueryLevel)
+   *
+   *  @throws exception if dataset is not grouped or the level is out of range
+   */
+  void setQueryLevel(int level);
+
   void saveGroupsOld(const std::string& path, bool groupSizeOnly) const;
   int loadGroupsOld(const std::string& path);
   
@@ -96,6 +124,8 @@ private:
       throw GenexException("No group found");
     }
 
+    // Lazily grouped lengths no query has visited are saved too
+    this->groupsAllLengthSet->buildAllSpaces();
     ar << this->getItemCount()
        << this->getMaxLength();
 
@@ -118,6 +148,9 @@ private:
     reset();
     this->groupsAllLengthSet = new GlobalGroupSpace(*this);
     ar >> *(this->groupsAllLengthSet);
+    if (isZNormalizedDistance(this->getDistanceName())) {
+      this->setKeepPrefixSums(true);
+    }
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER()
@@ -12,13 +12,7 @@ using std::endl;
 
 namespace genex {
 
-PAAWrapper::PAAWrapper(const TimeSeriesSet& dataset): dataset(dataset)
-{
-  for (int i = 0; i < dataset.getItemCount(); i++) {
-    TimeSeries ts = dataset.getTimeSeries(i);
-    this->paaMat.push_back(vector<TimeSeries>{ts});
-  }
-}
+PAAWrapper::PAAWrapper(const TimeSeriesSet& dataset): dataset(dataset) {}
 
 /**
  * Perform PAA on a time series.
@@ -49,16 +43,7 @@ void PAAWrapper::generatePAAMatrix(int blockSize)
     throw GenexException("Block size for PAA must be positive");
   }
  
-  int itemLength = dataset.getItemLength(dataset.getMaxLength());
-  blockSize = min(blockSize, itemLength);
-  for (int i = 0; i < dataset.getItemCount(); i++) {
-    this->paaMat[i].clear();
-    for (int offset = 0; offset < blockSize; offset++) {
-      TimeSeries paaTS = tsPAA(dataset.getTimeSeries(i, offset, itemLength), blockSize);      
-      this->paaMat[i].push_back(paaTS);
-    }
-  }
-  this->blockSize = blockSize;
+  this->blockSize = min(blockSize, dataset.getMaxLength());
 }
 
 TimeSeries PAAWrapper::getPAA(int index, int start, int end) {
@@ -75,22 +60,14 @@ TimeSeries PAAWrapper::getPAA(int index, int start, int end) {
     {
       throw GenexException("Invalid starting or ending position of a time series");
     }
-    int offset = start % blockSize;
-    TimeSeries &wholePAA = paaMat[index][offset];
-
     // -1 to shift to 0-based, +1 to shift back to 1-based
     int paaLength = (end - start - 1) / blockSize + 1;
     TimeSeries paaTS{paaLength};
-    int paaStart = (start - offset) / blockSize;
-    int paaEnd = (end - offset) / blockSize;
-    for (int i = paaStart; i < paaEnd; i++) {
-      paaTS[i - paaStart] = wholePAA[i];
-    }
-    // Compute average of the leftover if start and end do not cover the whole cached PAA
-    if ((end - offset) % blockSize != 0) {
-      int leftOverStart = start + (end - start) / blockSize * blockSize;
-      TimeSeries ts = dataset.getTimeSeries(index, leftOverStart, end);
-      paaTS[paaLength - 1] = ts.average();
+    // Blocks are aligned to start, the last one holds the leftover if any
+    for (int i = 0; i < paaLength; i++) {
+      int blockStart = start + i * blockSize;
+      int blockEnd = min(blockStart + blockSize, end);
+      paaTS[i] = dataset.getTimeSeries(index, blockStart, blockEnd).average();
     }
     return paaTS;
   }
@@ -106,13 +83,13 @@ vector<candidate_time_series_t> PAAWrapper::getKBestMatchesPAA(
 
   auto warpedDistance = getDistanceFromName(distanceName + DTW_SUFFIX);
   data_t bestSoFarDist, currentDist;
-  auto timeSeriesLength = dataset.getItemLength(dataset.getMaxLength());
   auto numberTimeSeries = dataset.getItemCount();
   auto paaQuery = tsPAA(query, this->blockSize);
 
   // iterate through every timeseries
   for (int idx = 0; idx < numberTimeSeries; idx++)
   {
+    auto timeSeriesLength = dataset.getItemLength(idx);
     // iterate through every length of interval
     for (int intervalLength = 2; intervalLength <= timeSeriesLength;
         intervalLength++) 
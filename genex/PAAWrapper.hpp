@@ -19,10 +19,11 @@ public:
   PAAWrapper(const TimeSeriesSet&);
 
   /**
-   * @brief Generates a matrix containing PAA information
+   * @brief Prepares the wrapper for PAA with the given block size
    * 
-   * Each row of this matrix corresponds to a time series in the original dataset. The jth element in a row
-   * is a PAA of the corresponding time series offset by j.
+   * No PAA matrix is materialized. Block averages are computed on demand from
+   * the time series of the dataset, which takes constant time per block when the
+   * dataset keeps prefix sums (see TimeSeriesSet::setKeepPrefixSums).
    * 
    * @param blockSize size of a block for PAA.
    */
@@ -53,8 +54,7 @@ public:
 
 private:
   const TimeSeriesSet& dataset;
-  int blockSize;
-  vector< vector<TimeSeries> > paaMat;
+  int blockSize = 1;
 };
 
 } // namespace genex
@@ -4,6 +4,7 @@
 #include "lib/trillionDTW.h"
 
 #include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
@@ -52,6 +53,8 @@ TimeSeries::TimeSeries(const TimeSeries& other)
   start = other.start;
   end = other.end;
   length = other.length;
+  prefixSum = other.prefixSum;
+  prefixSumSquared = other.prefixSumSquared;
   if (isOwnerOfData)
   {
     // If the data is internal to the TimeSeries, copy this data
@@ -73,8 +76,8 @@ TimeSeries& TimeSeries::operator=(const TimeSeries& other)
   if (other.isOwnerOfData)
   {
     // If the data is internal to the TimeSeries, copy this data
-    this->data = new data_t[length];
-    memcpy(this->data, other.data, length * sizeof(data_t));
+    this->data = new data_t[other.length];
+    memcpy(this->data, other.data, other.length * sizeof(data_t));
   }
   else {
     // If the data is external, only need to copy the referring pointer
@@ -86,6 +89,10 @@ TimeSeries& TimeSeries::operator=(const TimeSeries& other)
   start = other.start;
   end = other.end;
   length = other.length;
+  prefixSum = other.prefixSum;
+  prefixSumSquared = other.prefixSumSquared;
+  // The cached envelopes belong to the old data
+  clearKeogh();
 
   return *this;
 }
@@ -106,6 +113,10 @@ TimeSeries& TimeSeries::operator=(TimeSeries&& other)
   start = other.start;
   end = other.end;
   length = other.length;
+  prefixSum = other.prefixSum;
+  prefixSumSquared = other.prefixSumSquared;
+  // The cached envelopes belong to the old data
+  clearKeogh();
 
   return *this;
 }
@@ -118,10 +129,7 @@ TimeSeries::~TimeSeries()
     delete[] this->data;
     this->data = nullptr;
   }
-  delete[] keoghLower;
-  keoghLower = nullptr;
-  delete[] keoghUpper;
-  keoghUpper = nullptr;
+  clearKeogh();
 }
 
 data_t& TimeSeries::operator[](int idx) const
@@ -143,6 +151,9 @@ TimeSeries& TimeSeries::operator+=(const TimeSeries& other)
     data[start + i] += other[i];
   }
   keoghCacheValid = false;
+  // The data no longer matches the prefix sums
+  prefixSum = nullptr;
+  prefixSumSquared = nullptr;
   return *this;
 }
 
@@ -165,14 +176,79 @@ bool TimeSeries::operator==(const TimeSeries& other) const
   return true;
 }
 
-data_t TimeSeries::average() {
-  data_t sum;
+data_t TimeSeries::average() const
+{
+  if (this->prefixSum != nullptr) {
+    return (prefixSum[this->end] - prefixSum[this->start]) / this->length;
+  }
+  data_t sum = 0;
   for (int i = 0; i < this->length; i++) {
     sum += data[this->start + i];
   }
   return sum / this->length;
 }
 
+data_t TimeSeries::stddev() const
+{
+  data_t mean = this->average();
+  if (this->prefixSumSquared != nullptr) {
+    data_t sumSquared = prefixSumSquared[this->end] - prefixSumSquared[this->start];
+    // Cancellation may make the variance slightly negative for constant sequences
+    data_t variance = sumSquared / this->length - mean * mean;
+    return variance > 0 ? sqrt(variance) : 0;
+  }
+  // Without prefix sums the deviations from the mean are summed, which does
+  // not cancel for values far from zero
+  data_t sumDeviations = 0;
+  for (int i = 0; i < this->length; i++) {
+    data_t deviation = data[this->start + i] - mean;
+    sumDeviations += deviation * deviation;
+  }
+  return sqrt(sumDeviations / this->length);
+}
+
+void TimeSeries::setPrefixSums(const data_t* sum, const data_t* sumSquared)
+{
+  this->prefixSum = sum;
+  this->prefixSumSquared = sumSquared;
+}
+
+void TimeSeries::setPrefixSumsOf(const TimeSeries& other)
+{
+  if (!other.hasPrefixSums()) {
+    this->setPrefixSums(nullptr, nullptr);
+    return;
+  }
+  // Shift the arrays so that both time series index the same sums
+  this->setPrefixSums(other.prefixSum + other.start - this->start,
+                      other.prefixSumSquared + other.start - this->start);
+}
+
+
+TimeSeries TimeSeries::resample(int length) const
+{
+  if (length <= 0) {
+    throw GenexException("Length of a resampled time series must be positive");
+  }
+  TimeSeries result(length);
+  const data_t* from = this->data + this->start;
+  if (length == 1 || this->length == 1) {
+    for (int i = 0; i < length; i++) {
+      result.data[i] = from[0];
+    }
+    return result;
+  }
+  // Point i of the result lies at i * (this->length - 1) / (length - 1)
+  double scale = (double)(this->length - 1) / (length - 1);
+  for (int i = 0; i < length; i++)
+  {
+    double x = i * scale;
+    int left = std::min((int)x, this->length - 2);
+    double w = x - left;
+    result.data[i] = from[left] * (1 - w) + from[left + 1] * w;
+  }
+  return result;
+}
 
 const data_t* TimeSeries::getKeoghLower(int warpingBand) const
 {
@@ -194,23 +270,44 @@ const data_t* TimeSeries::getKeoghUpper(int warpingBand) const
 
 void TimeSeries::generateKeoghLU(int warpingBand) const
 {
-  delete[] keoghLower;
-  keoghLower = nullptr;
-  delete[] keoghUpper;
-  keoghUpper = nullptr;
+  clearKeogh();
 
-  keoghLower = new data_t[this->length];
-  keoghUpper = new data_t[this->length];
+  data_t* lower = new data_t[this->length];
+  data_t* upper = new data_t[this->length];
 
   warpingBand = min(warpingBand, this->length - 1);
 
   // Function provided by trillionDTW codebase
-  lower_upper_lemire(this->data + this->start, this->length, warpingBand,
-                     this->keoghLower, this->keoghUpper);
+  lower_upper_lemire(this->data + this->start, this->length, warpingBand, lower, upper);
+
+  keoghLower = lower;
+  keoghUpper = upper;
+  isOwnerOfKeogh = true;
+  keoghCacheValid = true;
+}
 
+void TimeSeries::setKeoghEnvelope(const data_t* lower, const data_t* upper, int warpingBand) const
+{
+  clearKeogh();
+  keoghLower = lower;
+  keoghUpper = upper;
+  isOwnerOfKeogh = false;
+  cachedWarpingBand = warpingBand;
   keoghCacheValid = true;
 }
 
+void TimeSeries::clearKeogh() const
+{
+  if (isOwnerOfKeogh) {
+    delete[] keoghLower;
+    delete[] keoghUpper;
+  }
+  keoghLower = nullptr;
+  keoghUpper = nullptr;
+  isOwnerOfKeogh = true;
+  keoghCacheValid = false;
+}
+
 const data_t* TimeSeries::getData() const
 {
   return this->data;
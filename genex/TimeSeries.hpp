@@ -146,12 +146,70 @@ public:
 
   /**
    *  @brief returns the average of the whole time series
+   *
+   *  This takes constant time if prefix sums are attached to this time series,
+   *  otherwise all data points are visited.
+   */
+  data_t average() const;
+
+  /**
+   *  @brief returns the (population) standard deviation of the whole time series
+   *
+   *  This takes constant time if prefix sums are attached to this time series,
+   *  otherwise all data points are visited.
    */
-  data_t average();
+  data_t stddev() const;
+
+  /**
+   *  @brief attaches prefix sums of the underlying data
+   *
+   *  Both arrays are indexed the same way as the data, with one extra element:
+   *  sum[i] is the sum of the first i data points so the sum of the interval
+   *  [start, end) is sum[end] - sum[start].
+   *
+   *  @param sum prefix sums of the data
+   *  @param sumSquared prefix sums of the squared data
+   */
+  void setPrefixSums(const data_t* sum, const data_t* sumSquared);
+
+  /**
+   *  @brief attaches the prefix sums of another time series holding the same values
+   *
+   *  @param other a time series of the same length, e.g. the one this was copied from
+   */
+  void setPrefixSumsOf(const TimeSeries& other);
+
+  /**
+   *  @brief uniformly rescales this time series to another length
+   *
+   *  Values are linearly interpolated between the nearest points, so the first
+   *  and last values are kept. The result has no prefix sums.
+   *
+   *  @param length the length of the result
+   *  @return a time series owning the rescaled values
+   */
+  TimeSeries resample(int length) const;
+
+  /**
+   *  @brief checks if prefix sums are attached to this time series
+   */
+  bool hasPrefixSums() const { return this->prefixSum != nullptr; }
 
   const data_t* getKeoghLower(int warpingBand) const;
   const data_t* getKeoghUpper(int warpingBand) const;
 
+  /**
+   *  @brief uses Keogh envelopes computed elsewhere for a warping band
+   *
+   *  The arrays are not copied; they must stay valid until this time series is
+   *  destroyed or given other envelopes.
+   *
+   *  @param lower the lower envelope
+   *  @param upper the upper envelope
+   *  @param warpingBand the warping band of the envelopes
+   */
+  void setKeoghEnvelope(const data_t* lower, const data_t* upper, int warpingBand) const;
+
   const data_t* getData() const;
   std::string getIdentifierString() const;
 
@@ -166,10 +224,18 @@ private:
   int end;
   int length;
 
+  // Prefix sums of the underlying data, indexed the same way as 'data'
+  const data_t* prefixSum = nullptr;
+  const data_t* prefixSumSquared = nullptr;
+
   mutable bool keoghCacheValid = false;
-  mutable data_t* keoghLower = nullptr;
-  mutable data_t* keoghUpper = nullptr;
+  mutable const data_t* keoghLower = nullptr;
+  mutable const data_t* keoghUpper = nullptr;
   mutable double cachedWarpingBand;
+  // false if the envelopes were given by setKeoghEnvelope
+  mutable bool isOwnerOfKeogh = true;
+
+  void clearKeogh() const;
 
   std::ostream &printData(std::ostream &out) const;
   
@@ -1,13 +1,28 @@
 #include "TimeSeriesSet.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <future>
+#include <mutex>
+#include <queue>
+#include <glob.h>
+#include <sys/stat.h>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zlib.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 #include <boost/tokenizer.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "distance/Distance.hpp"
+#include "lib/ThreadPool.hpp"
 #include "Exception.hpp"
 
 using std::string;
@@ -40,65 +55,75 @@ string TimeSeriesSet::getTimeSeriesName(int index) const
   return std::to_string(index);
 }
 
-std::pair<int, int> _getMaxRowsMaxColumns(std::ifstream& f, const string& separators)
+/**
+ * Opens the input of a dataset. "-" is the standard input, files ending with
+ * ".gz" are gzip-compressed and files ending with ".z" or ".zlib" are
+ * zlib-compressed (like saved group files). Anything else is read as is.
+ */
+static void _openDataInput(const string& filePath,
+                           std::ifstream& file,
+                           boost::iostreams::filtering_istream& in)
 {
-  int lineCount = 0;
-  int maxColumn = 0;
-  int length;
-  string line;
-  boost::char_separator<char> sep(separators.c_str());
-  typedef boost::tokenizer<boost::char_separator<char>> tokenizer;
-  for (lineCount = 0; std::getline(f, line); ++lineCount)
-  {
-    tokenizer tokens(line, sep);
-    length = std::distance(tokens.begin(), tokens.end());
-    if (maxColumn < length) {
-      maxColumn = length;
-    }
+  auto endsWith = [&filePath](const string& suffix) {
+    return filePath.size() >= suffix.size() &&
+      filePath.compare(filePath.size() - suffix.size(), suffix.size(), suffix) == 0;
+  };
+  if (filePath == "-") {
+    in.push(std::cin);
+    return;
   }
-  f.clear();
-  f.seekg(0);
-  return {lineCount, maxColumn};
-}
-
-void TimeSeriesSet::loadData(const string& filePath
-                            , int maxNumRow
-                            , int startCol
-                            , const string& separators
-                            , bool hasNameCol)
-{
-  this->clearData();
-
-  std::ifstream f(filePath);
-  if (!f.is_open())
+  file.open(filePath, std::ios::binary);
+  if (!file.is_open())
   {
-    f.close();
     throw GenexException(string("Cannot open ") + filePath);
   }
-  auto maxRowMaxColumn = _getMaxRowsMaxColumns(f, separators);
-  if (maxNumRow <= 0) {
-    maxNumRow = maxRowMaxColumn.first;
+  if (endsWith(".gz")) {
+    in.push(boost::iostreams::gzip_decompressor());
   }
-  else {
-    maxNumRow = std::min(maxNumRow, maxRowMaxColumn.first);
+  else if (endsWith(".z") || endsWith(".zlib")) {
+    in.push(boost::iostreams::zlib_decompressor());
   }
-  auto rawMaxCol = maxRowMaxColumn.second;
-  int length = -1;
+  in.push(file);
+}
+
+/**
+ * Rows parsed from one input, stored one after another
+ */
+struct parsed_rows_t
+{
+  vector<data_t> values;
+  vector<size_t> rowOffsets;
+  vector<int> lengths;
+  vector<string> names;
+  int maxLength = 0;
+};
+
+/**
+ * Parses the rows of a dataset file in a single pass. See TimeSeriesSet::loadData.
+ */
+static void _parseDataFile(const string& filePath
+                          , int maxNumRow
+                          , int startCol
+                          , const string& separators
+                          , bool hasNameCol
+                          , parsed_rows_t& rows)
+{
+  std::ifstream file;
+  boost::iostreams::filtering_istream f;
+  _openDataInput(filePath, file, f);
+
   string line;
   // Tokenize each line using the given separators
   boost::char_separator<char> sep(separators.c_str());
   typedef boost::tokenizer<boost::char_separator<char>> tokenizer;
 
-  this->itemCount = 0;
-  this->data = new data_t[maxNumRow * rawMaxCol];
-  memset(this->data, 0, maxNumRow * rawMaxCol * sizeof(data_t*));
-  for (int row = 0; row < maxNumRow; row++, this->itemCount++)
+  // Rows are read into a growable buffer, one after another
+  try
   {
-    // Read and process line by line
-    if (getline(f, line))
+    for (int row = 0; (maxNumRow <= 0 || row < maxNumRow) && getline(f, line); row++)
     {
       tokenizer tokens(line, sep);
-      this->lengths.push_back(std::distance(tokens.begin(), tokens.end()) - startCol - hasNameCol);
+      rows.rowOffsets.push_back(rows.values.size());
       int col = 0;
       for (tokenizer::iterator tok_iter = tokens.begin();
            tok_iter != tokens.end(); tok_iter++, col++)
@@ -106,67 +131,493 @@ void TimeSeriesSet::loadData(const string& filePath
         // Only read columns from startCol and after
         if (col >= startCol)
         {
-          try
-          {
-            if (col == startCol && hasNameCol) {
-              this->names.push_back(*tok_iter);
-            }
-            else {
-              int index = row * (rawMaxCol - startCol - hasNameCol) + (col - startCol - hasNameCol);
-              this->data[index] = (data_t)std::stod(*tok_iter);
-            }
+          if (col == startCol && hasNameCol) {
+            rows.names.push_back(*tok_iter);
           }
-          catch (const std::invalid_argument& e)
-          {
-            f.close();
-            this->clearData();
-            throw GenexException("Dataset file contains unparsable text");
-          }
-          catch (const std::out_of_range& e)
-          {
-            f.close();
-            this->clearData();
-            throw GenexException("Values are out of range");
+          else {
+            rows.values.push_back((data_t)std::stod(*tok_iter));
           }
         }
       }
-    }
-    else {
-      break;
+      int length = std::max(0, col - startCol - (int)hasNameCol);
+      rows.lengths.push_back(length);
+      rows.maxLength = std::max(rows.maxLength, length);
     }
   }
-
+  catch (const std::invalid_argument& e)
+  {
+    throw GenexException("Dataset file contains unparsable text");
+  }
+  catch (const std::out_of_range& e)
+  {
+    throw GenexException("Values are out of range");
+  }
+  catch (const std::ios_base::failure& e)
+  {
+    throw GenexException("Error while reading file");
+  }
 
   if (f.bad())
   {
-    f.close();
-    this->clearData();
     throw GenexException("Error while reading file");
   }
+}
+
+void TimeSeriesSet::_setRows(const parsed_rows_t& rows, int maxNumRow)
+{
+  this->itemCount = rows.lengths.size();
+  if (maxNumRow > 0) {
+    this->itemCount = std::min(this->itemCount, maxNumRow);
+  }
+  this->lengths.assign(rows.lengths.begin(), rows.lengths.begin() + this->itemCount);
+  this->names.assign(rows.names.begin(),
+                     rows.names.begin() + std::min((int)rows.names.size(), this->itemCount));
+  this->maxCol = this->lengths.empty() ?
+    0 : *std::max_element(this->lengths.begin(), this->lengths.end());
+
+  // Lay the rows out with a fixed stride now that the longest row is known
+  this->data = new data_t[(size_t)this->itemCount * this->maxCol]();
+  for (int row = 0; row < this->itemCount; row++) {
+    std::copy(rows.values.begin() + rows.rowOffsets[row],
+              rows.values.begin() + rows.rowOffsets[row] + this->lengths[row],
+              this->data + row * this->maxCol);
+  }
+
+  if (this->keepPrefixSums) {
+    this->_buildPrefixSums();
+  }
+}
+
+void TimeSeriesSet::loadData(const string& filePath
+                            , int maxNumRow
+                            , int startCol
+                            , const string& separators
+                            , bool hasNameCol)
+{
+  this->clearData();
 
+  parsed_rows_t rows;
+  _parseDataFile(filePath, maxNumRow, startCol, separators, hasNameCol, rows);
+  this->_setRows(rows, maxNumRow);
   this->filePath = filePath;
-  this->maxCol = rawMaxCol - startCol - hasNameCol;
+}
+
+bool TimeSeriesSet::isMultiFilePath(const string& path)
+{
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0) {
+    return S_ISDIR(st.st_mode);
+  }
+  return path.find_first_of("*?[") != string::npos;
+}
+
+/**
+ * Lists the regular files in a directory or matching a glob pattern, sorted
+ * by path so that the order does not depend on the file system or locale.
+ */
+static vector<string> _listDataFiles(const string& path)
+{
+  struct stat st;
+  string pattern = path;
+  if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    pattern = path + (path.back() == '/' ? "*" : "/*");
+  }
+
+  vector<string> files;
+  glob_t matches;
+  int ret = glob(pattern.c_str(), 0, nullptr, &matches);
+  if (ret == 0) {
+    for (size_t i = 0; i < matches.gl_pathc; i++) {
+      if (stat(matches.gl_pathv[i], &st) == 0 && S_ISREG(st.st_mode)) {
+        files.push_back(matches.gl_pathv[i]);
+      }
+    }
+  }
+  globfree(&matches);
+  if (ret != 0 && ret != GLOB_NOMATCH) {
+    throw GenexException(string("Cannot list files of ") + path);
+  }
+  std::sort(files.begin(), files.end());
+  return files;
+}
+
+/**
+ * Name of a file without its directory and extensions
+ */
+static string _fileStem(const string& filePath)
+{
+  string name = filePath.substr(filePath.find_last_of('/') + 1);
+  return name.substr(0, name.find('.'));
+}
+
+void TimeSeriesSet::loadDataFiles(const string& path
+                                 , int maxNumRow
+                                 , int startCol
+                                 , const string& separators
+                                 , bool hasNameCol
+                                 , int numThreads)
+{
+  if (numThreads < 1) {
+    throw GenexException("Number of threads must be positive");
+  }
+  this->clearData();
+
+  vector<string> files = _listDataFiles(path);
+  if (files.empty()) {
+    throw GenexException(string("No file found at ") + path);
+  }
+
+  // Each file is parsed by its own task, the results are combined in the
+  // order of the sorted file names. A file only needs the rows still missing
+  // after the files before it, which is at most maxNumRow less the rows of
+  // those already parsed; files with none missing are skipped
+  vector<parsed_rows_t> parsed(files.size());
+  vector<int> parsedRows(files.size(), 0);
+  std::mutex parsedMutex;
+  auto rowsLeft = [&](int i) {
+    std::lock_guard<std::mutex> lock(parsedMutex);
+    int left = maxNumRow;
+    for (int j = 0; j < i; j++) {
+      left -= parsedRows[j];
+    }
+    return left;
+  };
+  auto parse = [&](int i) {
+    int budget = 0;
+    if (maxNumRow > 0) {
+      int left = rowsLeft(i);
+      if (left <= 0) {
+        return;
+      }
+      // Two rows tell whether the file has more than one, which names its rows
+      budget = std::max(left, 2);
+    }
+    try {
+      _parseDataFile(files[i], budget, startCol, separators, hasNameCol, parsed[i]);
+    }
+    catch (GenexException& e) {
+      throw GenexException(string(e.what()) + " (" + files[i] + ")");
+    }
+    std::lock_guard<std::mutex> lock(parsedMutex);
+    parsedRows[i] = parsed[i].lengths.size();
+  };
+  if (numThreads == 1) {
+    for (int i = 0; i < files.size() && (maxNumRow <= 0 || rowsLeft(i) > 0); i++) {
+      parse(i);
+    }
+  }
+  else {
+    ThreadPool pool(std::min(numThreads, (int)files.size()));
+    vector< std::future<void> > tasks;
+    for (int i = 0; i < files.size(); i++) {
+      tasks.emplace_back(pool.enqueue(parse, i));
+    }
+    for (auto& t : tasks) {
+      t.get();
+    }
+  }
+
+  parsed_rows_t rows;
+  for (int i = 0; i < files.size() && (maxNumRow <= 0 || rows.lengths.size() < maxNumRow); i++) {
+    const parsed_rows_t& p = parsed[i];
+    string stem = _fileStem(files[i]);
+    int rowCount = p.lengths.size();
+    for (int r = 0; r < rowCount; r++) {
+      if (hasNameCol && r < p.names.size()) {
+        rows.names.push_back(stem + ":" + p.names[r]);
+      }
+      else if (rowCount == 1) {
+        rows.names.push_back(stem);
+      }
+      else {
+        rows.names.push_back(stem + ":" + std::to_string(r));
+      }
+      rows.rowOffsets.push_back(rows.values.size() + p.rowOffsets[r]);
+    }
+    rows.values.insert(rows.values.end(), p.values.begin(), p.values.end());
+    rows.lengths.insert(rows.lengths.end(), p.lengths.begin(), p.lengths.end());
+    vector<data_t>().swap(parsed[i].values);
+  }
+
+  this->_setRows(rows, maxNumRow);
+  this->filePath = path;
+}
+
+/**
+ * Writes x the way an output stream with the default precision (6 significant
+ * digits, %g style) does, and returns the end of the written text. Values
+ * printed in fixed notation, which covers most datasets, are formatted with
+ * integer arithmetic. Others, and values too close to a rounding tie to be
+ * sure of the rounding direction, go through snprintf.
+ */
+static char* _formatValue(data_t x, char* out)
+{
+  static const data_t POW10[] = {1e-4, 1e-3, 1e-2, 1e-1, 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9};
+  data_t ax = std::abs(x);
+  if (x == 0) {
+    if (std::signbit(x)) {
+      *out++ = '-';
+    }
+    *out++ = '0';
+    return out;
+  }
+  // Fixed notation is used when the decimal exponent is in [-4, 6)
+  if (ax >= 1e-4 && ax < 999999.5) {
+    int e = 5;
+    while (e > -4 && ax < POW10[e + 4]) {
+      e--;
+    }
+    // Six significant digits as an integer in [100000, 1000000]
+    data_t scaled = ax * POW10[5 - e + 4];
+    data_t rounded = std::floor(scaled + 0.5);
+    if (std::abs(scaled - std::floor(scaled) - 0.5) > 1e-6 && rounded < 1e6) {
+      long digits = (long)rounded;
+      char buf[8];
+      for (int i = 5; i >= 0; i--) {
+        buf[i] = '0' + digits % 10;
+        digits /= 10;
+      }
+      // Drop trailing zeros after the decimal point
+      int last = 5;
+      while (last > e && last > 0 && buf[last] == '0') {
+        last--;
+      }
+      if (x < 0) {
+        *out++ = '-';
+      }
+      if (e >= 0) {
+        for (int i = 0; i <= last; i++) {
+          if (i == e + 1) {
+            *out++ = '.';
+          }
+          *out++ = buf[i];
+        }
+      }
+      else {
+        *out++ = '0';
+        *out++ = '.';
+        for (int i = 0; i < -e - 1; i++) {
+          *out++ = '0';
+        }
+        for (int i = 0; i <= last; i++) {
+          *out++ = buf[i];
+        }
+      }
+      return out;
+    }
+  }
+  return out + snprintf(out, 32, "%g", x);
+}
+
+void TimeSeriesSet::saveData(const string& filePath, char separator, int numThreads) const
+{
+  if (numThreads < 1) {
+    throw GenexException("Number of threads must be positive");
+  }
+  std::ofstream f(filePath, std::ios::binary);
+  if (!f.is_open())
+  {
+    f.close();
+    throw GenexException(string("Cannot open ") + filePath);
+  }
+
+  // Formats rows [begin, end) into a buffer of its own
+  auto formatRows = [this, separator](int begin, int end) {
+    string buffer;
+    char value[32];
+    for (int i = begin; i < end; i++) {
+      if (!this->names.empty()) {
+        buffer += this->names[i];
+        buffer += separator;
+      }
+      const data_t* row = this->data + i * this->maxCol;
+      for (int j = 0; j < this->lengths[i]; j++) {
+        char* valueEnd = _formatValue(row[j], value);
+        *valueEnd++ = separator;
+        buffer.append(value, valueEnd);
+      }
+      buffer += '\n';
+    }
+    return buffer;
+  };
+
+  // Chunks of about 1MB of values, formatted ahead by at most 2 chunks per
+  // thread so that memory stays bounded for large datasets
+  int rowsPerChunk = std::max(1, (1 << 17) / std::max(1, this->maxCol));
+  if (numThreads == 1) {
+    for (int begin = 0; begin < this->itemCount; begin += rowsPerChunk) {
+      string buffer = formatRows(begin, std::min(begin + rowsPerChunk, this->itemCount));
+      f.write(buffer.data(), buffer.size());
+    }
+  }
+  else {
+    ThreadPool pool(numThreads);
+    std::queue< std::future<string> > pending;
+    for (int begin = 0; begin < this->itemCount; begin += rowsPerChunk) {
+      int end = std::min(begin + rowsPerChunk, this->itemCount);
+      pending.push(pool.enqueue(formatRows, begin, end));
+      if (pending.size() >= 2 * numThreads) {
+        string buffer = pending.front().get();
+        pending.pop();
+        f.write(buffer.data(), buffer.size());
+      }
+    }
+    while (!pending.empty()) {
+      string buffer = pending.front().get();
+      pending.pop();
+      f.write(buffer.data(), buffer.size());
+    }
+  }
+
+  if (!f.good())
+  {
+    f.close();
+    throw GenexException(string("Error while writing ") + filePath);
+  }
   f.close();
 }
 
-void TimeSeriesSet::saveData(const string& filePath, char separator) const
+static const char BINARY_DATA_SIGNATURE[8] = {'G', 'E', 'N', 'E', 'X', 'D', 'S', '\0'};
+static const uint32_t BINARY_DATA_VERSION = 1;
+
+template<typename V>
+static void _writeBinary(std::ofstream& f, const V& value)
+{
+  f.write(reinterpret_cast<const char*>(&value), sizeof(V));
+}
+
+template<typename V>
+static void _readBinary(std::ifstream& f, V& value)
+{
+  if (!f.read(reinterpret_cast<char*>(&value), sizeof(V))) {
+    throw GenexException("Binary dataset file is truncated");
+  }
+}
+
+void TimeSeriesSet::saveDataBinary(const string& filePath) const
 {
-  std::ofstream f(filePath);
+  std::ofstream f(filePath, std::ios::binary);
   if (!f.is_open())
   {
     f.close();
     throw GenexException(string("Cannot open ") + filePath);
   }
-  for (int i = 0; i < itemCount; i++) {
-    if (!this->names.empty()) {
-      f << names[i] << separator;
+
+  f.write(BINARY_DATA_SIGNATURE, sizeof(BINARY_DATA_SIGNATURE));
+  _writeBinary(f, BINARY_DATA_VERSION);
+  _writeBinary(f, (int32_t)this->itemCount);
+  _writeBinary(f, (int32_t)this->maxCol);
+  _writeBinary(f, (uint8_t)this->normalized);
+  _writeBinary(f, (uint8_t)!this->names.empty());
+  for (int i = 0; i < this->itemCount; i++) {
+    _writeBinary(f, (int32_t)this->lengths[i]);
+  }
+  for (const auto& name : this->names) {
+    _writeBinary(f, (uint32_t)name.size());
+    f.write(name.data(), name.size());
+  }
+  for (int i = 0; i < this->itemCount; i++) {
+    f.write(reinterpret_cast<const char*>(this->data + i * this->maxCol),
+            this->lengths[i] * sizeof(data_t));
+  }
+
+  if (!f.good())
+  {
+    f.close();
+    throw GenexException(string("Error while writing ") + filePath);
+  }
+  f.close();
+}
+
+bool TimeSeriesSet::isBinaryDataFile(const string& filePath)
+{
+  std::ifstream f(filePath, std::ios::binary);
+  char signature[sizeof(BINARY_DATA_SIGNATURE)];
+  return f.read(signature, sizeof(signature)) &&
+    std::equal(signature, signature + sizeof(signature), BINARY_DATA_SIGNATURE);
+}
+
+void TimeSeriesSet::loadDataBinary(const string& filePath)
+{
+  this->clearData();
+
+  std::ifstream f(filePath, std::ios::binary);
+  if (!f.is_open())
+  {
+    throw GenexException(string("Cannot open ") + filePath);
+  }
+
+  try
+  {
+    char signature[sizeof(BINARY_DATA_SIGNATURE)];
+    if (!f.read(signature, sizeof(signature)) ||
+        !std::equal(signature, signature + sizeof(signature), BINARY_DATA_SIGNATURE))
+    {
+      throw GenexException("File is not a binary dataset");
+    }
+    uint32_t version;
+    int32_t itemCount, maxCol;
+    uint8_t normalized, hasNames;
+    _readBinary(f, version);
+    if (version != BINARY_DATA_VERSION)
+    {
+      throw GenexException("Incompatible binary dataset version");
+    }
+    _readBinary(f, itemCount);
+    _readBinary(f, maxCol);
+    _readBinary(f, normalized);
+    _readBinary(f, hasNames);
+    if (itemCount < 0 || maxCol < 0)
+    {
+      throw GenexException("Binary dataset file is corrupted");
+    }
+
+    this->lengths.resize(itemCount);
+    for (int i = 0; i < itemCount; i++) {
+      int32_t length;
+      _readBinary(f, length);
+      if (length < 0 || length > maxCol)
+      {
+        throw GenexException("Binary dataset file is corrupted");
+      }
+      this->lengths[i] = length;
     }
-    for (int j = 0; j < this->lengths[i]; j++) {
-      f << data[i * this->maxCol + j] << separator;
+    if (hasNames) {
+      this->names.resize(itemCount);
+      for (int i = 0; i < itemCount; i++) {
+        uint32_t size;
+        _readBinary(f, size);
+        this->names[i].resize(size);
+        if (size > 0 && !f.read(&this->names[i][0], size)) {
+          throw GenexException("Binary dataset file is truncated");
+        }
+      }
+    }
+
+    this->data = new data_t[(size_t)itemCount * maxCol]();
+    this->itemCount = itemCount;
+    this->maxCol = maxCol;
+    for (int i = 0; i < itemCount; i++) {
+      auto bytes = this->lengths[i] * sizeof(data_t);
+      if (bytes > 0 && !f.read(reinterpret_cast<char*>(this->data + i * maxCol), bytes)) {
+        throw GenexException("Binary dataset file is truncated");
+      }
     }
-    f << endl;
+    this->normalized = normalized;
+  }
+  catch (GenexException& e)
+  {
+    f.close();
+    this->clearData();
+    throw;
   }
+
+  this->filePath = filePath;
   f.close();
+
+  if (this->keepPrefixSums) {
+    this->_buildPrefixSums();
+  }
 }
 
 void TimeSeriesSet::clearData()
@@ -176,6 +627,51 @@ void TimeSeriesSet::clearData()
   this->itemCount = 0;
   this->maxCol = 0;
   this->names.clear();
+  this->lengths.clear();
+  this->prefixSums.clear();
+  this->prefixSumsSquared.clear();
+  this->stats.clear();
+}
+
+void TimeSeriesSet::setKeepPrefixSums(bool keep)
+{
+  this->keepPrefixSums = keep;
+  if (!keep) {
+    this->prefixSums.clear();
+    this->prefixSumsSquared.clear();
+  }
+  else if (this->data != nullptr && this->prefixSums.empty()) {
+    this->_buildPrefixSums();
+  }
+}
+
+void TimeSeriesSet::_buildPrefixSums()
+{
+  int stride = this->maxCol + 1;
+  this->prefixSums.assign(this->itemCount * stride, 0);
+  this->prefixSumsSquared.assign(this->itemCount * stride, 0);
+  for (int ts = 0; ts < this->itemCount; ts++) {
+    const data_t* row = this->data + ts * this->maxCol;
+    data_t* sum = &this->prefixSums[ts * stride];
+    data_t* sumSquared = &this->prefixSumsSquared[ts * stride];
+    // Neumaier's variant of Kahan summation, the compensations are
+    // added back to every stored prefix
+    data_t s = 0, c = 0, s2 = 0, c2 = 0;
+    for (int i = 0; i < this->lengths[ts]; i++) {
+      data_t x = row[i];
+      data_t t = s + x;
+      c += std::abs(s) >= std::abs(x) ? (s - t) + x : (x - t) + s;
+      s = t;
+
+      data_t x2 = x * x;
+      data_t t2 = s2 + x2;
+      c2 += s2 >= x2 ? (s2 - t2) + x2 : (x2 - t2) + s2;
+      s2 = t2;
+
+      sum[i + 1] = s + c;
+      sumSquared[i + 1] = s2 + c2;
+    }
+  }
 }
 
 TimeSeries TimeSeriesSet::getTimeSeries(int index, int start, int end) const
@@ -186,16 +682,120 @@ TimeSeries TimeSeriesSet::getTimeSeries(int index, int start, int end) const
   }
   if (start < 0 && end < 0)
   {
-    return TimeSeries(this->data + index * this->maxCol, index, 0, this->lengths[index]);
+    start = 0;
+    end = this->lengths[index];
   }
-  if (start < 0 || start >= end || end > this->lengths[index])
+  else if (start < 0 || start >= end || end > this->lengths[index])
   {
     throw GenexException("Invalid starting or ending position of a time series");
   }
-  return TimeSeries(this->data + index * this->maxCol, index, start, end);
+  TimeSeries ts(this->data + index * this->maxCol, index, start, end);
+  if (!this->prefixSums.empty())
+  {
+    int offset = index * (this->maxCol + 1);
+    ts.setPrefixSums(&this->prefixSums[offset], &this->prefixSumsSquared[offset]);
+  }
+  return ts;
+}
+
+/**
+ * Vectorized kernels over a single row. Rows are not aligned, so unaligned
+ * loads are used. The scalar loops handle the tails and non-SSE2 targets.
+ */
+static void _rowMinMax(const data_t* x, int n, data_t& rowMin, data_t& rowMax)
+{
+  int i = 0;
+  data_t mn = INF, mx = -INF;
+#ifdef __SSE2__
+  if (n >= 2) {
+    __m128d vmin = _mm_loadu_pd(x);
+    __m128d vmax = vmin;
+    for (i = 2; i + 2 <= n; i += 2) {
+      __m128d v = _mm_loadu_pd(x + i);
+      vmin = _mm_min_pd(vmin, v);
+      vmax = _mm_max_pd(vmax, v);
+    }
+    data_t lanes[2];
+    _mm_storeu_pd(lanes, vmin);
+    mn = min(lanes[0], lanes[1]);
+    _mm_storeu_pd(lanes, vmax);
+    mx = max(lanes[0], lanes[1]);
+  }
+#endif
+  for (; i < n; i++) {
+    mn = min(mn, x[i]);
+    mx = max(mx, x[i]);
+  }
+  rowMin = mn;
+  rowMax = mx;
 }
 
-std::pair<data_t, data_t> TimeSeriesSet::normalize(void)
+static void _rowSums(const data_t* x, int n, data_t& rowSum, data_t& rowSumSquared)
+{
+  int i = 0;
+  data_t sum = 0, sumSquared = 0;
+#ifdef __SSE2__
+  __m128d vsum = _mm_setzero_pd();
+  __m128d vsumSquared = _mm_setzero_pd();
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_loadu_pd(x + i);
+    vsum = _mm_add_pd(vsum, v);
+    vsumSquared = _mm_add_pd(vsumSquared, _mm_mul_pd(v, v));
+  }
+  data_t lanes[2];
+  _mm_storeu_pd(lanes, vsum);
+  sum = lanes[0] + lanes[1];
+  _mm_storeu_pd(lanes, vsumSquared);
+  sumSquared = lanes[0] + lanes[1];
+#endif
+  for (; i < n; i++) {
+    sum += x[i];
+    sumSquared += x[i] * x[i];
+  }
+  rowSum = sum;
+  rowSumSquared = sumSquared;
+}
+
+static void _rowRescale(data_t* x, int n, data_t offset, data_t range)
+{
+  int i = 0;
+#ifdef __SSE2__
+  __m128d voffset = _mm_set1_pd(offset);
+  __m128d vrange = _mm_set1_pd(range);
+  for (; i + 2 <= n; i += 2) {
+    __m128d v = _mm_loadu_pd(x + i);
+    _mm_storeu_pd(x + i, _mm_div_pd(_mm_sub_pd(v, voffset), vrange));
+  }
+#endif
+  for (; i < n; i++) {
+    x[i] = (x[i] - offset) / range;
+  }
+}
+
+void TimeSeriesSet::_forEachRowChunk(
+  int numThreads, const std::function<void(int, int)>& f) const
+{
+  if (numThreads < 1) {
+    throw GenexException("Number of threads must be positive");
+  }
+  numThreads = std::min(numThreads, this->itemCount);
+  if (numThreads <= 1) {
+    f(0, this->itemCount);
+    return;
+  }
+  ThreadPool pool(numThreads);
+  vector< std::future<void> > chunks;
+  int chunkSize = (this->itemCount + numThreads - 1) / numThreads;
+  for (int begin = 0; begin < this->itemCount; begin += chunkSize) {
+    int end = std::min(begin + chunkSize, this->itemCount);
+    chunks.emplace_back(pool.enqueue([&f, begin, end] { f(begin, end); }));
+  }
+  for (auto& c : chunks) {
+    c.get();
+  }
+}
+
+std::pair<data_t, data_t> TimeSeriesSet::normalize(int numThreads)
 {
 
   if (!this->itemCount)
@@ -203,62 +803,21 @@ std::pair<data_t, data_t> TimeSeriesSet::normalize(void)
     throw GenexException("No data to normalize");
   }
 
-  // auto minAndMax = std::minmax(this->data);
-  // data_t diff = *minAndMax.first - *minAndMax.second;
-  data_t MIN = INF;
-  data_t MAX = -INF;
-  unsigned int i;
-
-  // find min and max in 1.5 comparisons per element
-  // for (int ts = 0; ts < this->itemCount; ts++)
-  // {
-  //   data_t x, y, z;
-
-  //   // start at 0 if even, 1 if odd
-  //   if ((i = (length % 2 != 0)))
-  //   {
-  //     if (data[ts * this->itemLength] < MIN)
-  //     {
-  //       MIN = data[ts * this->itemLength];
-  //     }
-  //     if (data[ts * this->itemLength] > MAX)
-  //     {
-  //       MAX = data[ts * this->itemLength];
-  //     }
-  //   }
-
-  //   for (; i < this->itemLength - 1; i += 2)
-  //   {
-  //     x = data[ts * this->itemLength + i];
-  //     y = data[ts * this->itemLength + (i + 1)];
-  //     if ( x > y )
-  //     {
-  //       z = y;
-  //       y = x;
-  //       x = z;
-  //     }
-  //     if ( y > MAX )
-  //     {
-  //       MAX = y;
-  //     }
-  //     if ( x < MIN )
-  //     {
-  //       MIN = x;
-  //     }
-  //   }
-  // }
-
-  for (int ts = 0; ts < this->itemCount; ts++) {
-    for (i = 0; i < this->lengths[ts]; i++) {
-      if (data[ts * this->maxCol + i] > MAX) {
-        MAX = data[ts * this->maxCol + i];
-      }
-
-      if (data[ts * this->maxCol + i] < MIN) {
-        MIN = data[ts * this->maxCol + i];
-      }
+  // Each chunk of rows reduces to its own min and max
+  int numChunks = std::max(1, std::min(numThreads, this->itemCount));
+  vector<data_t> chunkMin(numChunks, INF), chunkMax(numChunks, -INF);
+  int chunkSize = (this->itemCount + numChunks - 1) / numChunks;
+  _forEachRowChunk(numThreads, [&](int begin, int end) {
+    int chunk = begin / chunkSize;
+    for (int ts = begin; ts < end; ts++) {
+      data_t rowMin, rowMax;
+      _rowMinMax(this->data + ts * this->maxCol, this->lengths[ts], rowMin, rowMax);
+      chunkMin[chunk] = min(chunkMin[chunk], rowMin);
+      chunkMax[chunk] = max(chunkMax[chunk], rowMax);
     }
-  }
+  });
+  data_t MIN = *std::min_element(chunkMin.begin(), chunkMin.end());
+  data_t MAX = *std::max_element(chunkMax.begin(), chunkMax.end());
 
   data_t diff = MAX - MIN;
 
@@ -267,31 +826,86 @@ std::pair<data_t, data_t> TimeSeriesSet::normalize(void)
   {
     if (MAX != 0)
     {
-      // zero out data (use memset instead...)
-      for (int ts = 0; ts < this->itemCount; ts++)
-      {
-        for (i = 0; i < this->lengths[ts]; i++)
-        {
-          data[ts * this->maxCol + i] = 0;
+      // zero out data
+      _forEachRowChunk(numThreads, [this](int begin, int end) {
+        for (int ts = begin; ts < end; ts++) {
+          std::fill_n(this->data + ts * this->maxCol, this->lengths[ts], 0);
         }
+      });
+      for (auto& st : this->stats) {
+        st.min = st.max = st.mean = st.std = 0;
       }
     }
   }
   else
   {
     // normalize
-    for (int ts = 0; ts < this->itemCount; ts++)
-    {
-      for (i = 0; i < this->lengths[ts]; i++)
-      {
-        data[ts * this->maxCol + i] = (data[ts * this->maxCol + i] - MIN)/ diff;
+    _forEachRowChunk(numThreads, [this, MIN, diff](int begin, int end) {
+      for (int ts = begin; ts < end; ts++) {
+        _rowRescale(this->data + ts * this->maxCol, this->lengths[ts], MIN, diff);
       }
+    });
+    // The transformation is affine so the statistics follow without a rescan
+    for (auto& st : this->stats) {
+      st.min = (st.min - MIN) / diff;
+      st.max = (st.max - MIN) / diff;
+      st.mean = (st.mean - MIN) / diff;
+      st.std = st.std / diff;
     }
   }
   normalized = true;
+  if (this->keepPrefixSums) {
+    this->_buildPrefixSums();
+  }
   return std::make_pair(MIN, MAX);
 }
 
+void TimeSeriesSet::computeStatistics(int numThreads)
+{
+  if (!this->itemCount)
+  {
+    throw GenexException("No data to compute statistics");
+  }
+
+  vector<series_stats_t> newStats(this->itemCount);
+  _forEachRowChunk(numThreads, [this, &newStats](int begin, int end) {
+    for (int ts = begin; ts < end; ts++) {
+      const data_t* row = this->data + ts * this->maxCol;
+      int length = this->lengths[ts];
+      series_stats_t& st = newStats[ts];
+      _rowMinMax(row, length, st.min, st.max);
+
+      data_t sum, sumSquared;
+      _rowSums(row, length, sum, sumSquared);
+      st.mean = sum / length;
+      // Cancellation may make the variance slightly negative for constant rows
+      data_t variance = sumSquared / length - st.mean * st.mean;
+      st.std = variance > 0 ? sqrt(variance) : 0;
+
+      int run = 1;
+      st.longestConstantRun = length > 0 ? 1 : 0;
+      for (int i = 1; i < length; i++) {
+        run = row[i] == row[i - 1] ? run + 1 : 1;
+        st.longestConstantRun = std::max(st.longestConstantRun, run);
+      }
+    }
+  });
+  this->stats.swap(newStats);
+}
+
+const series_stats_t& TimeSeriesSet::getSeriesStats(int index) const
+{
+  if (this->stats.empty())
+  {
+    throw GenexException("Statistics of the dataset are not computed");
+  }
+  if (index < 0 || index >= this->itemCount)
+  {
+    throw GenexException("Invalid time series index");
+  }
+  return this->stats[index];
+}
+
 vector<candidate_time_series_t> TimeSeriesSet::getKBestMatchesBruteForce(
   const TimeSeries& query, int k, string distanceName)
 {
@@ -302,6 +916,9 @@ vector<candidate_time_series_t> TimeSeriesSet::getKBestMatchesBruteForce(
   vector<candidate_time_series_t> bestSoFar;
 
   auto warpedDistance = getDistanceFromName(distanceName + DTW_SUFFIX);
+  if (isZNormalizedDistance(distanceName)) {
+    this->setKeepPrefixSums(true);
+  }
   data_t bestSoFarDist, currentDist;
   // auto timeSeriesLength = getItemLength();
   auto numberTimeSeries = getItemCount();
@@ -1,6 +1,7 @@
 #ifndef TIMESERIESSET_H
 #define TIMESERIESSET_H
 
+#include <functional>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,21 @@ using std::vector;
 
 namespace genex {
 
+struct parsed_rows_t;
+
+/**
+ *  @brief statistics of a single time series in a dataset
+ */
+struct series_stats_t
+{
+  data_t min = 0;
+  data_t max = 0;
+  data_t mean = 0;
+  data_t std = 0;
+  // Number of points in the longest run of consecutive equal values
+  int longestConstantRun = 0;
+};
+
 /**
  *  @brief a TimeSeriesSet object contains values and information of a dataset
  *
@@ -45,6 +61,10 @@ public:
    *  or equal to the actual number of lines, or maxNumRow is not positive, all lines 
    *  are read.
    *
+   *  The file is read in a single pass, so it can be streamed. Files ending with
+   *  ".gz" are decompressed with gzip, files ending with ".z" or ".zlib" with zlib,
+   *  and "-" reads from the standard input.
+   *
    *  @param filePath path to a text file
    *  @param maxNumRow maximum number of rows to be read. If this value is not positive,
    *         all lines are read
@@ -63,7 +83,87 @@ public:
                , const string& separator
                , bool hasNameCol = false);
 
-  void saveData(const string& filePath, char separator) const;
+  /**
+   *  @brief loads data from many text files into a single dataset
+   *
+   *  The files are either all regular files in a directory or the files
+   *  matching a glob pattern. They are parsed in parallel, each one the same
+   *  way as in loadData, and their rows are concatenated in the order of the
+   *  sorted file paths. A row is named after the stem of its file (the file
+   *  name without directory and extensions), followed by ":<name>" if there is
+   *  a name column or by ":<row>" if the file has more than one row.
+   *
+   *  @param path a directory or a glob pattern
+   *  @param maxNumRow maximum number of rows to be read in total. Files after
+   *         the first maxNumRow rows are not read, except by threads that
+   *         started on them before. If this value is not positive, all lines are read
+   *  @param startCol columns before startCol, in 0-based index, are discarded.
+   *  @param separator a string containing possible separator characters for values
+   *         in a line
+   *  @param hasNameCol whether the first column (starting from startCol) is the one
+   *         with names for each time series
+   *  @param numThreads number of threads parsing the files
+   *
+   *  @throw GenexException if no file is found or cannot read from one of the files
+   */
+  void loadDataFiles(const string& path
+                    , int maxNumRow
+                    , int startCol
+                    , const string& separator
+                    , bool hasNameCol = false
+                    , int numThreads = 1);
+
+  /**
+   *  @brief checks if a path refers to many files (a directory or a glob pattern)
+   */
+  static bool isMultiFilePath(const string& path);
+
+  /**
+   *  @brief saves data to a text file
+   *
+   *  Each time series is written on its own line, preceded by its name if the
+   *  dataset has names. Every value is followed by the separator and printed with
+   *  6 significant digits, like the default formatting of an output stream. Rows
+   *  are formatted in chunks by numThreads threads and written in order.
+   *
+   *  @param filePath path to the text file
+   *  @param separator a character to separate values in a line
+   *  @param numThreads number of threads formatting the rows
+   *
+   *  @throw GenexException if cannot write to the given file
+   */
+  void saveData(const string& filePath, char separator, int numThreads = 1) const;
+
+  /**
+   *  @brief saves data to a binary file
+   *
+   *  Values are written with full precision so loading the file with
+   *  loadDataBinary gives back exactly the same dataset. The format is described
+   *  in genex/README.md.
+   *
+   *  @param filePath path to the binary file
+   *
+   *  @throw GenexException if cannot write to the given file
+   */
+  void saveDataBinary(const string& filePath) const;
+
+  /**
+   *  @brief loads data from a binary file written by saveDataBinary
+   *
+   *  @param filePath path to the binary file
+   *
+   *  @throw GenexException if cannot read from the given file or the file is
+   *         not a valid binary dataset
+   */
+  void loadDataBinary(const string& filePath);
+
+  /**
+   *  @brief checks if a file is a binary dataset written by saveDataBinary
+   *
+   *  @param filePath path to a file
+   *  @return true if the file starts with the binary dataset signature
+   */
+  static bool isBinaryDataFile(const string& filePath);
 
   /**
    * @brief clears all data
@@ -123,12 +223,38 @@ public:
    *  Each value in the dataset is transformed by the following formula:
    *    d = (d - min) / (max - min)
    *  Where min and max are respectively the minimum and maximum values
-   *  across the whole dataset.
+   *  across the whole dataset. Statistics of the time series, if computed,
+   *  are updated accordingly.
    *
+   * @param numThreads number of threads to scan and rewrite the rows with
    * @return a pair (min, max) - the minimum and maximum value across
    *          the whole dataset before being normalized.
    */
-  std::pair<data_t, data_t> normalize();
+  virtual std::pair<data_t, data_t> normalize(int numThreads = 1);
+
+  /**
+   *  @brief computes statistics of every time series in the dataset
+   *
+   *  The statistics are kept until the dataset is cleared or reloaded.
+   *
+   *  @param numThreads number of threads to scan the rows with
+   */
+  void computeStatistics(int numThreads = 1);
+
+  /**
+   *  @brief check if statistics of the time series are computed
+   */
+  bool hasStatistics() const { return !this->stats.empty(); }
+
+  /**
+   *  @brief gets statistics of a time series
+   *
+   *  @param index index of the time series
+   *  @return statistics of the time series
+   *
+   *  @throw GenexException if statistics are not computed or index is invalid
+   */
+  const series_stats_t& getSeriesStats(int index) const;
 
   /**
   *  @brief check if the dataset is normalized
@@ -140,6 +266,25 @@ public:
    */
   bool isLoaded() { return this->data != nullptr; }
 
+  /**
+   *  @brief sets whether prefix sums of every time series are kept
+   *
+   *  When enabled, prefix sums of the values and of the squared values are
+   *  built for every time series (right away if data is already loaded, and
+   *  again after every load or normalization). Time series returned by
+   *  getTimeSeries then compute their mean, standard deviation and PAA block
+   *  averages in constant time. Sums are accumulated with compensated
+   *  (Kahan-Babuska) summation to limit cancellation error on long series.
+   *
+   *  @param keep whether prefix sums are kept
+   */
+  void setKeepPrefixSums(bool keep);
+
+  /**
+   *  @brief check if prefix sums are available
+   */
+  bool hasPrefixSums() const { return !this->prefixSums.empty(); }
+
   /**
    * @brief Exhaustively searches through timeseries set for k similar time series.
    * 
@@ -162,8 +307,19 @@ protected:
   int maxCol;
 
 private:
+  void _buildPrefixSums();
+  void _setRows(const parsed_rows_t& rows, int maxNumRow);
+  void _forEachRowChunk(int numThreads, const std::function<void(int, int)>& f) const;
+
   string filePath;
   bool normalized;
+
+  // Row i of the prefix sums starts at i * (maxCol + 1)
+  bool keepPrefixSums = false;
+  vector<data_t> prefixSums;
+  vector<data_t> prefixSumsSquared;
+
+  vector<series_stats_t> stats;
 };
 
 } // namespace genex
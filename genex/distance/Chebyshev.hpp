@@ -37,6 +37,11 @@ public:
     return norm(total, t_1, t_2);
   }
 
+  data_t extend(data_t distance, int length, data_t x_1, data_t x_2) const
+  {
+    return std::max(distance, dist(x_1, x_2));
+  }
+
   void clean(data_t x) {}
 
 };
@@ -33,7 +33,12 @@ static vector<dist_t> gAllDistance =
     NEW_DISTANCE(Manhattan, data_t),
     NEW_DISTANCE(Chebyshev, data_t),
     NEW_DISTANCE(Cosine, data_t*),
-    NEW_DISTANCE(Sorensen, data_t*)
+    NEW_DISTANCE(Sorensen, data_t*),
+    NEW_ZNORM_DISTANCE(Euclidean, data_t),
+    NEW_ZNORM_DISTANCE(Manhattan, data_t),
+    NEW_ZNORM_DISTANCE(Chebyshev, data_t),
+    NEW_ZNORM_DISTANCE(Cosine, data_t*),
+    NEW_ZNORM_DISTANCE(Sorensen, data_t*)
   };
 
 /**
@@ -45,7 +50,47 @@ static vector<string> gAllDistanceName =
     NEW_DISTANCE_NAME(manhattan),
     NEW_DISTANCE_NAME(chebyshev),
     NEW_DISTANCE_NAME(cosine),
-    NEW_DISTANCE_NAME(sorensen)
+    NEW_DISTANCE_NAME(sorensen),
+    NEW_ZNORM_DISTANCE_NAME(euclidean),
+    NEW_ZNORM_DISTANCE_NAME(manhattan),
+    NEW_ZNORM_DISTANCE_NAME(chebyshev),
+    NEW_ZNORM_DISTANCE_NAME(cosine),
+    NEW_ZNORM_DISTANCE_NAME(sorensen)
+  };
+
+/**
+ *  Add names of distances satisfying the triangle inequality to this list
+ */
+static vector<string> gMetricDistanceName =
+  {
+    "euclidean",
+    "manhattan",
+    "chebyshev",
+    "euclidean_znorm",
+    "manhattan_znorm",
+    "chebyshev_znorm"
+  };
+
+/**
+ *  Add distances whose pairwise distance can be extended by one point in
+ *  constant time to this list
+ */
+static vector< pair<string, extend_t> > gDistanceExtension =
+  {
+    { "euclidean", extendDistance<Euclidean> },
+    { "manhattan", extendDistance<Manhattan> },
+    { "chebyshev", extendDistance<Chebyshev> }
+  };
+
+/**
+ *  Add names of distances never smaller than the difference between the means
+ *  of their inputs to this list
+ */
+static vector<string> gMeanBoundedDistanceName =
+  {
+    "euclidean",
+    "manhattan",
+    "chebyshev"
   };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -80,6 +125,36 @@ const vector<string>& getAllDistanceName()
   return gAllDistanceName;
 }
 
+bool isZNormalizedDistance(const string& distance_name)
+{
+  return distance_name.find(ZNORM_SUFFIX) != string::npos;
+}
+
+bool isMetricDistance(const string& distance_name)
+{
+  return std::find(gMetricDistanceName.begin(), gMetricDistanceName.end(), distance_name)
+    != gMetricDistanceName.end();
+}
+
+bool isMeanBoundedDistance(const string& distance_name)
+{
+  return std::find(gMeanBoundedDistanceName.begin(), gMeanBoundedDistanceName.end(), distance_name)
+    != gMeanBoundedDistanceName.end();
+}
+
+thread_local long gPairwiseComparisons = 0;
+thread_local long gPairwisePoints = 0;
+
+extend_t getDistanceExtensionFromName(const string& distance_name)
+{
+  for (auto& e : gDistanceExtension) {
+    if (e.first == distance_name) {
+      return e.second;
+    }
+  }
+  return nullptr;
+}
+
 double warpingBandRatio = 0.1;
 
 void setWarpingBandRatio(double ratio) {
@@ -15,6 +15,14 @@
 
 #define NEW_DISTANCE_NAME(_name) #_name, #_name"_dtw"
 
+#define ZNORM_SUFFIX "_znorm"
+
+#define NEW_ZNORM_DISTANCE(_class, _type)     \
+  pairwiseDistance<_class, _type, ZNormValue>, \
+  warpedDistance<_class, _type, ZNormValue>
+
+#define NEW_ZNORM_DISTANCE_NAME(_name) #_name"_znorm", #_name"_znorm_dtw"
+
 using std::min;
 using std::max;
 using std::make_pair;
@@ -28,6 +36,7 @@ using coord_t = std::pair<int, int>;
 using matching_t = std::vector<coord_t>;
 using dist_t = 
     data_t (*)(const TimeSeries&, const TimeSeries&, data_t, matching_t&);
+using extend_t = data_t (*)(data_t, int, data_t, data_t);
 
 int calculateWarpingBandSize(int length);
 void setWarpingBandRatio(double ratio);
@@ -46,6 +55,104 @@ const dist_t getDistanceFromName(const string& distance_name);
  */
 const vector<string>& getAllDistanceName();
 
+/**
+ *  @brief checks if a distance z-normalizes its inputs
+ *
+ *  @param distance_name name of a distance metric
+ *  @return true if the distance is a z-normalized variant
+ */
+bool isZNormalizedDistance(const string& distance_name);
+
+/**
+ *  @brief checks if a pairwise distance satisfies the triangle inequality
+ *
+ *  Metric distances allow whole sets of centroids to be skipped during grouping
+ *  (see VPTree). Warped distances are never metrics.
+ *
+ *  @param distance_name name of a distance metric
+ *  @return true if the distance is a metric
+ */
+bool isMetricDistance(const string& distance_name);
+
+/**
+ *  @brief checks if a pairwise distance is bounded below by the means of its inputs
+ *
+ *  For such a distance, |mean(a) - mean(b)| <= d(a, b), so centroids can be
+ *  visited by increasing difference of means and skipped once that difference
+ *  exceeds the best distance found (see LocalLengthGroupSpace::enableOrdering).
+ *
+ *  @param distance_name name of a distance metric
+ *  @return true if the distance is bounded by the difference of means
+ */
+bool isMeanBoundedDistance(const string& distance_name);
+
+/**
+ *  Number of pairwise distances computed on the calling thread and of points
+ *  compared by them. A computation abandoned early only counts the points
+ *  compared before abandoning.
+ */
+extern thread_local long gPairwiseComparisons;
+extern thread_local long gPairwisePoints;
+
+/**
+ *  @brief returns a function extending a pairwise distance by one point
+ *
+ *  Given the pairwise distance of two time series of length n and the values
+ *  appended to each of them, the function returns the pairwise distance of the
+ *  two extended time series in constant time (up to rounding).
+ *
+ *  @param distance_name name of a distance metric
+ *  @return the extension function, or nullptr if the distance cannot be extended
+ */
+extend_t getDistanceExtensionFromName(const string& distance_name);
+
+/**
+ *  Adapts the extend method of a distance metric class to extend_t.
+ */
+template<typename DM>
+data_t extendDistance(data_t distance, int length, data_t x_1, data_t x_2)
+{
+  static DM metric;
+  return metric.extend(distance, length, x_1, x_2);
+}
+
+/**
+ *  Reads values of a time series as they are.
+ */
+class RawValue
+{
+public:
+  RawValue(const TimeSeries& ts) : ts(ts) {}
+
+  data_t operator[](int i) const { return ts[i]; }
+
+private:
+  const TimeSeries& ts;
+};
+
+/**
+ *  Reads values of a time series z-normalized by the mean and standard deviation
+ *  of that time series. The statistics take constant time to compute if the time
+ *  series carries prefix sums (see TimeSeriesSet::setKeepPrefixSums). A time series
+ *  with (near) zero standard deviation is read as all zeros.
+ */
+class ZNormValue
+{
+public:
+  ZNormValue(const TimeSeries& ts) : ts(ts), mean(ts.average())
+  {
+    data_t std = ts.stddev();
+    invStd = std < EPS ? 0 : 1 / std;
+  }
+
+  data_t operator[](int i) const { return (ts[i] - mean) * invStd; }
+
+private:
+  const TimeSeries& ts;
+  data_t mean;
+  data_t invStd;
+};
+
 /**
  *  Check if a class has the method InverseNorm using compile-time introspection.
  *  https://jguegant.github.io/blogs/tech/sfinae-introduction.html
@@ -78,8 +185,9 @@ template <class T> struct hasInverseNorm
  *  @param a one of the two arrays of data
  *  @param b the other of the two arrays of data
  *  @param dropout drops the calculation of distance if within this
+ *  V decides how values are read from a and b (as they are or z-normalized).
  */
-template<typename DM, typename T>
+template<typename DM, typename T, typename V = RawValue>
 data_t warpedDistance(
   const TimeSeries& a, 
   const TimeSeries& b, 
@@ -87,6 +195,7 @@ data_t warpedDistance(
   matching_t& matching)
 {
   bool computeMatching = matching.empty(); 
+  const V va(a), vb(b);
   auto m = a.getLength();
   auto n = b.getLength();
   auto r = calculateWarpingBandSize(max(m, n));
@@ -100,12 +209,18 @@ data_t warpedDistance(
   if (m == 1 && n == 1)
   {
     T result = metric->init();
-    result = metric->reduce(result, result, a[0], b[0]);
+    result = metric->reduce(result, result, va[0], vb[0]);
     auto normalizedResult = metric->normDTW(result, a, b);
     metric->clean(result);
     return normalizedResult;
   }
 
+  // Without a matching to return, skip lengths too far apart for the last
+  // cell to be within the warping band
+  if (!computeMatching && std::abs(m - n) > r) {
+    return INF;
+  }
+
   // create cost matrix
   vector< vector< T >> cost(m, vector< T >(n));
   vector< vector< data_t >> ncost(m, vector<data_t>(n));
@@ -115,14 +230,14 @@ data_t warpedDistance(
   ncost[m - 1][n - 1] = INF;
 
   cost[0][0] = metric->init();
-  cost[0][0] = metric->reduce(cost[0][0], cost[0][0], a[0], b[0]);
+  cost[0][0] = metric->reduce(cost[0][0], cost[0][0], va[0], vb[0]);
   ncost[0][0] = metric->normDTW(cost[0][0], a, b);
 
   // calculate first column
   for(int i = 1; i < min(2*r + 1, m); i++)
   {
     cost[i][0] = metric->init();
-    cost[i][0] = metric->reduce(cost[i][0], cost[i-1][0], a[i], b[0]);
+    cost[i][0] = metric->reduce(cost[i][0], cost[i-1][0], va[i], vb[0]);
     ncost[i][0] = metric->normDTW(cost[i][0], a, b);
   }
 
@@ -130,7 +245,7 @@ data_t warpedDistance(
   for(int j = 1; j < min(2*r + 1, n); j++)
   {
     cost[0][j] = metric->init();
-    cost[0][j] = metric->reduce(cost[0][j], cost[0][j-1], a[0], b[j]);
+    cost[0][j] = metric->reduce(cost[0][j], cost[0][j-1], va[0], vb[j]);
     ncost[0][j] = metric->normDTW(cost[0][j], a, b);
   }
 
@@ -159,7 +274,7 @@ data_t warpedDistance(
         minPrev = cost[i][j-1];
       }
       cost[i][j] = metric->init();
-      cost[i][j] = metric->reduce(cost[i][j], minPrev, a[i], b[j]);
+      cost[i][j] = metric->reduce(cost[i][j], minPrev, va[i], vb[j]);
       ncost[i][j] = metric->normDTW(cost[i][j], a, b);
       bestSoFar = min(bestSoFar, ncost[i][j]);
     }
@@ -224,7 +339,7 @@ data_t warpedDistance(
  * Calculates pairwise distance between two time series. This function is enabled if the given
  * distance metric class DM does not have the 'hasInverseNorm' function.
  */
-template<typename DM, typename T>
+template<typename DM, typename T, typename V = RawValue>
 typename std::enable_if<!hasInverseNorm<DM>::value, data_t>::type
 pairwiseDistance(
   const TimeSeries& x_1, 
@@ -243,19 +358,23 @@ pairwiseDistance(
     metric = new DM();
   }
 
+  const V v_1(x_1), v_2(x_2);
   T total = metric->init();
 
   bool dropped = false;
 
-  for(int i = 0; i < x_1.getLength(); i++)
+  int i = 0;
+  for(; i < x_1.getLength(); i++)
   {
-    total = metric->reduce(total, total, x_1[i], x_2[i]);
+    total = metric->reduce(total, total, v_1[i], v_2[i]);
     if (metric->norm(total, x_1, x_2) > dropout)
     {
       dropped = true;
       break;
     }
   }
+  gPairwiseComparisons++;
+  gPairwisePoints += dropped ? i + 1 : i;
 
   auto result = dropped ? INF : metric->norm(total, x_1, x_2);
   metric->clean(total);
@@ -267,7 +386,7 @@ pairwiseDistance(
  * Calculates pairwise distance between two time series. This function is enabled if the given
  * distance metric class DM has the 'hasInverseNorm' function.
  */
-template<typename DM, typename T>
+template<typename DM, typename T, typename V = RawValue>
 typename std::enable_if<hasInverseNorm<DM>::value, data_t>::type
 pairwiseDistance(
   const TimeSeries& x_1, 
@@ -286,20 +405,24 @@ pairwiseDistance(
     metric = new DM();
   }
 
+  const V v_1(x_1), v_2(x_2);
   T total = metric->init();
 
   bool dropped = false;
   dropout = metric->inverseNorm(dropout, x_1, x_2);
 
-  for(int i = 0; i < x_1.getLength(); i++)
+  int i = 0;
+  for(; i < x_1.getLength(); i++)
   {
-    total = metric->reduce(total, total, x_1[i], x_2[i]);
+    total = metric->reduce(total, total, v_1[i], v_2[i]);
     if (total > dropout)
     {
       dropped = true;
       break;
     }
   }
+  gPairwiseComparisons++;
+  gPairwisePoints += dropped ? i + 1 : i;
 
   auto result = dropped ? INF : metric->norm(total, x_1, x_2);
   metric->clean(total);
@@ -37,6 +37,11 @@ public:
     return total / (2 * std::max(t_1.getLength(), t_2.getLength()));
   }
 
+  data_t extend(data_t distance, int length, data_t x_1, data_t x_2) const
+  {
+    return (distance * length + dist(x_1, x_2)) / (length + 1);
+  }
+
   void clean(data_t x) {}
 };
 
@@ -0,0 +1,113 @@
+#include "group/CentroidMatrix.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "lib/trillionDTW.h"
+
+// Rows start on boundaries of this many bytes, the size of a cache line
+#define CENTROID_ALIGNMENT 64
+#define VALUES_PER_ALIGNMENT (CENTROID_ALIGNMENT / sizeof(data_t))
+
+namespace genex {
+
+CentroidMatrix::CentroidMatrix(int length)
+  : length(length)
+{
+  this->stride = (length + VALUES_PER_ALIGNMENT - 1) / VALUES_PER_ALIGNMENT * VALUES_PER_ALIGNMENT;
+}
+
+data_t* CentroidMatrix::_allocate(std::vector<data_t>& storage, size_t size)
+{
+  // Over-allocate by one alignment so that an aligned start always fits
+  storage.assign(size + VALUES_PER_ALIGNMENT, 0);
+  auto address = reinterpret_cast<std::uintptr_t>(storage.data());
+  auto skip = (CENTROID_ALIGNMENT - address % CENTROID_ALIGNMENT) % CENTROID_ALIGNMENT;
+  return storage.data() + skip / sizeof(data_t);
+}
+
+int CentroidMatrix::add(const TimeSeries& centroid)
+{
+  if (this->rows == this->capacity)
+  {
+    int newCapacity = std::max(16, this->capacity * 2);
+    std::vector<data_t> newStorage;
+    data_t* newData = _allocate(newStorage, (size_t)newCapacity * this->stride);
+    if (this->rows > 0) {
+      memcpy(newData, this->data, (size_t)this->rows * this->stride * sizeof(data_t));
+    }
+    this->storage.swap(newStorage);
+    this->data = newData;
+    this->capacity = newCapacity;
+  }
+
+  data_t* row = this->getRow(this->rows);
+  data_t norm = 0;
+  for (int i = 0; i < this->length; i++) {
+    row[i] = centroid[i];
+    norm += row[i] * row[i];
+  }
+  this->norms.push_back(norm);
+  return this->rows++;
+}
+
+void CentroidMatrix::swap(CentroidMatrix& other)
+{
+  std::swap(this->length, other.length);
+  std::swap(this->stride, other.stride);
+  std::swap(this->rows, other.rows);
+  std::swap(this->capacity, other.capacity);
+  this->storage.swap(other.storage);
+  std::swap(this->data, other.data);
+  this->norms.swap(other.norms);
+  this->envelopeStorage.swap(other.envelopeStorage);
+  std::swap(this->envelopes, other.envelopes);
+  std::swap(this->envelopeBand, other.envelopeBand);
+  std::swap(this->envelopeRows, other.envelopeRows);
+}
+
+void CentroidMatrix::clear()
+{
+  std::vector<data_t>().swap(this->storage);
+  std::vector<data_t>().swap(this->norms);
+  std::vector<data_t>().swap(this->envelopeStorage);
+  this->data = nullptr;
+  this->envelopes = nullptr;
+  this->rows = 0;
+  this->capacity = 0;
+  this->envelopeBand = -1;
+  this->envelopeRows = 0;
+}
+
+bool CentroidMatrix::prepareEnvelopes(int warpingBand)
+{
+  if (warpingBand != this->envelopeBand) {
+    this->envelopeRows = 0;
+  }
+  if (this->envelopeRows == this->rows) {
+    return false;
+  }
+  if (this->envelopes == nullptr || this->envelopeStorage.size() < (size_t)this->capacity * 2 * this->stride)
+  {
+    std::vector<data_t> newStorage;
+    data_t* newEnvelopes = _allocate(newStorage, (size_t)this->capacity * 2 * this->stride);
+    if (this->envelopeRows > 0) {
+      memcpy(newEnvelopes, this->envelopes,
+             (size_t)this->envelopeRows * 2 * this->stride * sizeof(data_t));
+    }
+    this->envelopeStorage.swap(newStorage);
+    this->envelopes = newEnvelopes;
+  }
+
+  int band = std::min(warpingBand, this->length - 1);
+  for (int r = this->envelopeRows; r < this->rows; r++) {
+    data_t* lower = this->envelopes + (size_t)r * 2 * this->stride;
+    lower_upper_lemire(this->getRow(r), this->length, band, lower, lower + this->stride);
+  }
+  this->envelopeBand = warpingBand;
+  this->envelopeRows = this->rows;
+  return true;
+}
+
+} // namespace genex
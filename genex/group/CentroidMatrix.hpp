@@ -0,0 +1,122 @@
+#ifndef CENTROID_MATRIX_HPP
+#define CENTROID_MATRIX_HPP
+
+#include <vector>
+
+#include "TimeSeries.hpp"
+
+namespace genex {
+
+/**
+ *  @brief the centroids of one length, copied into a contiguous matrix
+ *
+ *  Each centroid takes one row of getStride() values starting on a 64-byte
+ *  boundary; values past the length of a row are zero. The squared norm of each
+ *  row is kept alongside, and the Keogh envelopes of all rows for one warping
+ *  band are stored in a second matrix of the same layout, lower then upper row
+ *  of each centroid. Scans over all centroids therefore stream through memory.
+ */
+class CentroidMatrix
+{
+public:
+  /**
+   *  @param length number of values of each centroid
+   */
+  explicit CentroidMatrix(int length);
+
+  CentroidMatrix(const CentroidMatrix&) = delete;
+  CentroidMatrix& operator=(const CentroidMatrix&) = delete;
+
+  /**
+   *  @brief appends a centroid
+   *
+   *  Rows may move when the matrix grows; compare getData() before and after.
+   *
+   *  @param centroid values of the centroid
+   *  @return the row of the centroid
+   */
+  int add(const TimeSeries& centroid);
+
+  /**
+   *  @brief exchanges the rows of two matrices of the same length
+   */
+  void swap(CentroidMatrix& other);
+
+  /**
+   *  @brief removes all rows
+   */
+  void clear();
+
+  /**
+   *  @return number of rows
+   */
+  int size() const { return this->rows; }
+
+  /**
+   *  @return number of values between the starts of two consecutive rows
+   */
+  int getStride() const { return this->stride; }
+
+  /**
+   *  @return the first value of the first row
+   */
+  data_t* getData() const { return this->data; }
+
+  /**
+   *  @return the first value of a row
+   */
+  data_t* getRow(int row) const { return this->data + (size_t)row * this->stride; }
+
+  /**
+   *  @return the sum of the squared values of a row
+   */
+  data_t getNorm(int row) const { return this->norms[row]; }
+
+  /**
+   *  @brief computes the Keogh envelopes of all rows for a warping band
+   *
+   *  Envelopes are only recomputed for a new band or for rows added since the
+   *  last call.
+   *
+   *  @param warpingBand the warping band
+   *  @return true if any envelope was computed; envelopes may then have moved
+   */
+  bool prepareEnvelopes(int warpingBand);
+
+  /**
+   *  @return the lower envelope of a row, valid after prepareEnvelopes
+   */
+  const data_t* getLower(int row) const
+  {
+    return this->envelopes + (size_t)row * 2 * this->stride;
+  }
+
+  /**
+   *  @return the upper envelope of a row, valid after prepareEnvelopes
+   */
+  const data_t* getUpper(int row) const
+  {
+    return this->getLower(row) + this->stride;
+  }
+
+private:
+  int length;
+  int stride;
+  int rows = 0;
+  int capacity = 0;
+
+  std::vector<data_t> storage;
+  data_t* data = nullptr;
+  std::vector<data_t> norms;
+
+  std::vector<data_t> envelopeStorage;
+  data_t* envelopes = nullptr;
+  int envelopeBand = -1;
+  int envelopeRows = 0;
+
+  static data_t* _allocate(std::vector<data_t>& storage, size_t size);
+};
+
+} // namespace genex
+
+#endif // CENTROID_MATRIX_HPP
@@ -0,0 +1,75 @@
+#include "group/Envelope.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "distance/Distance.hpp"
+#include "lib/trillionDTW.h"
+
+namespace genex {
+
+void Envelope::add(const TimeSeries& values)
+{
+  int length = values.getLength();
+  if (this->lower.empty()) {
+    this->lower.resize(length);
+    for (int i = 0; i < length; i++) {
+      this->lower[i] = values[i];
+    }
+    this->upper = this->lower;
+  }
+  else {
+    for (int i = 0; i < length; i++) {
+      this->lower[i] = std::min(this->lower[i], values[i]);
+      this->upper[i] = std::max(this->upper[i], values[i]);
+    }
+  }
+  this->band = -1;
+}
+
+void Envelope::clear()
+{
+  this->lower.clear();
+  this->upper.clear();
+  this->band = -1;
+}
+
+data_t Envelope::lowerBound(const TimeSeries& query) const
+{
+  if (this->lower.empty()) {
+    return 0;
+  }
+
+  int length = this->lower.size();
+  int maxLength = std::max(query.getLength(), length);
+  int band = std::min(calculateWarpingBandSize(maxLength), length - 1);
+  if (band != this->band)
+  {
+    // Lowest of the lower and highest of the upper values within the band
+    std::vector<data_t> unused(length);
+    this->bandLower.resize(length);
+    this->bandUpper.resize(length);
+    lower_upper_lemire(const_cast<data_t*>(this->lower.data()), length,
+                       band, this->bandLower.data(), unused.data());
+    lower_upper_lemire(const_cast<data_t*>(this->upper.data()), length,
+                       band, unused.data(), this->bandUpper.data());
+    this->band = band;
+  }
+
+  int len = std::min(query.getLength(), length);
+  data_t lb = 0;
+  for (int i = 0; i < len; i++)
+  {
+    data_t excess = 0;
+    if (query[i] > this->bandUpper[i]) {
+      excess = query[i] - this->bandUpper[i];
+    }
+    else if (query[i] < this->bandLower[i]) {
+      excess = this->bandLower[i] - query[i];
+    }
+    lb += excess * excess;
+  }
+  return sqrt(lb) / (2 * maxLength);
+}
+
+} // namespace genex
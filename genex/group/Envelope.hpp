@@ -0,0 +1,74 @@
+#ifndef ENVELOPE_HPP
+#define ENVELOPE_HPP
+
+#include <vector>
+
+#include "TimeSeries.hpp"
+
+namespace genex {
+
+/**
+ *  @brief the smallest and the largest value at each position of a set of
+ *         time series of one length
+ *
+ *  Any time series of the set lies within the envelope, so the Keogh lower
+ *  bound of a query against the envelope widened by the warping band bounds
+ *  cascadeDistance from the query to every one of them.
+ */
+class Envelope
+{
+public:
+  /**
+   *  @brief widens the envelope to a time series, or starts it if empty
+   *
+   *  @param values the time series, of the length of the envelope
+   */
+  void add(const TimeSeries& values);
+
+  /**
+   *  @brief removes all time series
+   */
+  void clear();
+
+  /**
+   *  @return true if no time series was added
+   */
+  bool empty() const { return this->lower.empty(); }
+
+  /**
+   *  @brief gets a lower bound of cascadeDistance from a query to every time
+   *         series of the envelope
+   *
+   *  The envelope widened by the warping band is cached for the band of the
+   *  last query.
+   *
+   *  @param query the query
+   *  @return the lower bound; 0 if the envelope is empty
+   */
+  data_t lowerBound(const TimeSeries& query) const;
+
+  /**
+   *  @return the smallest value at each position, to be saved or loaded
+   */
+  std::vector<data_t>& getLower() { return this->lower; }
+  const std::vector<data_t>& getLower() const { return this->lower; }
+
+  /**
+   *  @return the largest value at each position, to be saved or loaded
+   */
+  std::vector<data_t>& getUpper() { return this->upper; }
+  const std::vector<data_t>& getUpper() const { return this->upper; }
+
+private:
+  std::vector<data_t> lower;
+  std::vector<data_t> upper;
+
+  // envelope widened by the warping band of the last query
+  mutable std::vector<data_t> bandLower;
+  mutable std::vector<data_t> bandUpper;
+  mutable int band = -1;
+};
+
+} // namespace genex
+
+#endif // ENVELOPE_HPP
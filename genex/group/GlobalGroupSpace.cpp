@@ -4,8 +4,10 @@
 #include "TimeSeriesSet.hpp"
 #include "group/Group.hpp"
 #include "distance/Distance.hpp"
-#include "lib/ThreadPool.hpp"
+#include "lib/WorkStealingPool.hpp"
+#include "Exception.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <functional>
@@ -14,6 +16,8 @@
 #include <fstream>
 #include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <boost/algorithm/string.hpp>
 
 using std::vector;
@@ -36,17 +40,25 @@ GlobalGroupSpace::~GlobalGroupSpace(void)
 
 void GlobalGroupSpace::reset(void)
 {
+  // Builds still queued are skipped and the running ones are waited for
+  this->lazyCancelled = true;
+  this->lazyPool.reset();
+  this->lazyCancelled = false;
+  this->lazyBuilds.clear();
+  this->lazy = false;
   for (auto i = 0; i < this->localLengthGroupSpace.size(); i++) {
     delete this->localLengthGroupSpace[i];
     this->localLengthGroupSpace[i] = nullptr;
   }
   this->localLengthGroupSpace.clear();
+  this->lengthSpace.clear();
 }
 
 void GlobalGroupSpace::_loadDistance(const string& distance_name)
 {
   this->distanceName = distance_name;
   this->pairwiseDistance = getDistanceFromName(distance_name);
+  this->metricDistance = isMetricDistance(distance_name);
   if (distance_name == "euclidean") {
     this->warpedDistance = cascadeDistance;
   }
@@ -55,12 +67,66 @@ void GlobalGroupSpace::_loadDistance(const string& distance_name)
   }  
 }
 
-int GlobalGroupSpace::_group(int i)
+int GlobalGroupSpace::_group(int i, const group_options_t& options, WorkStealingPool* pool)
 {
-  this->localLengthGroupSpace[i] = new LocalLengthGroupSpace(this->dataset, i);
-  int noOfGenerated = 
-    this->localLengthGroupSpace[i]->generateGroups(this->pairwiseDistance, this->threshold);
-  return noOfGenerated;
+  this->localLengthGroupSpace[i] = this->_buildSpace(i, options, pool);
+  return this->localLengthGroupSpace[i]->getNumberOfGroups();
+}
+
+LocalLengthGroupSpace* GlobalGroupSpace::_buildSpace(
+  int i, const group_options_t& options, WorkStealingPool* pool)
+{
+  std::unique_ptr<LocalLengthGroupSpace> llgs(new LocalLengthGroupSpace(
+    this->dataset, i, this->_bucketLengthCount(i, options.bucketRatio)));
+  if (options.centroidIndex && this->metricDistance) {
+    llgs->enableCentroidIndex(this->pairwiseDistance);
+  }
+  if (options.triangleBounds && this->metricDistance) {
+    llgs->enableTriangleBounds();
+  }
+  if (options.batched) {
+    llgs->enableBatching();
+  }
+  if (options.stride > 1) {
+    llgs->setStride(options.stride);
+  }
+  if (options.sampleRatio > 0) {
+    // Each length draws a different sample
+    llgs->enableSampling(options.sampleRatio, options.sampleSeed + i);
+  }
+  if (options.lshTables > 0) {
+    llgs->enableHashing(
+      options.lshTables, options.lshWidth, options.lshVerify);
+  }
+  if (options.refineIterations > 0) {
+    llgs->enableRefinement(options.refineIterations);
+  }
+  if (options.superGroupRatio > 1) {
+    llgs->enableSuperGroups(options.superGroupRatio);
+  }
+  if (!options.levelThresholds.empty()) {
+    llgs->enableLevels(options.levelThresholds);
+  }
+  if (options.ordered) {
+    llgs->enableOrdering(isMeanBoundedDistance(this->distanceName));
+  }
+  if (options.incremental) {
+    llgs->enableIncremental(
+      this->localLengthGroupSpace[i - 1], getDistanceExtensionFromName(this->distanceName));
+  }
+  llgs->generateGroups(this->pairwiseDistance, this->threshold, pool, options.deterministic);
+  return llgs.release();
+}
+
+void GlobalGroupSpace::_finishIncremental(int i, const group_options_t& options)
+{
+  // Length i - 1 is no longer needed to seed anything
+  if (options.incremental && this->localLengthGroupSpace[i - 1] != nullptr) {
+    this->localLengthGroupSpace[i - 1]->finishIncremental();
+  }
+  if (options.incremental && i == this->localLengthGroupSpace.size() - 1) {
+    this->localLengthGroupSpace[i]->finishIncremental();
+  }
 }
 
 int GlobalGroupSpace::_getMinLength() const
@@ -68,60 +134,298 @@ int GlobalGroupSpace::_getMinLength() const
   return this->wholeSeriesOnly ? this->localLengthGroupSpace.size() - 1 : 2;
 }
 
-int GlobalGroupSpace::group(
-  const string& distance_name, data_t threshold, bool wholeSeriesOnly)
+int GlobalGroupSpace::_bucketLengthCount(int length, double bucketRatio) const
 {
-  reset();
-  this->_loadDistance(distance_name);
-  this->localLengthGroupSpace.resize(dataset.getMaxLength() + 1, nullptr);
-  this->threshold = threshold;
-  this->totalNumberOfGroups = 0;
-  this->wholeSeriesOnly = wholeSeriesOnly;
-  auto maxLength = this->localLengthGroupSpace.size();
-  auto minLength = _getMinLength();
-  for (auto i = minLength; i < maxLength; i++)
+  int maxLength = this->localLengthGroupSpace.size() - 1;
+  int last = std::max(length, (int)std::floor(length * bucketRatio + EPS));
+  return std::min(last, maxLength) - length + 1;
+}
+
+void GlobalGroupSpace::_indexLengthSpaces()
+{
+  this->lengthSpace.assign(this->localLengthGroupSpace.size(), -1);
+  for (auto i = 0; i < this->localLengthGroupSpace.size(); i++) {
+    auto llgs = this->localLengthGroupSpace[i];
+    for (auto j = 0; llgs != nullptr && j < llgs->getLengthCount(); j++) {
+      this->lengthSpace[i + j] = i;
+    }
+  }
+}
+
+std::shared_future<void> GlobalGroupSpace::_startBuild(int i)
+{
+  std::lock_guard<std::mutex> lock(this->lazyMutex);
+  if (!this->lazyBuilds[i].valid()) {
+    this->lazyBuilds[i] = this->lazyPool->submit([this, i] {
+      if (this->lazyCancelled) {
+        return;
+      }
+      auto llgs = this->_buildSpace(i, this->lazyOptions, this->lazyPool.get());
+      std::lock_guard<std::mutex> lock(this->lazyMutex);
+      this->localLengthGroupSpace[i] = llgs;
+      this->totalNumberOfGroups += llgs->getNumberOfGroups();
+    }).share();
+  }
+  return this->lazyBuilds[i];
+}
+
+void GlobalGroupSpace::_prefetch(int queryLength)
+{
+  // The spaces of the query come first, then those of its neighbours
+  for (int i : this->_traverseOrder(queryLength)) {
+    this->_startBuild(i);
+  }
+  int maxLength = this->lengthSpace.size() - 1;
+  for (int d = 1; d <= this->lazyOptions.lazyPrefetch; d++) {
+    for (int length : {queryLength - d, queryLength + d}) {
+      if (length < 2 || length > maxLength) {
+        continue;
+      }
+      for (int i : this->_traverseOrder(length)) {
+        this->_startBuild(i);
+      }
+    }
+  }
+}
+
+LocalLengthGroupSpace* GlobalGroupSpace::_space(int i, std::unique_lock<std::mutex>& search)
+{
+  if (!this->lazy) {
+    return this->localLengthGroupSpace[i];
+  }
+  std::shared_future<void> build = this->_startBuild(i);
+  if (build.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+    // Other queries search while this one waits
+    search.unlock();
+    build.wait();
+    search.lock();
+  }
+  // Rethrows if the build failed
+  build.get();
+  return this->localLengthGroupSpace[i];
+}
+
+void GlobalGroupSpace::_waitForBuilds()
+{
+  vector< std::shared_future<void> > builds;
   {
-    this->totalNumberOfGroups += this->_group(i);
+    std::lock_guard<std::mutex> lock(this->lazyMutex);
+    builds = this->lazyBuilds;
   }
+  for (auto& build : builds) {
+    if (build.valid()) {
+      build.wait();
+    }
+  }
+}
 
-  return  this->totalNumberOfGroups;
+bool GlobalGroupSpace::_isFullyBuilt() const
+{
+  std::lock_guard<std::mutex> lock(this->lazyMutex);
+  for (auto i = 0; this->lazy && i < this->lengthSpace.size(); i++) {
+    if (this->lengthSpace[i] == i && this->localLengthGroupSpace[i] == nullptr) {
+      return false;
+    }
+  }
+  return true;
+}
+
+vector<int> GlobalGroupSpace::_traverseOrder(int queryLength) const
+{
+  // Each space is visited once, at the first of its lengths in the order
+  vector<int> order;
+  for (int length : generateTraverseOrder(queryLength, this->lengthSpace.size() - 1)) {
+    int space = length < this->lengthSpace.size() ? this->lengthSpace[length] : -1;
+    if (space >= 0 && std::find(order.begin(), order.end(), space) == order.end()) {
+      order.push_back(space);
+    }
+  }
+  return order;
+}
+
+int GlobalGroupSpace::group(
+  const string& distance_name, data_t threshold, bool wholeSeriesOnly)
+{
+  group_options_t options;
+  options.wholeSeriesOnly = wholeSeriesOnly;
+  return this->group(distance_name, threshold, options);
 }
 
 int GlobalGroupSpace::groupMultiThreaded(
   const std::string& distance_name, data_t threshold, int num_thread, bool wholeSeriesOnly)
 {
+  group_options_t options;
+  options.numThreads = num_thread;
+  options.wholeSeriesOnly = wholeSeriesOnly;
+  return this->group(distance_name, threshold, options);
+}
+
+int GlobalGroupSpace::group(
+  const string& distance_name, data_t threshold, const group_options_t& options)
+{
+  if (options.numThreads <= 0) {
+    throw GenexException("Number of threads must be positive");
+  }
+  if (options.stride < 1) {
+    throw GenexException("Stride must be positive");
+  }
+  if (options.sampleRatio < 0 || options.sampleRatio > 1) {
+    throw GenexException("Sample ratio must be in [0, 1]");
+  }
+  if (options.lshTables < 0 || (options.lshTables > 0 && options.lshWidth <= 0)) {
+    throw GenexException("Number of hash tables and bucket width must be positive");
+  }
+  if (options.bucketRatio < 1) {
+    throw GenexException("Bucket ratio must be at least 1");
+  }
+  if (options.incremental && options.bucketRatio > 1) {
+    throw GenexException("Incremental grouping cannot be combined with length buckets");
+  }
+  if (options.refineIterations < 0) {
+    throw GenexException("Number of refinement passes must not be negative");
+  }
+  if (options.incremental && options.refineIterations > 0) {
+    throw GenexException("Incremental grouping cannot be combined with refinement");
+  }
+  if (options.incremental && options.lazy) {
+    throw GenexException("Incremental grouping cannot be combined with lazy grouping");
+  }
+  if (options.lazyPrefetch < 0) {
+    throw GenexException("Number of prefetched lengths must not be negative");
+  }
+  if (options.superGroupRatio < 1) {
+    throw GenexException("Super-group ratio must be at least 1");
+  }
+  for (auto i = 0; i < options.levelThresholds.size(); i++) {
+    data_t below = i == 0 ? threshold : options.levelThresholds[i - 1];
+    if (options.levelThresholds[i] <= below) {
+      throw GenexException("Level thresholds must increase from the grouping threshold");
+    }
+  }
   reset();
   this->_loadDistance(distance_name);
   this->localLengthGroupSpace.resize(dataset.getMaxLength() + 1, nullptr);
   this->threshold = threshold;
-  this->wholeSeriesOnly = wholeSeriesOnly;
-  ThreadPool pool(num_thread);
-  vector< std::future<int> > groupCounts;
-
+  this->levelThresholds = options.levelThresholds;
+  this->queryLevel = 0;
+  this->totalNumberOfGroups = 0;
+  this->wholeSeriesOnly = options.wholeSeriesOnly;
   auto maxLength = this->localLengthGroupSpace.size();
   auto minLength = _getMinLength();
-  for (auto i = minLength; i < maxLength; i++)
+
+  if (options.lazy) {
+    // Spaces are planned here and built by the queries visiting them
+    this->lazy = true;
+    this->lazyOptions = options;
+    this->lazyBuilds.assign(maxLength, std::shared_future<void>());
+    this->lengthSpace.assign(maxLength, -1);
+    for (auto i = minLength; i < maxLength; i += this->_bucketLengthCount(i, options.bucketRatio))
+    {
+      for (auto j = 0; j < this->_bucketLengthCount(i, options.bucketRatio); j++) {
+        this->lengthSpace[i + j] = i;
+      }
+    }
+    this->lazyPool.reset(new WorkStealingPool(options.numThreads));
+    return this->totalNumberOfGroups;
+  }
+
+  if (options.numThreads == 1) {
+    for (auto i = minLength; i < maxLength; i += this->_bucketLengthCount(i, options.bucketRatio))
+    {
+      this->totalNumberOfGroups += this->_group(i, options);
+      this->_finishIncremental(i, options);
+    }
+    this->_indexLengthSpaces();
+    return this->totalNumberOfGroups;
+  }
+
+  WorkStealingPool pool(options.numThreads);
+  if (options.incremental) {
+    // Each length is seeded by the previous one, so only the subsequences
+    // within a length are grouped in parallel
+    for (auto i = minLength; i < maxLength; i++)
+    {
+      this->totalNumberOfGroups += this->_group(i, options, &pool);
+      this->_finishIncremental(i, options);
+    }
+    this->_indexLengthSpaces();
+    return this->totalNumberOfGroups;
+  }
+
+  vector< std::future<int> > groupCounts;
+  for (auto i = minLength; i < maxLength; i += this->_bucketLengthCount(i, options.bucketRatio))
   {
     groupCounts.emplace_back(
-      pool.enqueue([this, i] {
-        return this->_group(i);
+      pool.submit([this, i, &options, &pool] {
+        return this->_group(i, options, &pool);
       })
     );
   }
 
-  this->totalNumberOfGroups = 0;
   for (auto i = 0; i < groupCounts.size(); i++)
   {
-    this->totalNumberOfGroups += groupCounts[i].get();
+    this->totalNumberOfGroups += pool.wait(groupCounts[i]);
   }
+  this->_indexLengthSpaces();
   return this->totalNumberOfGroups;
 }
 
+void GlobalGroupSpace::refreshCentroids()
+{
+  this->_waitForBuilds();
+  for (auto llgs : this->localLengthGroupSpace) {
+    if (llgs != nullptr) {
+      llgs->refreshCentroids();
+    }
+  }
+}
+
+void GlobalGroupSpace::buildAllSpaces()
+{
+  if (!this->lazy) {
+    return;
+  }
+  vector< std::shared_future<void> > builds;
+  for (auto i = 0; i < this->lengthSpace.size(); i++) {
+    if (this->lengthSpace[i] == i) {
+      builds.push_back(this->_startBuild(i));
+    }
+  }
+  for (auto& build : builds) {
+    build.get();
+  }
+}
+
 int GlobalGroupSpace::getTotalNumberOfGroups() const
 {
+  std::lock_guard<std::mutex> lock(this->lazyMutex);
   return this->totalNumberOfGroups;
 }
 
+group_stats_t GlobalGroupSpace::getGroupStats() const
+{
+  std::lock_guard<std::mutex> lock(this->lazyMutex);
+  group_stats_t stats;
+  for (auto llgs : this->localLengthGroupSpace) {
+    if (llgs != nullptr) {
+      const group_stats_t& s = llgs->getGroupStats();
+      stats.subsequences += s.subsequences;
+      stats.comparisons += s.comparisons;
+      stats.points += s.points;
+      stats.sampledGroups += s.sampledGroups;
+      stats.verifiedAssignments += s.verifiedAssignments;
+      stats.differingAssignments += s.differingAssignments;
+      stats.unrefinedGroups += s.unrefinedGroups;
+      stats.unrefinedRadius += s.unrefinedRadius;
+      stats.refinedRadius += s.refinedRadius;
+      stats.groupingSeconds += s.groupingSeconds;
+      stats.refinementSeconds += s.refinementSeconds;
+      stats.superGroups += s.superGroups;
+    }
+  }
+  return stats;
+}
+
 string GlobalGroupSpace::getDistanceName() const
 {
   return this->distanceName;
@@ -132,32 +436,71 @@ data_t GlobalGroupSpace::getThreshold() const
   return this->threshold;
 }
 
+int GlobalGroupSpace::getNumberOfLevels() const
+{
+  return this->levelThresholds.size() + 1;
+}
+
+data_t GlobalGroupSpace::getLevelThreshold(int level) const
+{
+  if (level < 0 || level >= this->getNumberOfLevels()) {
+    throw GenexException("Level is out of range");
+  }
+  return level == 0 ? this->threshold : this->levelThresholds[level - 1];
+}
+
+void GlobalGroupSpace::setQueryLevel(int level)
+{
+  if (level < 0 || level >= this->getNumberOfLevels()) {
+    throw GenexException("Level is out of range");
+  }
+  this->queryLevel = level;
+}
+
 candidate_time_series_t 
 GlobalGroupSpace::getBestMatch(const TimeSeries& query)
 {
   if (query.getLength() <= 1) {
     throw GenexException("Length of query must be larger than 1");
   }
+  std::unique_lock<std::mutex> search(this->searchMutex, std::defer_lock);
+  if (this->lazy) {
+    search.lock();
+    this->_prefetch(query.getLength());
+  }
   data_t bestSoFarDist = INF;
-  const Group* bestSoFarGroup = nullptr;
+  // Each group closer than the ones before it, the best one last
+  vector<const Group*> bestSoFarGroups;
 
-  vector<int> order (
-    generateTraverseOrder(query.getLength(), this->localLengthGroupSpace.size() - 1));
+  vector<int> order(this->_traverseOrder(query.getLength()));
   for (auto io = 0; io < order.size(); io++) {
-    int i = order[io];
-    if (this->localLengthGroupSpace[i] != nullptr) {
+    auto llgs = this->_space(order[io], search);
+    if (llgs != nullptr) {
       // this looks through each group of a certain length finding the best of those groups
       candidate_group_t candidate = 
-        this->localLengthGroupSpace[i]->getBestGroup(
-          query, this->warpedDistance, bestSoFarDist);
+        llgs->getBestGroup(
+          query, this->warpedDistance, bestSoFarDist, this->queryLevel);
       if (candidate.second < bestSoFarDist)
       {
-        bestSoFarGroup = candidate.first;
+        bestSoFarGroups.push_back(candidate.first);
         bestSoFarDist = candidate.second;
       }
     }
   }
-  return bestSoFarGroup->getBestMatch(query, this->warpedDistance);
+  if (bestSoFarGroups.empty()) {
+    throw GenexException("No group is close enough to the query");
+  }
+
+  // Members of a length bucket may all be too long or short to warp onto the
+  // query, in which case the next best group is searched
+  candidate_time_series_t best;
+  for (auto it = bestSoFarGroups.rbegin(); it != bestSoFarGroups.rend(); it++) {
+    best = (*it)->getBestMatch(query, this->warpedDistance);
+    if (best.dist < INF) {
+      break;
+    }
+  }
+  return best;
 }
 
 std::vector<candidate_time_series_t> 
@@ -166,16 +509,20 @@ GlobalGroupSpace::getKBestMatches(const TimeSeries& query, int k)
   std::vector<candidate_time_series_t> best;
   std::vector<group_index_t> bestSoFar;
   int kPrime = k;
+  std::unique_lock<std::mutex> search(this->searchMutex, std::defer_lock);
+  if (this->lazy) {
+    search.lock();
+    this->_prefetch(query.getLength());
+  }
   
   // process each group of a certain length keeping top sum-k groups
-  vector<int> order(
-    generateTraverseOrder(query.getLength(), this->localLengthGroupSpace.size() - 1));
+  vector<int> order(this->_traverseOrder(query.getLength()));
   for (auto io = 0; io < order.size(); io++) 
   {
-    int i = order[io];
-    if (this->localLengthGroupSpace[i] != nullptr) {
-      kPrime = this->localLengthGroupSpace[i]->
-          interLevelKSim(query, this->warpedDistance, bestSoFar, kPrime);
+    auto llgs = this->_space(order[io], search);
+    if (llgs != nullptr) {
+      kPrime = llgs->
+          interLevelKSim(query, this->warpedDistance, bestSoFar, kPrime, this->queryLevel);
     }
   }
   
@@ -190,24 +537,57 @@ GlobalGroupSpace::getKBestMatches(const TimeSeries& query, int k)
     // add all of the worst's best to answer
     for (int i = 0; i < intraResults.size(); ++i) 
     {
+      intraResults[i].dist = this->warpedDistance(query, intraResults[i].data, INF, gNoMatching);
       best.push_back(intraResults[i]);
     }
   }
-  // add all timeseries in the *better* groups 
+
+  // The member envelope of a group bounds cascadeDistance from below, so
+  // groups are visited from the lowest bound and a group is skipped once k
+  // members closer than its bound are known
+  bool bounded = this->warpedDistance == cascadeDistance;
+  vector<std::pair<data_t, int>> visit;
   for (auto i = 0; i < bestSoFar.size(); i++)
   {
-    group_index_t g = bestSoFar[i];  
-    vector<TimeSeries> members = 
-        this->localLengthGroupSpace[g.length]->getGroup(g.index)->getMembers();
-    std::vector<candidate_time_series_t> withBounds;
-    for (auto i = 0; i < members.size(); i++) {
-      withBounds.push_back(candidate_time_series_t(members[i], g.dist + this->threshold));
-    }
-    best.insert(std::end(best), std::begin(withBounds), std::end(withBounds));  
+    const Group* group = this->localLengthGroupSpace[bestSoFar[i].length]->getGroup(bestSoFar[i].index);
+    // The bound does not cover the starts compared around strided members
+    bool groupBounded = bounded && group->getStride() <= 1;
+    visit.push_back(std::make_pair(groupBounded ? group->memberLowerBound(query) : 0, i));
   }
+  std::sort(visit.begin(), visit.end());
 
+  // max-heap of the k smallest distances found so far
+  vector<data_t> kBest;
+  auto offer = [&kBest, k](data_t dist) {
+    if ((int)kBest.size() < k) {
+      kBest.push_back(dist);
+      std::push_heap(kBest.begin(), kBest.end());
+    }
+    else if (dist < kBest.front()) {
+      std::pop_heap(kBest.begin(), kBest.end());
+      kBest.back() = dist;
+      std::push_heap(kBest.begin(), kBest.end());
+    }
+  };
   for (auto i = 0; i < best.size(); i++) {
-    best[i].dist = this->warpedDistance(query, best[i].data, INF, gNoMatching);
+    offer(best[i].dist);
+  }
+
+  // add all timeseries in the *better* groups, with the starts around
+  // strided members
+  for (auto i = 0; i < visit.size(); i++)
+  {
+    if ((int)kBest.size() >= k && kBest.front() < visit[i].first) {
+      break;
+    }
+    group_index_t g = bestSoFar[visit[i].second];
+    vector<TimeSeries> members = 
+        this->localLengthGroupSpace[g.length]->getGroup(g.index)->getCandidates();
+    for (auto j = 0; j < members.size(); j++) {
+      data_t dist = this->warpedDistance(query, members[j], INF, gNoMatching);
+      offer(dist);
+      best.push_back(candidate_time_series_t(members[j], dist));
+    }
   }
 
   return best;
@@ -215,6 +595,9 @@ GlobalGroupSpace::getKBestMatches(const TimeSeries& query, int k)
 
 void GlobalGroupSpace::saveGroupsOld(ofstream &fout, bool groupSizeOnly) const
 {
+  if (!this->_isFullyBuilt()) {
+    throw GenexException("Lazily grouped spaces must all be built before saving");
+  }
   // Range of lengths and distance name
   auto minLength = _getMinLength();
   auto maxLength = this->localLengthGroupSpace.size();
@@ -236,6 +619,8 @@ int GlobalGroupSpace::loadGroupsOld(ifstream &fin)
   string distance;
   fin >> lenFrom >> lenTo >> distance;
   boost::trim_right(distance);
+  this->levelThresholds.clear();
+  this->queryLevel = 0;
   this->_loadDistance(distance);
   this->localLengthGroupSpace.resize(dataset.getMaxLength() + 1, nullptr);
   this->totalNumberOfGroups = 0;  
@@ -244,6 +629,7 @@ int GlobalGroupSpace::loadGroupsOld(ifstream &fin)
     this->totalNumberOfGroups += gel->loadGroupsOld(fin);
     this->localLengthGroupSpace[i] = gel;
   }
+  this->_indexLengthSpaces();
   return this->totalNumberOfGroups;
 }
 
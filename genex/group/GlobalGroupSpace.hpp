@@ -1,17 +1,23 @@
 #ifndef GLOBAL_GROUP_SPACE_H
 #define GLOBAL_GROUP_SPACE_H
 
+#include <atomic>
 #include <fstream>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/split_member.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "group/LocalLengthGroupSpace.hpp"
 #include "TimeSeries.hpp"
 #include "TimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
 #include "group/Group.hpp"
+#include "Exception.hpp"
 
 namespace genex {
 
@@ -55,14 +61,98 @@ public:
     const std::string& distance_name, data_t threshold, bool wholeSeriesOnly=false);
   int groupMultiThreaded(
     const std::string& distance_name, data_t threshold, int num_thread, bool wholeSeriesOnly=false);
+
+  /**
+   *  @brief groups the dataset into groups of equal length
+   *
+   *  With more than one thread, lengths are grouped concurrently on a work-stealing
+   *  pool and each length further splits its subsequences into chunks on the same
+   *  pool, so a single long length cannot leave the other threads idle.
+   *
+   *  With a bucket ratio above 1, the lengths from lo to lo * bucketRatio are
+   *  grouped by one LocalLengthGroupSpace of length lo, starting from the
+   *  shortest length. Queries then visit the spaces of the lengths within
+   *  their warping band once each, and only compute exact warped distances to
+   *  the members of the best groups.
+   *
+   *  With lazy grouping, the spaces are only planned here. Each query builds
+   *  the spaces it visits that are not built yet, on a pool of numThreads
+   *  threads, and also starts building those of the neighbouring query
+   *  lengths in the background. Queries needing a space being built wait for
+   *  that build rather than starting another one.
+   *
+   *  @param distance_name the distance used to group by
+   *  @param threshold the threshold to be group with
+   *  @param options number of threads, lengths to group and determinism
+   *  @return the number of groups it creates; 0 with lazy grouping
+   *  @throw GenexException if an option is out of range, or if incremental
+   *         grouping is combined with length buckets or lazy grouping
+   */
+  int group(
+    const std::string& distance_name, data_t threshold, const group_options_t& options);
   
+  /**
+   *  @brief copies the centroids of all groups from the dataset again
+   *
+   *  Called after the values of the dataset change, e.g. when normalized.
+   */
+  void refreshCentroids();
+
+  /**
+   *  @brief builds the spaces lazy grouping has not built yet and waits for
+   *         them; does nothing if the dataset was not grouped lazily
+   *
+   *  Called before saving, which needs all spaces.
+   */
+  void buildAllSpaces();
+
+  /**
+   *  @return the number of groups of the spaces built so far
+   */
   int getTotalNumberOfGroups() const;
+
+  /**
+   *  @return the work done to group all lengths (see group_stats_t)
+   */
+  group_stats_t getGroupStats() const;
+
   std::string getDistanceName() const;
   data_t getThreshold() const;
 
+  /**
+   *  @return the number of levels queries can choose from, including the
+   *          groups (see group_options_t::levelThresholds)
+   */
+  int getNumberOfLevels() const;
+
+  /**
+   *  @return the threshold of a level; the grouping threshold for level 0
+   *  @throw GenexException if the level is out of range
+   */
+  data_t getLevelThreshold(int level) const;
+
+  /**
+   *  @brief chooses the level searched by getBestMatch and getKBestMatches
+   *
+   *  Level 0 compares the query with the centroids of all groups. Higher
+   *  levels compare it with the centroids of the coarser groups of that level,
+   *  then only with those of the closest ones at each level below (see
+   *  LocalLengthGroupSpace::enableLevels): fewer distances, but the best
+   *  matches may be missed. Grouping or loading goes back to level 0.
+   *
+   *  @param level the level
+   *  @throw GenexException if the level is out of range
+   */
+  void setQueryLevel(int level);
+
   /**
    *  @brief gets the most similar sequence in the dataset
    *
+   *  With lazy grouping, queries may run from several threads: they wait for
+   *  the spaces they need concurrently, but search them one at a time since
+   *  searches prepare envelopes shared by all queries. The same holds for
+   *  getKBestMatches.
+   *
    *  @param query gets most similar sequence to the query
    *  @return the best match in the dataset
    */
@@ -84,15 +174,44 @@ public:
 private:
   std::string distanceName;
   std::vector<LocalLengthGroupSpace*> localLengthGroupSpace;
+  // length of the space grouping each length; -1 if the length is not grouped
+  std::vector<int> lengthSpace;
   const TimeSeriesSet& dataset;
   dist_t pairwiseDistance;
   dist_t warpedDistance;
   data_t threshold;
+  // thresholds of the levels above the groups, and the level searched
+  std::vector<data_t> levelThresholds;
+  int queryLevel = 0;
   int totalNumberOfGroups = 0;
   bool wholeSeriesOnly = false;
   void _loadDistance(const std::string& distanceName);
-  int _group(int i);
+  bool metricDistance = false;
+  int _group(int i, const group_options_t& options, WorkStealingPool* pool = nullptr);
+  LocalLengthGroupSpace* _buildSpace(int i, const group_options_t& options, WorkStealingPool* pool);
+  void _finishIncremental(int i, const group_options_t& options);
   int _getMinLength() const;
+  int _bucketLengthCount(int length, double bucketRatio) const;
+  void _indexLengthSpaces();
+  vector<int> _traverseOrder(int queryLength) const;
+
+  // lazy grouping: the options of the spaces still to build, the build of
+  // each space once started, and the pool running the builds
+  bool lazy = false;
+  group_options_t lazyOptions;
+  std::vector< std::shared_future<void> > lazyBuilds;
+  std::unique_ptr<WorkStealingPool> lazyPool;
+  std::atomic<bool> lazyCancelled{false};
+  // guards lazyBuilds, and the spaces and totalNumberOfGroups while builds
+  // publish to them
+  mutable std::mutex lazyMutex;
+  // searches of lazily built spaces are serialized (see getBestMatch)
+  std::mutex searchMutex;
+  std::shared_future<void> _startBuild(int i);
+  void _prefetch(int queryLength);
+  LocalLengthGroupSpace* _space(int i, std::unique_lock<std::mutex>& search);
+  void _waitForBuilds();
+  bool _isFullyBuilt() const;
 
   /*************************
    *  Start serialization
@@ -101,28 +220,55 @@ private:
   template<class A>
   void save(A & ar, unsigned) const
   {
+    if (!this->_isFullyBuilt()) {
+      throw GenexException("Lazily grouped spaces must all be built before saving");
+    }
     size_t maxLen = this->localLengthGroupSpace.size();
     size_t minLen = _getMinLength();
     ar << minLen << maxLen << this->distanceName << this->threshold;
+    ar << this->levelThresholds;
     for (auto i = minLen; i < maxLen; i++) {
-      ar << *(this->localLengthGroupSpace[i]);
+      // Lengths inside a bucket have no space of their own
+      bool hasSpace = this->localLengthGroupSpace[i] != nullptr;
+      ar << hasSpace;
+      if (hasSpace) {
+        ar << *(this->localLengthGroupSpace[i]);
+      }
     }
   }
 
   template<class A>
-  void load(A & ar, unsigned)
+  void load(A & ar, unsigned version)
   {
     size_t maxLen, minLen;
     ar >> minLen >> maxLen >> this->distanceName >> this->threshold;
+    // Versions before 2 have no levels
+    this->levelThresholds.clear();
+    if (version >= 2) {
+      ar >> this->levelThresholds;
+    }
+    this->queryLevel = 0;
     this->_loadDistance(this->distanceName);
     this->localLengthGroupSpace.resize(dataset.getMaxLength() + 1, nullptr);
     this->totalNumberOfGroups = 0;
     for (auto i = minLen; i < maxLen; i++) {
+      // Version 0 has a space for every length
+      bool hasSpace = true;
+      if (version >= 1) {
+        ar >> hasSpace;
+      }
+      if (!hasSpace) {
+        continue;
+      }
       auto llgs = new LocalLengthGroupSpace(dataset, i);
       ar >> *llgs;
+      if (this->metricDistance) {
+        llgs->enableCentroidIndex(this->pairwiseDistance);
+      }
       this->localLengthGroupSpace[i] = llgs;
       this->totalNumberOfGroups += llgs->getNumberOfGroups();
     }
+    this->_indexLengthSpaces();
   }
 
   BOOST_SERIALIZATION_SPLIT_MEMBER()
@@ -133,4 +279,7 @@ private:
 };
 
 } // namespace genex
+
+BOOST_CLASS_VERSION(genex::GlobalGroupSpace, 2)
+
 #endif //GLOBAL_GROUP_SPACE_H
@@ -4,9 +4,11 @@
 #include <fstream>
 #include <vector>
 #include <algorithm>
+#include <cmath>
 
 #include "TimeSeries.hpp"
 #include "distance/Distance.hpp"
+#include "lib/trillionDTW.h"
 
 using std::vector;
 using std::ofstream;
@@ -17,52 +19,232 @@ namespace genex {
 
 void Group::addMember(int tsIndex, int tsStart)
 {
+  this->addMember(tsIndex, tsStart, this->memberLength);
+}
+
+void Group::addMember(int tsIndex, int tsStart, int tsLength)
+{
+  if (this->encodedMembers != nullptr) {
+    // Thread the encoded members back into the member map first
+    vector< std::pair<member_coord_t, int> > members;
+    this->_forEachMember([&members](const member_coord_t& member, int length) {
+      members.push_back(std::make_pair(member, length));
+    });
+    this->encodedMembers = nullptr;
+    this->count = 0;
+    this->lastMember = -1;
+    for (auto it = members.rbegin(); it != members.rend(); it++) {
+      this->addMember(it->first.first, it->first.second, it->second);
+    }
+  }
   this->count++;
-  this->memberMap[tsIndex * this->subTimeSeriesCount + tsStart] =
-    group_membership_t(this->groupIndex, this->lastMemberCoord);
-  this->lastMemberCoord = std::make_pair(tsIndex, tsStart);
+  this->centroidDistances.clear();
+  int l = tsLength - this->memberLength;
+  int slot = (l * this->dataset.getItemCount() + tsIndex) * this->subTimeSeriesCount + tsStart;
+  this->memberMap[slot] = group_membership_t(this->groupIndex, this->lastMember);
+  this->lastMember = slot;
+}
+
+void Group::measureMembers()
+{
+  if (this->lengthCount > 1) {
+    return;
+  }
+
+  vector<data_t> distances;
+  distances.reserve(this->count);
+  this->_forEachMember([&](const member_coord_t& member, int) {
+    const TimeSeries ts = this->dataset.getTimeSeries(
+      member.first, member.second, member.second + this->memberLength);
+    data_t total = 0;
+    for (int i = 0; i < this->memberLength; i++) {
+      total += (ts[i] - this->centroid[i]) * (ts[i] - this->centroid[i]);
+    }
+    distances.push_back(sqrt(total));
+  });
+  this->_setCentroidDistances(distances);
+}
+
+void Group::_setCentroidDistances(const vector<data_t>& distances)
+{
+  this->centroidDistances.clear();
+  if (distances.empty()) {
+    return;
+  }
+  data_t largest = *std::max_element(distances.begin(), distances.end());
+  // The step is widened by a little more than the rounding error of the
+  // division, so that a distance is never rounded below its value
+  this->centroidDistanceStep = largest / 255 * (1 + 1e-9);
+  this->centroidDistances.reserve(distances.size());
+  for (data_t d : distances) {
+    int steps = this->centroidDistanceStep > 0 ? (int)std::ceil(d / this->centroidDistanceStep) : 0;
+    this->centroidDistances.push_back((uint8_t)std::min(steps, 255));
+  }
+}
+
+bool Group::_memberBounds(const TimeSeries& query, const dist_t warpedDistance,
+                          data_t& keogh, data_t& spread, data_t& norm) const
+{
+  if (this->centroidDistances.empty() || this->stride > 1 || warpedDistance != cascadeDistance) {
+    return false;
+  }
+
+  // Each point of the query is warped onto a member point within the band,
+  // which is within the band envelope of the member. That envelope is within
+  // e[i] of the one of the centroid, where e[i] is the largest difference
+  // between the member and the centroid over the band around i, and the
+  // norm of e is at most spread times the distance between them.
+  int maxLength = std::max(query.getLength(), this->memberLength);
+  int band = std::min(calculateWarpingBandSize(maxLength), this->memberLength - 1);
+  vector<data_t> lower(this->memberLength);
+  vector<data_t> upper(this->memberLength);
+  vector<data_t> values(this->memberLength);
+  for (int i = 0; i < this->memberLength; i++) {
+    values[i] = this->centroid[i];
+  }
+  lower_upper_lemire(values.data(), this->memberLength, band, lower.data(), upper.data());
+
+  int len = std::min(query.getLength(), this->memberLength);
+  data_t total = 0;
+  for (int i = 0; i < len; i++)
+  {
+    data_t excess = 0;
+    if (query[i] > upper[i]) {
+      excess = query[i] - upper[i];
+    }
+    else if (query[i] < lower[i]) {
+      excess = lower[i] - query[i];
+    }
+    total += excess * excess;
+  }
+  keogh = sqrt(total);
+  spread = sqrt(std::min(2 * band + 1, this->memberLength));
+  norm = 2 * maxLength;
+  return true;
+}
+
+void Group::encodeMembers(vector<uint8_t>& out) const
+{
+  int itemCount = this->dataset.getItemCount();
+  int64_t previous = 0;
+  this->_forEachMember([&](const member_coord_t& member, int length) {
+    int64_t l = length - this->memberLength;
+    int64_t position = (l * this->subTimeSeriesCount + member.second) * itemCount + member.first;
+    int64_t delta = position - previous;
+    previous = position;
+    uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+    while (zigzag >= 0x80) {
+      out.push_back((uint8_t)(zigzag | 0x80));
+      zigzag >>= 7;
+    }
+    out.push_back((uint8_t)zigzag);
+  });
+}
+
+void Group::setEncodedMembers(const uint8_t* members)
+{
+  this->encodedMembers = members;
 }
 
 void Group::setCentroid(int tsIndex, int tsStart)
 {
-  this->centroid = this->dataset.getTimeSeries(tsIndex, tsStart, tsStart + this->memberLength);
+  this->setCentroid(tsIndex, tsStart, this->memberLength);
+}
+
+void Group::setCentroid(int tsIndex, int tsStart, int tsLength)
+{
+  this->centroid = this->dataset.getTimeSeries(tsIndex, tsStart, tsStart + tsLength);
+  if (tsLength != this->memberLength) {
+    this->centroid = this->centroid.resample(this->memberLength);
+  }
+  this->centroidCoord = std::make_pair(tsIndex, tsStart);
+  this->centroidLength = tsLength;
+  this->centroidInDataset = true;
+}
+
+void Group::refreshCentroid()
+{
+  if (this->centroidInDataset) {
+    this->setCentroid(this->centroidCoord.first, this->centroidCoord.second, this->centroidLength);
+  }
+  this->_refreshBounds();
+}
+
+void Group::_refreshBounds()
+{
+  // The pairwise distance is not known here
+  this->radius = INF;
+  bool withEnvelope = !this->memberEnvelope.empty();
+  if (withEnvelope) {
+    this->memberEnvelope.clear();
+  }
+  bool measured = !this->centroidDistances.empty();
+  if (!withEnvelope && !measured) {
+    return;
+  }
+
+  vector<data_t> distances;
+  this->_forEachMember([&](const member_coord_t& member, int) {
+    const TimeSeries ts = this->dataset.getTimeSeries(
+      member.first, member.second, member.second + this->memberLength);
+    if (withEnvelope) {
+      this->memberEnvelope.add(ts);
+    }
+    data_t total = 0;
+    for (int i = 0; i < this->memberLength; i++) {
+      total += (ts[i] - this->centroid[i]) * (ts[i] - this->centroid[i]);
+    }
+    distances.push_back(sqrt(total));
+  });
+  if (measured) {
+    this->_setCentroidDistances(distances);
+  }
 }
 
-data_t Group::distanceFromCentroid(const TimeSeries& query, const dist_t distance, data_t dropout)
+void Group::setCentroidData(data_t* values)
+{
+  TimeSeries copy(values, this->memberLength);
+  copy.setPrefixSumsOf(this->centroid);
+  this->centroid = std::move(copy);
+}
+
+data_t Group::distanceFromCentroid(const TimeSeries& query, const dist_t distance, data_t dropout) const
 {
   return distance(this->centroid, query, dropout, gNoMatching);
 }
 
 candidate_time_series_t Group::getBestMatch(const TimeSeries& query, const dist_t warpedDistance) const
 {
-  member_coord_t currentMemberCoord = this->lastMemberCoord;
-
   data_t bestSoFarDist = INF;
   member_coord_t bestSoFarMember;
+  int bestSoFarLength = this->memberLength;
+
+  // Members whose distance to the centroid bounds their distance to the
+  // query above the best one so far are skipped
+  data_t keogh, spread, norm;
+  bool bounded = this->_memberBounds(query, warpedDistance, keogh, spread, norm);
+  int position = 0;
 
-  while (currentMemberCoord.first != -1)
+  this->_forEachCandidate([&](const TimeSeries& currentTimeSeries)
   {
-    auto currIndex = currentMemberCoord.first;
-    auto currStart = currentMemberCoord.second;
+    if (bounded && (keogh - spread * this->_centroidDistance(position++)) / norm > bestSoFarDist) {
+      return;
+    }
 
-    TimeSeries currentTimeSeries = 
-      this->dataset.getTimeSeries(currIndex, currStart, currStart + this->memberLength);
     data_t currentDistance = 
       warpedDistance(query, currentTimeSeries, bestSoFarDist, gNoMatching);
 
     if (currentDistance < bestSoFarDist)
     {
       bestSoFarDist = currentDistance;
-      bestSoFarMember = currentMemberCoord;
+      bestSoFarMember = std::make_pair(currentTimeSeries.getIndex(), currentTimeSeries.getStart());
+      bestSoFarLength = currentTimeSeries.getLength();
     }
-
-    currentMemberCoord = 
-      this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;
-  }
+  });
 
   auto bestIndex = bestSoFarMember.first;
   auto bestStart = bestSoFarMember.second;
-  TimeSeries bestTimeSeries = this->dataset.getTimeSeries(bestIndex, bestStart, bestStart + this->memberLength);
+  TimeSeries bestTimeSeries = this->dataset.getTimeSeries(bestIndex, bestStart, bestStart + bestSoFarLength);
   candidate_time_series_t best(bestTimeSeries, bestSoFarDist);
 
   return best;
@@ -74,15 +256,19 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
   vector<candidate_time_series_t> bestSoFar;
 
   data_t bestSoFarDist = INF;
-  member_coord_t bestSoFarMember;
-  member_coord_t currentMemberCoord = this->lastMemberCoord;  
 
-  while (currentMemberCoord.first != -1)
-  {
-    auto currIndex = currentMemberCoord.first;
-    auto currStart = currentMemberCoord.second;
+  // Members that cannot be closer than the k best so far are skipped (see
+  // getBestMatch)
+  data_t keogh, spread, norm;
+  bool bounded = this->_memberBounds(query, warpedDistance, keogh, spread, norm);
+  int position = 0;
 
-    TimeSeries currentTimeSeries = this->dataset.getTimeSeries(currIndex, currStart, currStart + this->memberLength);
+  this->_forEachCandidate([&](const TimeSeries& currentTimeSeries)
+  {
+    data_t bound = bounded ? (keogh - spread * this->_centroidDistance(position++)) / norm : 0;
+    if (k <= 0 && !bestSoFar.empty() && bound > bestSoFar.front().dist) {
+      return;
+    }
 
     // EXPERIMENT
     extraTimeSeries ++;
@@ -112,8 +298,7 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
         bestSoFar.pop_back();
       } 
     }
-    currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;    
-  }
+  });
   // EXPERIMENT
   extraTimeSeries -= k;
   return bestSoFar;
@@ -122,18 +307,49 @@ vector<candidate_time_series_t> Group::intraGroupKSim(
 vector<TimeSeries> Group::getMembers() const
 {
   vector<TimeSeries> members;
-  auto currentMemberCoord = this->lastMemberCoord;
-  while (currentMemberCoord.first != -1)
-  {
-    auto currIndex = currentMemberCoord.first;
-    auto currStart = currentMemberCoord.second;
+  members.reserve(this->count);
+  this->_forEachMember([&](const member_coord_t& member, int length) {
+    auto currIndex = member.first;
+    auto currStart = member.second;
+    members.push_back(
+      this->dataset.getTimeSeries(currIndex, currStart, currStart + length));
+  });
+  return members;
+}
+
+vector<TimeSeries> Group::getCandidates() const
+{
+  vector<TimeSeries> candidates;
+  candidates.reserve(this->count);
+  this->_forEachCandidate([&](const TimeSeries& candidate) {
+    candidates.push_back(candidate);
+  });
+  return candidates;
+}
+
+void Group::addToBounds(const TimeSeries& member, data_t distance)
+{
+  this->radius = std::max(this->radius, distance);
 
-    auto currentTimeSeries = 
-      this->dataset.getTimeSeries(currIndex, currStart, currStart + this->memberLength);
-    members.push_back(currentTimeSeries);
-    currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;
+  // Members of other lengths are compared resampled, so an envelope of their
+  // values bounds nothing
+  if (this->lengthCount > 1 || member.getLength() != this->memberLength) {
+    this->memberEnvelope.clear();
+    return;
+  }
+
+  if (this->count == 1) {
+    this->memberEnvelope.clear();
+    this->memberEnvelope.add(member);
+  }
+  else if (!this->memberEnvelope.empty()) {
+    this->memberEnvelope.add(member);
   }
-  return members;
+}
+
+data_t Group::memberLowerBound(const TimeSeries& query) const
+{
+  return this->memberEnvelope.lowerBound(query);
 }
 
 void Group::saveGroupOld(ofstream &fout) const
@@ -143,14 +359,9 @@ void Group::saveGroupOld(ofstream &fout) const
   // Members in the group, represented by <index, start> pairs
   fout << this->centroid << endl;
   fout << this->count << " ";
-  auto currentMemberCoord = this->lastMemberCoord;
-  while (currentMemberCoord.first != -1)
-  {
-    int currIndex = currentMemberCoord.first;
-    int currStart = currentMemberCoord.second;
-    fout << currIndex << " " << currStart << " ";
-    currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;    
-  }
+  this->_forEachMember([&fout](const member_coord_t& member, int) {
+    fout << member.first << " " << member.second << " ";
+  });
   fout << endl;
 }
 
@@ -158,6 +369,9 @@ void Group::loadGroupOld(ifstream &fin)
 {
   int cnt;
   this->centroid = TimeSeries(this->memberLength);
+  this->centroidInDataset = false;
+  // The old format has no bounds
+  this->radius = INF;
 
   for (int i = 0; i < this->memberLength; i++) {
     fin >> this->centroid[i];
@@ -3,11 +3,17 @@
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/split_member.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "TimeSeriesSet.hpp"
 #include "distance/Distance.hpp"
+#include "group/Envelope.hpp"
 
+#include <algorithm>
+#include <cstdint>
 #include <fstream>
+#include <vector>
 
 namespace genex {
 
@@ -21,14 +27,20 @@ typedef std::pair<int, int> member_coord_t;
 /**
  *  @brief a structure, used for identifying membership of a sub-time-series and
  *         the sub-time-series right before it in a group
+ *
+ *  A member is identified by its slot in the member map,
+ *  index * subTimeSeriesCount + start; prev is -1 for the first member. When
+ *  a group holds members longer than its length (see Group::setLengthCount),
+ *  a member l points longer has the slot
+ *  (l * itemCount + index) * subTimeSeriesCount + start.
  */
 struct group_membership_t
 {
-  member_coord_t prev;
-  int groupIndex;
+  int32_t prev;
+  int32_t groupIndex;
 
   group_membership_t() {}
-  group_membership_t(int groupIndex, member_coord_t prev)
+  group_membership_t(int groupIndex, int prev)
     : groupIndex(groupIndex), prev(prev) {}
 };
 
@@ -75,7 +87,9 @@ public:
     dataset(dataset),
     memberMap(memberMap),
     centroid(memberLength),
-    lastMemberCoord(std::make_pair(-1, -1)),
+    centroidCoord(std::make_pair(0, 0)),
+    centroidLength(memberLength),
+    lastMember(-1),
     count(0) {}
 
   /**
@@ -86,6 +100,16 @@ public:
    */
   void addMember(int index, int start);
 
+  /**
+   *  @brief adds a member that may be longer than the group
+   *
+   *  @param index which sequence the member is from
+   *  @param start where the member starts in the data
+   *  @param length length of the member, less than getMemberLength() + the
+   *         length count (see setLengthCount)
+   */
+  void addMember(int index, int start, int length);
+
   /**
    *  @brief set the centroid of the group
    *
@@ -94,6 +118,15 @@ public:
    */
   void setCentroid(int index, int start);
 
+  /**
+   *  @brief sets the centroid to a subsequence resampled to the group length
+   *
+   *  @param index index of sequence the centroid is from
+   *  @param start where the centroid starts in the data
+   *  @param length length of the subsequence in the data
+   */
+  void setCentroid(int index, int start, int length);
+
   /**
    *  @brief gets the centroid of the group
    *
@@ -104,6 +137,87 @@ public:
     return this->centroid;
   }
 
+  /**
+   *  @brief widens the radius and the member envelope of the group to a member
+   *
+   *  The envelope holds the smallest and the largest value of the members at
+   *  each position. It is only kept while every member has the length of the
+   *  group (see setLengthCount).
+   *
+   *  @param member values of the member in the dataset
+   *  @param distance pairwise distance between the member and the centroid
+   */
+  void addToBounds(const TimeSeries& member, data_t distance);
+
+  /**
+   *  @return the largest pairwise distance between a member and the centroid,
+   *          as given to addToBounds; INF if unknown
+   */
+  data_t getRadius() const { return this->radius; }
+
+  /**
+   *  @return true if the member envelope is known (see addToBounds)
+   */
+  bool hasMemberEnvelope() const { return !this->memberEnvelope.empty(); }
+
+  /**
+   *  @brief gets a lower bound of cascadeDistance from a query to every member
+   *
+   *  This is the Keogh lower bound (see keoghLowerBound) of the query against
+   *  the member envelope widened by the warping band. It does not cover the
+   *  starts compared around the members with a stride.
+   *
+   *  @param query the query
+   *  @return the lower bound; 0 if the member envelope is not known
+   */
+  data_t memberLowerBound(const TimeSeries& query) const;
+
+  /**
+   *  @brief keeps the Euclidean distance from each member to the centroid
+   *
+   *  Distances are kept in one byte each, rounded up to a 255th of the
+   *  largest one. The distance of a member to the centroid bounds its distance to a query,
+   *  so getBestMatch and intraGroupKSim skip the members that cannot be closer
+   *  than the best ones found so far. Members keep their order, which keeps
+   *  them compact once encoded (see encodeMembers). Adding a member drops the
+   *  distances. Nothing is done for groups of several member lengths.
+   */
+  void measureMembers();
+
+  /**
+   *  @return true if the distances of the members to the centroid are kept
+   *          (see measureMembers)
+   */
+  bool hasMemberDistances() const { return !this->centroidDistances.empty(); }
+
+  /**
+   *  @brief gets the coordinate of the centroid in the dataset
+   *
+   *  @return index and start of the centroid given to setCentroid
+   */
+  member_coord_t getCentroidCoord() const
+  {
+    return this->centroidCoord;
+  }
+
+  /**
+   *  @brief makes the centroid read its values from a copy held elsewhere
+   *
+   *  The coordinate of the centroid is kept. Used by LocalLengthGroupSpace to
+   *  keep all centroids of a length in one matrix.
+   *
+   *  @param values a copy of the values of the centroid
+   */
+  void setCentroidData(data_t* values);
+
+  /**
+   *  @brief reads the centroid from the dataset again if it was set by setCentroid
+   *
+   *  The member envelope and the distances of the members to the centroid
+   *  are read again too, and the radius becomes unknown.
+   */
+  void refreshCentroid();
+
   /**
    *  @brief gets the length of each sequence in the group
    *
@@ -118,6 +232,34 @@ public:
    */
   int getCount(void) const { return this->count;  }
 
+  /**
+   *  @brief sets the spacing of the starts grouped at this length
+   *
+   *  With a stride s above 1 only starts at multiples of s are members, and
+   *  getBestMatch and intraGroupKSim also compare the starts within s - 1 of
+   *  each member in the same series.
+   *
+   *  @param stride the spacing of grouped starts
+   */
+  void setStride(int stride) { this->stride = stride; }
+
+  /**
+   *  @return the spacing of grouped starts (see setStride)
+   */
+  int getStride() const { return this->stride; }
+
+  /**
+   *  @brief lets the group hold members of several lengths
+   *
+   *  Members may then be up to count - 1 points longer than the group. They
+   *  are compared with the centroid resampled to the group length, but
+   *  getMembers, getBestMatch and intraGroupKSim return them at their own
+   *  length. Must be called before any member is added or loaded.
+   *
+   *  @param count number of member lengths, from getMemberLength() on
+   */
+  void setLengthCount(int count) { this->lengthCount = count; }
+
   /**
    *  @brief returns the distance between the centroid and the query
    *
@@ -126,7 +268,7 @@ public:
    *  @param dropout upper bound for early stopping
    *  @return the distance between the query and the centroid
    */
-  data_t distanceFromCentroid(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout);
+  data_t distanceFromCentroid(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout) const;
 
   /**
    *  @brief gets the best match of a query in this group using the given distance
@@ -140,6 +282,15 @@ public:
    */
   std::vector<TimeSeries> getMembers() const;
 
+  /**
+   *  @brief gets the members and, with a stride, the starts within
+   *         stride - 1 of each member, which getBestMatch and intraGroupKSim
+   *         also compare
+   *
+   *  @return the TimeSeries of each candidate, once each
+   */
+  std::vector<TimeSeries> getCandidates() const;
+
   /**
    *  @brief performs necessary KNN operations a group
    *
@@ -151,6 +302,31 @@ public:
   std::vector<candidate_time_series_t> intraGroupKSim(
       const TimeSeries& query, int k, const dist_t warpedDistance) const;
   
+  /**
+   *  @brief appends the members, newest first, in a compact encoding
+   *
+   *  Each member is turned into its position in grouping order,
+   *  start * itemCount + index (plus l * subTimeSeriesCount * itemCount for a
+   *  member l points longer than the group), and stored as the zigzag varint of the
+   *  difference with the previous member. Members are added in increasing
+   *  position, so most of them take one or two bytes.
+   *
+   *  @param out the bytes to append to
+   */
+  void encodeMembers(std::vector<uint8_t>& out) const;
+
+  /**
+   *  @brief makes the group read its members from encoded bytes
+   *
+   *  The bytes hold getCount() members as written by encodeMembers and must
+   *  outlive the group or the next call to addMember, which goes back to the
+   *  member list threaded through memberMap. The member map is no longer
+   *  read, so its owner may release it.
+   *
+   *  @param members the first byte of the encoded members of the group
+   */
+  void setEncodedMembers(const uint8_t* members);
+
   void saveGroup(std::ofstream &fout) const;
   void loadGroup(std::ifstream &fin);
 
@@ -164,13 +340,136 @@ private:
 
   int groupIndex;
 
-  member_coord_t lastMemberCoord;
+  // member map slot of the newest member; -1 if none
+  int lastMember;
 
   int memberLength;
   int subTimeSeriesCount;
   int count;
 
   TimeSeries centroid;
+  member_coord_t centroidCoord;
+  // length of the centroid in the dataset, before resampling
+  int centroidLength;
+  // false if the centroid values were loaded as they are (see loadGroupOld)
+  bool centroidInDataset = false;
+
+  // members set by setEncodedMembers; nullptr to follow memberMap
+  const uint8_t* encodedMembers = nullptr;
+  // spacing of the starts grouped at this length (see setStride)
+  int stride = 1;
+  // number of member lengths (see setLengthCount)
+  int lengthCount = 1;
+
+  // largest distance between a member and the centroid, and smallest and
+  // largest value of the members at each position (see addToBounds)
+  data_t radius = 0;
+  Envelope memberEnvelope;
+
+  // Euclidean distance from each member to the centroid, in the order members
+  // are visited, as a multiple of centroidDistanceStep rounded up so that the
+  // bound of _memberBounds stays a lower bound; empty unless measured (see
+  // measureMembers)
+  vector<uint8_t> centroidDistances;
+  data_t centroidDistanceStep = 0;
+
+  /**
+   *  Sets the terms of the lower bound of cascadeDistance from the query to
+   *  the member visited at position p,
+   *  (keogh - spread * _centroidDistance(p)) / norm. Returns false if the
+   *  members are not measured or the bound does not hold for the distance.
+   */
+  bool _memberBounds(const TimeSeries& query, const dist_t warpedDistance,
+                     data_t& keogh, data_t& spread, data_t& norm) const;
+
+  /**
+   *  Keeps the distances of the members to the centroid, rounded up to one
+   *  of 255 steps of the largest one
+   */
+  void _setCentroidDistances(const vector<data_t>& distances);
+
+  /**
+   *  Gets the distance of the member visited at position p to the centroid,
+   *  rounded up (see centroidDistances)
+   */
+  data_t _centroidDistance(int p) const
+  {
+    return this->centroidDistances[p] * this->centroidDistanceStep;
+  }
+
+  /**
+   *  Computes the member envelope and the distances to the centroid again
+   *  from the dataset, whose values changed
+   */
+  void _refreshBounds();
+
+  /**
+   *  Calls f on the coordinate and the length of each member, newest first
+   */
+  template<class F>
+  void _forEachMember(F f) const
+  {
+    if (this->encodedMembers != nullptr) {
+      int itemCount = this->dataset.getItemCount();
+      const uint8_t* p = this->encodedMembers;
+      int64_t position = 0;
+      for (int i = 0; i < this->count; i++) {
+        uint64_t zigzag = 0;
+        for (int shift = 0; ; shift += 7) {
+          uint8_t b = *p++;
+          zigzag |= (uint64_t)(b & 0x7f) << shift;
+          if (!(b & 0x80)) {
+            break;
+          }
+        }
+        position += (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        int64_t rest = position / itemCount;
+        f(std::make_pair((int)(position % itemCount), (int)(rest % this->subTimeSeriesCount)),
+          this->memberLength + (int)(rest / this->subTimeSeriesCount));
+      }
+      return;
+    }
+    int itemCount = this->dataset.getItemCount();
+    int current = this->lastMember;
+    while (current != -1)
+    {
+      int rest = current / this->subTimeSeriesCount;
+      f(std::make_pair(rest % itemCount, current % this->subTimeSeriesCount),
+        this->memberLength + rest / itemCount);
+      current = this->memberMap[current].prev;
+    }
+  }
+
+  /**
+   *  Calls f on each member, as a time series, and, with a stride, on each
+   *  start within stride - 1 of a member at the length of the member, once each
+   */
+  template<class F>
+  void _forEachCandidate(F f) const
+  {
+    if (this->stride <= 1) {
+      this->_forEachMember([&](const member_coord_t& member, int length) {
+        f(this->dataset.getTimeSeries(member.first, member.second, member.second + length));
+      });
+      return;
+    }
+    // Length, index and start of each candidate
+    std::vector< std::pair<int, member_coord_t> > candidates;
+    this->_forEachMember([&](const member_coord_t& member, int length) {
+      int last = this->dataset.getItemLength(member.first) - length;
+      int from = std::max(0, member.second - this->stride + 1);
+      int to = std::min(last, member.second + this->stride - 1);
+      for (int start = from; start <= to; start++) {
+        candidates.push_back(std::make_pair(length, std::make_pair(member.first, start)));
+      }
+    });
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    for (auto& c : candidates) {
+      int start = c.second.second;
+      f(this->dataset.getTimeSeries(c.second.first, start, start + c.first));
+    }
+  }
 
   /*************************
    *  Start serialization
@@ -179,30 +478,65 @@ private:
   template<class A>
   void save(A & ar, unsigned) const
   {
-    ar << this->centroid.getIndex() << this->centroid.getStart();
-    ar << this->count;
-    member_coord_t currentMemberCoord = this->lastMemberCoord;
-    while (currentMemberCoord.first != -1)
-    {
-      int currIndex = currentMemberCoord.first;
-      int currStart = currentMemberCoord.second;
-      ar << currIndex << currStart;
-      currentMemberCoord = this->memberMap[currIndex * this->subTimeSeriesCount + currStart].prev;    
+    // Lengths are only written for groups of several member lengths
+    bool withLengths = this->lengthCount > 1;
+    ar << this->centroidCoord.first << this->centroidCoord.second;
+    if (withLengths) {
+      ar << this->centroidLength;
     }
+    ar << this->count;
+    this->_forEachMember([&ar, withLengths](const member_coord_t& member, int length) {
+      ar << member.first << member.second;
+      if (withLengths) {
+        ar << length;
+      }
+    });
+    ar << this->radius << this->memberEnvelope.getLower() << this->memberEnvelope.getUpper();
+    ar << this->centroidDistances << this->centroidDistanceStep;
   }
 
   template<class A>
-  void load(A & ar, unsigned)
+  void load(A & ar, unsigned version)
   {
-    int cindex, cstart;
+    bool withLengths = this->lengthCount > 1;
+    int cindex, cstart, clength = this->memberLength;
     ar >> cindex >> cstart;
-    this->setCentroid(cindex, cstart);
+    if (withLengths) {
+      ar >> clength;
+    }
+    this->setCentroid(cindex, cstart, clength);
     int cnt;
     ar >> cnt;
+    // Members are saved newest first, so they are added back from the last
+    // one to be visited in the same order
+    std::vector< std::pair<member_coord_t, int> > members(cnt);
     for (int i = 0; i < cnt; i++) {
-      int index, start;
+      int index, start, length = this->memberLength;
       ar >> index >> start;
-      this->addMember(index, start);
+      if (withLengths) {
+        ar >> length;
+      }
+      members[i] = std::make_pair(std::make_pair(index, start), length);
+    }
+    for (auto it = members.rbegin(); it != members.rend(); it++) {
+      this->addMember(it->first.first, it->first.second, it->second);
+    }
+
+    // Version 0 has no bounds, versions before 2 no distances of the members
+    // to the centroid, and version 2 has them at full precision
+    if (version >= 1) {
+      ar >> this->radius >> this->memberEnvelope.getLower() >> this->memberEnvelope.getUpper();
+    }
+    else {
+      this->radius = INF;
+    }
+    if (version == 2) {
+      std::vector<data_t> distances;
+      ar >> distances;
+      this->_setCentroidDistances(distances);
+    }
+    else if (version >= 3) {
+      ar >> this->centroidDistances >> this->centroidDistanceStep;
     }
   }
 
@@ -214,4 +548,7 @@ private:
 };
 
 } // namespace genex
+
+BOOST_CLASS_VERSION(genex::Group, 3)
+
 #endif //GROUP_HPP
@@ -6,11 +6,16 @@
 #include <cmath>
 #include <iostream>
 #include <chrono>
+#include <future>
+#include <mutex>
+#include <random>
 
 #include "TimeSeries.hpp"
 #include "group/Group.hpp"
 #include "Exception.hpp"
 #include "distance/Distance.hpp"
+#include "lib/DotProducts.hpp"
+#include "lib/WorkStealingPool.hpp"
 
 using std::cout;
 using std::ofstream;
@@ -21,92 +26,1601 @@ using namespace std::chrono;
 #define LOG_EVERY_S 10
 #define LOG_FREQ  5
 
+// Number of subsequences matched by one task of parallel grouping
+#define GROUP_CHUNK_SIZE 64
+// Upper bound on the number of tasks per thread in one round of parallel grouping
+#define GROUP_CHUNKS_PER_THREAD 8
+// Relative distance to the dropout below which an extended seed distance is
+// recomputed exactly
+#define EXTEND_TOLERANCE 1e-9
+// Number of centroids whose dot products with a batch are computed at once
+#define BATCH_CENTROID_BLOCK 256
+// Margin on squared distances expanded from dot products, relative to the
+// norms; far above their rounding error
+#define BATCH_TOLERANCE 1e-9
+// Margin on the difference of means bounding a distance, relative to the
+// magnitude of the means
+#define MEAN_BOUND_TOLERANCE 1e-9
+// Number of random projections making up the key of a hash table
+#define LSH_HASHES_PER_TABLE 4
+// Number of most recent centroids scanned when hashing finds no centroid
+// within the dropout
+#define LSH_FALLBACK_CENTROIDS 32
+// Number of members closest to the centroid tried as medoid of a large group
+#define MEDOID_CANDIDATES 32
+// Number of groups whose medoids are found by one task of refinement
+#define MEDOID_CHUNK_SIZE 16
+
 namespace genex {
 
-LocalLengthGroupSpace::LocalLengthGroupSpace(const TimeSeriesSet& dataset, int length)
- : dataset(dataset), length(length)
+static data_t meanOf(const TimeSeries& ts)
+{
+  data_t sum = 0;
+  for (int i = 0; i < ts.getLength(); i++) {
+    sum += ts[i];
+  }
+  return sum / ts.getLength();
+}
+
+// Work counted by the pairwise distances of the calling thread so far
+static group_stats_t pairwiseWork()
+{
+  group_stats_t work;
+  work.comparisons = gPairwiseComparisons;
+  work.points = gPairwisePoints;
+  return work;
+}
+
+// Adds the work counted on the calling thread since a snapshot of pairwiseWork
+static void addWorkSince(group_stats_t& stats, const group_stats_t& since)
+{
+  stats.comparisons += gPairwiseComparisons - since.comparisons;
+  stats.points += gPairwisePoints - since.points;
+}
+
+LocalLengthGroupSpace::LocalLengthGroupSpace(const TimeSeriesSet& dataset, int length,
+  int lengthCount)
+ : dataset(dataset), length(length), lengthCount(lengthCount), centroids(length)
+{
+  if (lengthCount < 1) {
+    throw GenexException("Length count must be positive");
+  }
+  this->subTimeSeriesCount = dataset.getMaxLength() - length + 1;
+  this->_allocateMemberMap();
+}
+
+LocalLengthGroupSpace::~LocalLengthGroupSpace()
+{
+  reset();
+  delete this->centroidIndex;
+}
+
+void LocalLengthGroupSpace::reset()
+{
+  groups.clear();
+  vector<uint8_t>().swap(memberBytes);
+  centroids.clear();
+  neighbours.clear();
+  centroidMeans.clear();
+  sampled.clear();
+  hashTables.clear();
+  superGroups.clear();
+  levels.clear();
+  stats = group_stats_t();
+  if (this->centroidIndex != nullptr) {
+    this->centroidIndex->clear();
+  }
+}
+
+/**
+ *  Finds the closest centroid to a subsequence within a dropout distance, walking
+ *  a VP-tree built with the same metric pairwise distance.
+ */
+struct nearest_centroid_visitor_t
+{
+  const TimeSeries& query;
+  const dist_t distance;
+  const vector<Group>& groups;
+  data_t best;
+  int bestIndex;
+  // stop at the first centroid within the dropout
+  bool stopAtFirst;
+
+  data_t visit(int i, data_t reach)
+  {
+    if (stopAtFirst && bestIndex >= 0) {
+      return INF;
+    }
+    auto dist = groups[i].distanceFromCentroid(query, distance, best + reach);
+    // Equal distances go to the earliest group, like a scan in creation order
+    if (dist <= best && dist < INF && (dist < best || bestIndex < 0 || i < bestIndex)) {
+      best = dist;
+      bestIndex = i;
+    }
+    return dist;
+  }
+
+  data_t lowerBound(data_t key, data_t lo, data_t hi) const
+  {
+    return std::max(key - hi, lo - key);
+  }
+
+  data_t bound() const { return stopAtFirst && bestIndex >= 0 ? -INF : best; }
+};
+
+/**
+ *  Finds the centroids within a radius of a new centroid
+ */
+struct neighbour_visitor_t
+{
+  const TimeSeries& centroid;
+  const dist_t distance;
+  const vector<Group>& groups;
+  data_t radius;
+  vector< std::pair<data_t, int> > found;
+
+  data_t visit(int i, data_t reach)
+  {
+    auto dist = groups[i].distanceFromCentroid(centroid, distance, radius + reach);
+    if (dist <= radius) {
+      found.push_back(std::make_pair(dist, i));
+    }
+    return dist;
+  }
+
+  data_t lowerBound(data_t key, data_t lo, data_t hi) const
+  {
+    return std::max(key - hi, lo - key);
+  }
+
+  data_t bound() const { return radius; }
+};
+
+/**
+ *  Ranks centroids indexed by euclidean distance against a query under
+ *  cascadeDistance. The Keogh lower bound against the query envelope is a distance
+ *  from a point to a set, so it changes by at most the euclidean distance between
+ *  two centroids, which bounds it over a whole subtree of the index.
+ */
+struct keogh_centroid_visitor_t
+{
+  const TimeSeries& query;
+  const vector<Group>& groups;
+  // converts the pairwise distance of the index to an unnormalized euclidean distance
+  data_t scale;
+  // normalization of keoghLowerBound
+  data_t norm;
+
+  keogh_centroid_visitor_t(const TimeSeries& query, const vector<Group>& groups, int length)
+    : query(query), groups(groups), scale(sqrt(length)),
+      norm(2 * std::max(query.getLength(), length)) {}
+
+  data_t key(int i) const
+  {
+    return keoghLowerBound(query, groups[i].getCentroid(), INF) * norm;
+  }
+
+  data_t lowerBound(data_t key, data_t lo, data_t hi) const
+  {
+    return (key - hi * scale) / norm;
+  }
+};
+
+struct best_group_visitor_t : keogh_centroid_visitor_t
+{
+  const dist_t warpedDistance;
+  data_t best;
+  int bestIndex = -1;
+
+  best_group_visitor_t(const TimeSeries& query, const vector<Group>& groups, int length,
+                       const dist_t warpedDistance, data_t dropout)
+    : keogh_centroid_visitor_t(query, groups, length),
+      warpedDistance(warpedDistance), best(dropout) {}
+
+  data_t visit(int i, data_t /* reach */)
+  {
+    auto k = this->key(i);
+    if (k / norm <= best) {
+      auto dist = groups[i].distanceFromCentroid(query, warpedDistance, best);
+      if (dist < best || (dist == best && bestIndex >= 0 && i < bestIndex)) {
+        best = dist;
+        bestIndex = i;
+      }
+    }
+    return k;
+  }
+
+  data_t bound() const { return best; }
+};
+
+/**
+ *  Adds a candidate to a heap of the closest candidates holding k members,
+ *  where k is the number of members still missing
+ */
+static void keepClosest(const group_index_t& candidate, vector<group_index_t> &bestSoFar, int& k)
+{
+  if (k <= 0) // if heap is full, keep only sum-k groups
+  {
+    if (candidate.dist < bestSoFar.front().dist) {
+      auto membersAdded = candidate.members;
+      bestSoFar.push_back(candidate);
+      std::push_heap(bestSoFar.begin(), bestSoFar.end());
+      k -= membersAdded;
+      // If the worst (furthest) group can be removed, with keeping at least k elements
+      // tracked, remove it.
+      while(k + bestSoFar.front().members <= 0) { 
+        k += bestSoFar.front().members;
+        std::pop_heap(bestSoFar.begin(), bestSoFar.end());
+        bestSoFar.pop_back();
+      }
+    }
+  }
+  else // heap is not full, directly add to heap.
+  {
+    auto membersAdded = candidate.members;
+    bestSoFar.push_back(candidate);
+    k -= membersAdded;
+    if (k <= 0) {
+      // heapify the heap exactly once when it becomes full.
+      std::make_heap(bestSoFar.begin(), bestSoFar.end());
+      while(k + bestSoFar.front().members <= 0) { 
+        k += bestSoFar.front().members;
+        std::pop_heap(bestSoFar.begin(), bestSoFar.end());
+        bestSoFar.pop_back();
+      }
+    }
+  }
+}
+
+/**
+ *  Offers group i to the heap of best groups of interLevelKSim
+ */
+static void offerGroup(int length, int i, const Group& group, const TimeSeries& query,
+                       const dist_t warpedDistance, vector<group_index_t> &bestSoFar, int& k)
+{
+  auto dropout = k <= 0 ? bestSoFar.front().dist : INF;
+  auto dist = group.distanceFromCentroid(query, warpedDistance, dropout);
+  keepClosest(group_index_t(length, i, group.getCount(), dist), bestSoFar, k);
+}
+
+struct k_best_groups_visitor_t : keogh_centroid_visitor_t
+{
+  const dist_t warpedDistance;
+  int length;
+  vector<group_index_t>& bestSoFar;
+  int& k;
+
+  k_best_groups_visitor_t(const TimeSeries& query, const vector<Group>& groups, int length,
+                          const dist_t warpedDistance, vector<group_index_t>& bestSoFar, int& k)
+    : keogh_centroid_visitor_t(query, groups, length),
+      warpedDistance(warpedDistance), length(length), bestSoFar(bestSoFar), k(k) {}
+
+  data_t visit(int i, data_t /* reach */)
+  {
+    auto key = this->key(i);
+    // A group further than the worst kept group is never added
+    if (key / norm <= this->bound()) {
+      offerGroup(length, i, groups[i], query, warpedDistance, bestSoFar, k);
+    }
+    return key;
+  }
+
+  data_t bound() const { return k <= 0 ? bestSoFar.front().dist : INF; }
+};
+
+void LocalLengthGroupSpace::enableCentroidIndex(const dist_t pairwiseDistance)
+{
+  this->indexDistance = pairwiseDistance;
+  this->keoghIndex = pairwiseDistance == getDistanceFromName("euclidean");
+  if (this->centroidIndex != nullptr && this->centroidIndex->size() == this->groups.size()) {
+    return;
+  }
+  delete this->centroidIndex;
+  this->centroidIndex = new VPTree();
+  for (auto i = 0; i < this->groups.size(); i++) {
+    this->_indexCentroid(i);
+  }
+}
+
+bool LocalLengthGroupSpace::hasCentroidIndex() const
+{
+  return this->centroidIndex != nullptr && this->indexDistance != nullptr;
+}
+
+void LocalLengthGroupSpace::enableTriangleBounds()
+{
+  this->triangleBounds = true;
+}
+
+void LocalLengthGroupSpace::_addNeighbours(
+  int groupIndex, const dist_t pairwiseDistance, data_t threshold)
+{
+  // A subsequence joins a centroid within threshold / 2, so the closest centroid
+  // of a member of A is within threshold of A
+  const TimeSeries& centroid = this->groups[groupIndex].getCentroid();
+  neighbour_visitor_t visitor = { centroid, pairwiseDistance, this->groups, threshold };
+  if (this->hasCentroidIndex()) {
+    this->centroidIndex->search(visitor);
+  }
+  else {
+    for (auto i = 0; i < groupIndex; i++) {
+      visitor.visit(i, 0);
+    }
+  }
+
+  this->neighbours.resize(groupIndex + 1);
+  for (auto& n : visitor.found) {
+    auto& list = this->neighbours[n.second];
+    auto entry = std::make_pair(n.first, groupIndex);
+    list.insert(std::upper_bound(list.begin(), list.end(), entry), entry);
+  }
+  std::sort(visitor.found.begin(), visitor.found.end());
+  this->neighbours[groupIndex].swap(visitor.found);
+}
+
+void LocalLengthGroupSpace::_refineWithNeighbours(const TimeSeries& query,
+  const dist_t pairwiseDistance, int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const
+{
+  // A centroid B can only beat A = bestSoFarIndex if
+  // dist(A, B) <= dist(q, A) + dist(q, B) <= dist(q, A) + bestSoFar
+  int a = bestSoFarIndex;
+  data_t da = bestSoFar;
+  for (auto& n : this->neighbours[a])
+  {
+    if (n.first > da + bestSoFar) {
+      break;
+    }
+    int b = n.second;
+    if (b >= numGroups) {
+      continue;
+    }
+    auto dist = this->groups[b].distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+    if (dist < bestSoFar || (dist == bestSoFar && b < bestSoFarIndex))
+    {
+      bestSoFar = dist;
+      bestSoFarIndex = b;
+    }
+  }
+}
+
+void LocalLengthGroupSpace::_storeCentroid(int groupIndex)
+{
+  data_t* before = this->centroids.getData();
+  this->centroids.add(this->groups[groupIndex].getCentroid());
+  // Rows move when the matrix grows
+  int from = this->centroids.getData() == before ? groupIndex : 0;
+  for (auto i = from; i <= groupIndex; i++) {
+    this->groups[i].setCentroidData(this->centroids.getRow(i));
+  }
+}
+
+void LocalLengthGroupSpace::refreshCentroids()
+{
+  // The centroids read their values from the old matrix until the swap
+  CentroidMatrix fresh(this->length);
+  for (auto& g : this->groups) {
+    g.refreshCentroid();
+    fresh.add(g.getCentroid());
+  }
+  this->centroids.swap(fresh);
+  for (auto i = 0; i < this->groups.size(); i++) {
+    this->groups[i].setCentroidData(this->centroids.getRow(i));
+  }
+
+  // The pairwise distance is not known here
+  for (auto& s : this->superGroups) {
+    s.radius = INF;
+    s.envelope.clear();
+    for (auto g : s.groups) {
+      s.envelope.add(this->groups[g].getCentroid());
+    }
+  }
+  for (auto& level : this->levels) {
+    for (auto& s : level) {
+      s.radius = INF;
+    }
+  }
+}
+
+void LocalLengthGroupSpace::_prepareEnvelopes(const TimeSeries& query) const
+{
+  int band = calculateWarpingBandSize(std::max(query.getLength(), this->length));
+  if (this->centroids.prepareEnvelopes(band)) {
+    for (auto i = 0; i < this->groups.size(); i++) {
+      this->groups[i].getCentroid().setKeoghEnvelope(
+        this->centroids.getLower(i), this->centroids.getUpper(i), band);
+    }
+  }
+}
+
+void LocalLengthGroupSpace::_indexCentroid(int groupIndex)
+{
+  this->centroidIndex->insert(groupIndex, [this](int a, int b) {
+    return this->groups[a].distanceFromCentroid(
+      this->groups[b].getCentroid(), this->indexDistance, INF);
+  });
+}
+
+void LocalLengthGroupSpace::_nearestCentroid(const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups,
+  data_t& bestSoFar, int& bestSoFarIndex) const
+{
+  if (this->hashing) {
+    this->_nearestByHash(query, pairwiseDistance, dropout, numGroups, bestSoFar, bestSoFarIndex);
+    return;
+  }
+
+  // A seed within the dropout (see _seed) stands for the first centroid found
+  bool seeded = bestSoFarIndex >= 0 && bestSoFar <= dropout;
+  if (seeded && this->triangleBounds) {
+    this->_refineWithNeighbours(query, pairwiseDistance, numGroups, bestSoFar, bestSoFarIndex);
+    return;
+  }
+
+  if (this->hasCentroidIndex()) {
+    // Only a centroid within the dropout matters, so the search starts bounded.
+    // The index holds exactly the first numGroups centroids.
+    nearest_centroid_visitor_t visitor = {
+      query, pairwiseDistance, this->groups, seeded ? bestSoFar : dropout,
+      seeded ? bestSoFarIndex : -1, this->triangleBounds };
+    this->centroidIndex->search(visitor);
+    bestSoFar = visitor.bestIndex < 0 ? INF : visitor.best;
+    bestSoFarIndex = visitor.bestIndex;
+    if (this->triangleBounds && bestSoFarIndex >= 0) {
+      this->_refineWithNeighbours(query, pairwiseDistance, numGroups, bestSoFar, bestSoFarIndex);
+    }
+    return;
+  }
+
+  if (this->meanOrdered) {
+    this->_nearestByMean(query, pairwiseDistance, dropout, numGroups, bestSoFar, bestSoFarIndex);
+    return;
+  }
+
+  if (this->triangleBounds) {
+    // Centroids before the first one within the dropout are all further than it
+    for (auto i = 0; i < numGroups; i++)
+    {
+      auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, dropout);
+      if (dist <= dropout)
+      {
+        bestSoFar = dist;
+        bestSoFarIndex = i;
+        this->_refineWithNeighbours(query, pairwiseDistance, numGroups, bestSoFar, bestSoFarIndex);
+        return;
+      }
+    }
+    bestSoFar = INF;
+    bestSoFarIndex = -1;
+    return;
+  }
+
+  // Without an index every centroid is scanned anyway; the closest one is
+  // returned even if it is beyond the dropout
+  if (!seeded) {
+    bestSoFar = INF;
+    bestSoFarIndex = -1;
+  }
+  for (auto i = 0; i < numGroups; i++)
+  {
+    auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+    if (dist < bestSoFar || (dist == bestSoFar && i < bestSoFarIndex))
+    {
+      bestSoFar = dist;
+      bestSoFarIndex = i;
+    }
+  }
+}
+
+void LocalLengthGroupSpace::_nearestByMean(const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups,
+  data_t& bestSoFar, int& bestSoFarIndex) const
+{
+  // Only a centroid within the dropout matters, so the search starts bounded
+  int seedIndex = bestSoFarIndex >= 0 && bestSoFar <= dropout ? bestSoFarIndex : -1;
+  if (seedIndex < 0) {
+    bestSoFar = dropout;
+    bestSoFarIndex = -1;
+  }
+
+  // Centroids are visited outwards from the mean of the query. One whose mean
+  // differs by more than the best distance cannot be closer.
+  data_t mean = meanOf(query);
+  data_t tolerance = MEAN_BOUND_TOLERANCE * (1 + std::abs(mean));
+  const auto& means = this->centroidMeans;
+  long hi = std::lower_bound(means.begin(), means.end(), std::make_pair(mean, -1)) - means.begin();
+  long lo = hi - 1;
+  while (lo >= 0 || hi < means.size())
+  {
+    data_t gapLo = lo >= 0 ? mean - means[lo].first : INF;
+    data_t gapHi = hi < means.size() ? means[hi].first - mean : INF;
+    if (std::min(gapLo, gapHi) > bestSoFar + tolerance) {
+      break;
+    }
+    int i = gapLo <= gapHi ? means[lo--].second : means[hi++].second;
+    if (i >= numGroups || i == seedIndex) {
+      continue;
+    }
+    auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+    if (dist < bestSoFar || (dist == bestSoFar && (bestSoFarIndex < 0 || i < bestSoFarIndex)))
+    {
+      bestSoFar = dist;
+      bestSoFarIndex = i;
+    }
+  }
+  if (bestSoFarIndex < 0) {
+    bestSoFar = INF;
+  }
+}
+
+void LocalLengthGroupSpace::_nearestByHash(const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups,
+  data_t& bestSoFar, int& bestSoFarIndex) const
+{
+  // Only a centroid within the dropout matters, so the search starts bounded
+  int seedIndex = bestSoFarIndex >= 0 && bestSoFar <= dropout ? bestSoFarIndex : -1;
+  if (seedIndex < 0) {
+    bestSoFar = dropout;
+    bestSoFarIndex = -1;
+  }
+  auto offer = [&](int i) {
+    if (i >= numGroups || i == seedIndex) {
+      return;
+    }
+    auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+    if (dist < bestSoFar || (dist == bestSoFar && (bestSoFarIndex < 0 || i < bestSoFarIndex)))
+    {
+      bestSoFar = dist;
+      bestSoFarIndex = i;
+    }
+  };
+
+  vector<uint64_t> keys(this->lshTables);
+  this->_hashKeys(query, keys.data());
+  vector<int> candidates;
+  for (int t = 0; t < this->lshTables; t++)
+  {
+    auto bucket = this->hashTables[t].find(keys[t]);
+    if (bucket != this->hashTables[t].end()) {
+      candidates.insert(candidates.end(), bucket->second.begin(), bucket->second.end());
+    }
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+  for (int i : candidates) {
+    offer(i);
+  }
+
+  // Recent centroids come from the previous starts, which are often similar
+  for (int i = numGroups - 1; bestSoFarIndex < 0 && i >= std::max(0, numGroups - LSH_FALLBACK_CENTROIDS); i--)
+  {
+    if (!std::binary_search(candidates.begin(), candidates.end(), i)) {
+      offer(i);
+    }
+  }
+  if (bestSoFarIndex < 0) {
+    bestSoFar = INF;
+  }
+
+  if (this->lshVerify) {
+    this->_verifyAssignment(query, pairwiseDistance, dropout, numGroups, bestSoFarIndex);
+  }
+}
+
+void LocalLengthGroupSpace::_verifyAssignment(const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups, int bestSoFarIndex) const
+{
+  // The scan is not part of the work of grouping
+  long comparisons = gPairwiseComparisons;
+  long points = gPairwisePoints;
+  data_t best = dropout;
+  int bestIndex = -1;
+  for (auto i = 0; i < numGroups; i++)
+  {
+    auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, best);
+    if (dist < best || (dist == best && bestIndex < 0))
+    {
+      best = dist;
+      bestIndex = i;
+    }
+  }
+  gPairwiseComparisons = comparisons;
+  gPairwisePoints = points;
+
+  this->verifiedAssignments++;
+  if (bestIndex != bestSoFarIndex) {
+    this->differingAssignments++;
+  }
+}
+
+std::atomic<long> gLastTime(duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+
+static bool shouldLog()
+{
+  auto nowInSec = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
+  auto elapsedSeconds = nowInSec - gLastTime;
+  if (elapsedSeconds >= LOG_EVERY_S) {
+    gLastTime = nowInSec;
+    return true;
+  }
+  return false;
+}
+
+void LocalLengthGroupSpace::enableBatching()
+{
+  this->batched = true;
+}
+
+void LocalLengthGroupSpace::enableHashing(int tables, double width, bool verify)
+{
+  if (tables <= 0 || width <= 0) {
+    throw GenexException("Number of hash tables and bucket width must be positive");
+  }
+  this->lshTables = tables;
+  this->lshWidth = width;
+  this->lshVerify = verify;
+}
+
+void LocalLengthGroupSpace::_prepareHashing(const dist_t pairwiseDistance, data_t threshold)
+{
+  // Projections preserve euclidean distances only
+  this->hashing = this->lshTables > 0 && threshold > 0 &&
+                  pairwiseDistance == getDistanceFromName("euclidean");
+  if (!this->hashing) {
+    return;
+  }
+  this->bucketWidth = this->lshWidth * threshold;
+
+  // The euclidean distance is normalized by the square root of the length, so
+  // projections on directions of that norm differ by about the distance
+  std::mt19937 random(this->length);
+  std::normal_distribution<data_t> direction(0, 1 / sqrt(this->length));
+  std::uniform_real_distribution<data_t> shift(0, 1);
+  int hashes = this->lshTables * LSH_HASHES_PER_TABLE;
+  this->projections.resize((size_t)hashes * this->length);
+  this->offsets.resize(hashes);
+  for (auto& v : this->projections) {
+    v = direction(random);
+  }
+  for (auto& v : this->offsets) {
+    v = shift(random);
+  }
+
+  this->hashTables.assign(this->lshTables, std::unordered_map< uint64_t, vector<int> >());
+  for (auto i = 0; i < this->groups.size(); i++) {
+    this->_hashCentroid(i);
+  }
+}
+
+void LocalLengthGroupSpace::_hashKeys(const TimeSeries& ts, uint64_t* keys) const
+{
+  // Bucket numbers of the projections of a table are combined with FNV-1a
+  const data_t* values = ts.getData() + ts.getStart();
+  const data_t* row = this->projections.data();
+  for (int t = 0; t < this->lshTables; t++)
+  {
+    uint64_t key = 14695981039346656037ULL;
+    for (int h = 0; h < LSH_HASHES_PER_TABLE; h++, row += this->length)
+    {
+      data_t projection = 0;
+      for (int i = 0; i < this->length; i++) {
+        projection += row[i] * values[i];
+      }
+      int64_t bucket = (int64_t)std::floor(projection / this->bucketWidth
+                                           + this->offsets[t * LSH_HASHES_PER_TABLE + h]);
+      key = (key ^ (uint64_t)bucket) * 1099511628211ULL;
+    }
+    keys[t] = key;
+  }
+}
+
+void LocalLengthGroupSpace::_hashCentroid(int groupIndex)
+{
+  vector<uint64_t> keys(this->lshTables);
+  this->_hashKeys(this->groups[groupIndex].getCentroid(), keys.data());
+  for (int t = 0; t < this->lshTables; t++) {
+    this->hashTables[t][keys[t]].push_back(groupIndex);
+  }
+}
+
+void LocalLengthGroupSpace::_finishHashing()
+{
+  this->stats.verifiedAssignments += this->verifiedAssignments.exchange(0);
+  this->stats.differingAssignments += this->differingAssignments.exchange(0);
+  this->hashing = false;
+  vector< std::unordered_map< uint64_t, vector<int> > >().swap(this->hashTables);
+  vector<data_t>().swap(this->projections);
+  vector<data_t>().swap(this->offsets);
+}
+
+void LocalLengthGroupSpace::setStride(int stride)
+{
+  if (stride < 1) {
+    throw GenexException("Stride must be positive");
+  }
+  this->stride = stride;
+  for (auto& g : this->groups) {
+    g.setStride(stride);
+  }
+}
+
+int LocalLengthGroupSpace::getStride() const
+{
+  return this->stride;
+}
+
+bool LocalLengthGroupSpace::_isGrouped(int idx, int start, int length) const
+{
+  return start % this->stride == 0 && start + length <= dataset.getItemLength(idx);
+}
+
+long LocalLengthGroupSpace::_slot(int idx, int start, int length) const
+{
+  long l = length - this->length;
+  return (l * dataset.getItemCount() + idx) * this->subTimeSeriesCount + start;
+}
+
+long LocalLengthGroupSpace::_position(int idx, int start, int length) const
+{
+  long l = length - this->length;
+  return (l * this->subTimeSeriesCount + start) * dataset.getItemCount() + idx;
+}
+
+void LocalLengthGroupSpace::_decodePosition(long p, int& idx, int& start, int& length) const
+{
+  // Positions enumerate subsequences in the order of the sequential version:
+  // all series at start 0, then all series at start 1, ..., then the same for
+  // each longer length
+  int itemCount = dataset.getItemCount();
+  long rest = p / itemCount;
+  idx = p % itemCount;
+  start = rest % this->subTimeSeriesCount;
+  length = this->length + rest / this->subTimeSeriesCount;
+}
+
+TimeSeries LocalLengthGroupSpace::_subsequence(int idx, int start, int length) const
+{
+  TimeSeries ts = dataset.getTimeSeries(idx, start, start + length);
+  return length == this->length ? ts : ts.resample(this->length);
+}
+
+const TimeSeries& LocalLengthGroupSpace::_scaledQuery(const TimeSeries& query,
+  TimeSeries& scaled) const
+{
+  // Only spaces of several lengths hold resampled centroids
+  if (this->lengthCount > 1 && query.getLength() != this->length) {
+    scaled = query.resample(this->length);
+    return scaled;
+  }
+  return query;
+}
+
+void LocalLengthGroupSpace::enableSampling(double ratio, unsigned seed)
+{
+  if (ratio <= 0 || ratio > 1) {
+    throw GenexException("Sample ratio must be in (0, 1]");
+  }
+  this->sampleRatio = ratio;
+  this->sampleSeed = seed;
+}
+
+void LocalLengthGroupSpace::enableRefinement(int iterations)
+{
+  if (iterations <= 0) {
+    throw GenexException("Number of refinement passes must be positive");
+  }
+  this->refineIterations = iterations;
+}
+
+void LocalLengthGroupSpace::enableSuperGroups(double ratio)
+{
+  if (ratio <= 1) {
+    throw GenexException("Super-group ratio must be above 1");
+  }
+  this->superGroupRatio = ratio;
+}
+
+int LocalLengthGroupSpace::getNumberOfSuperGroups() const
+{
+  return this->superGroups.size();
+}
+
+const super_group_t& LocalLengthGroupSpace::getSuperGroup(int idx) const
+{
+  if (idx < 0 || idx >= this->getNumberOfSuperGroups()) {
+    throw GenexException("Super-group index is out of range");
+  }
+  return this->superGroups[idx];
+}
+
+void LocalLengthGroupSpace::enableLevels(const vector<data_t>& thresholds)
+{
+  for (auto i = 0; i < thresholds.size(); i++) {
+    if (thresholds[i] <= 0 || (i > 0 && thresholds[i] <= thresholds[i - 1])) {
+      throw GenexException("Level thresholds must be positive and increasing");
+    }
+  }
+  this->levelThresholds = thresholds;
+}
+
+int LocalLengthGroupSpace::getNumberOfLevels() const
+{
+  return this->levels.size() + 1;
+}
+
+int LocalLengthGroupSpace::getLevelSize(int level) const
 {
-  this->subTimeSeriesCount = dataset.getMaxLength() - length + 1;
-  this->memberMap = std::vector<group_membership_t>(dataset.getItemCount() * this->subTimeSeriesCount);
+  if (level < 1 || level >= this->getNumberOfLevels()) {
+    throw GenexException("Level is out of range");
+  }
+  return this->levels[level - 1].size();
 }
 
-LocalLengthGroupSpace::~LocalLengthGroupSpace()
+const super_group_t& LocalLengthGroupSpace::getLevelGroup(int level, int idx) const
 {
-  reset();
+  if (idx < 0 || idx >= this->getLevelSize(level)) {
+    throw GenexException("Cluster index is out of range");
+  }
+  return this->levels[level - 1][idx];
 }
 
-void LocalLengthGroupSpace::reset()
+void LocalLengthGroupSpace::enableOrdering(bool meanBound)
+{
+  this->ordered = true;
+  this->meanOrdered = meanBound;
+}
+
+int LocalLengthGroupSpace::getLengthCount() const
+{
+  return this->lengthCount;
+}
+
+const group_stats_t& LocalLengthGroupSpace::getGroupStats() const
+{
+  return this->stats;
+}
+
+void LocalLengthGroupSpace::enableIncremental(
+  const LocalLengthGroupSpace* previous, extend_t extend)
+{
+  this->incremental = true;
+  this->previous = previous;
+  this->extend = extend;
+  this->assignedDistance.assign(this->memberMap.size(), INF);
+  if (previous != nullptr) {
+    this->extendedGroup.assign(previous->groups.size(), -1);
+    this->lastJoined.assign(previous->groups.size(), -1);
+  }
+}
+
+void LocalLengthGroupSpace::finishIncremental()
+{
+  this->incremental = false;
+  this->previous = nullptr;
+  vector<group_membership_t>().swap(this->memberMap);
+  vector<data_t>().swap(this->assignedDistance);
+  vector<int>().swap(this->extendedGroup);
+  vector<int>().swap(this->lastJoined);
+}
+
+void LocalLengthGroupSpace::_seed(int idx, int start, int length, const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups,
+  data_t& bestSoFar, int& bestSoFarIndex) const
 {
-  for (auto i = 0; i < groups.size(); i++)
+  bestSoFar = INF;
+  bestSoFarIndex = -1;
+  if (this->previous != nullptr)
   {
-    delete groups[i];
-    groups[i] = nullptr;
+    this->_seedFromPrefix(idx, start, query, pairwiseDistance, dropout, numGroups,
+                          bestSoFar, bestSoFarIndex);
+    if (bestSoFarIndex >= 0 && bestSoFar <= dropout) {
+      return;
+    }
+  }
+
+  // Consecutive starts of a series usually fall into the same group. The
+  // previous start is not assigned yet if it is in the same parallel round.
+  if (this->ordered && start >= this->stride)
+  {
+    int h = this->memberMap[this->_slot(idx, start - this->stride, length)].groupIndex;
+    if (h >= 0 && h < numGroups && h != bestSoFarIndex)
+    {
+      auto dist = this->groups[h].distanceFromCentroid(query, pairwiseDistance, dropout);
+      if (dist <= dropout)
+      {
+        bestSoFar = dist;
+        bestSoFarIndex = h;
+      }
+    }
   }
-  groups.clear();
 }
 
-std::atomic<long> gLastTime(duration_cast<seconds>(system_clock::now().time_since_epoch()).count());
+void LocalLengthGroupSpace::_seedFromPrefix(int idx, int start, const TimeSeries& query,
+  const dist_t pairwiseDistance, data_t dropout, int numGroups,
+  data_t& bestSoFar, int& bestSoFarIndex) const
+{
+  // The prefix of a valid subsequence is valid at the previous length
+  long p = this->previous->_slot(idx, start, this->previous->length);
+  int g = this->previous->memberMap[p].groupIndex;
+  int h = this->extendedGroup[g];
+  if (h >= 0 && h < numGroups)
+  {
+    bestSoFarIndex = h;
+    if (this->extend != nullptr)
+    {
+      int last = this->length - 1;
+      bestSoFar = this->extend(this->previous->assignedDistance[p], last,
+                               query[last], this->groups[h].getCentroid()[last]);
+      // Right at the dropout, rounding may flip the decision to join the group
+      if (std::abs(bestSoFar - dropout) > dropout * EXTEND_TOLERANCE) {
+        return;
+      }
+    }
+  }
+  else
+  {
+    h = this->lastJoined[g];
+    if (h < 0 || h >= numGroups) {
+      return;
+    }
+    bestSoFarIndex = h;
+  }
+  bestSoFar = this->groups[h].distanceFromCentroid(query, pairwiseDistance, dropout);
+}
+
+void LocalLengthGroupSpace::_assign(int idx, int start, int length,
+  const dist_t pairwiseDistance, data_t threshold, data_t bestSoFar, int bestSoFarIndex)
+{
+  bool created = bestSoFar > threshold / 2 || this->groups.size() == 0;
+  if (created)
+  {
+    bestSoFarIndex = this->groups.size();
+    auto newGroupIndex = this->groups.size();
+    this->groups.emplace_back(newGroupIndex
+                              , this->length
+                              , this->subTimeSeriesCount
+                              , this->dataset
+                              , this->memberMap);
+    this->groups[bestSoFarIndex].setLengthCount(this->lengthCount);
+    this->groups[bestSoFarIndex].setCentroid(idx, start, length);
+    this->groups[bestSoFarIndex].setStride(this->stride);
+    this->_storeCentroid(bestSoFarIndex);
+    if (this->triangleBounds) {
+      this->_addNeighbours(bestSoFarIndex, pairwiseDistance, threshold);
+    }
+    if (this->hasCentroidIndex()) {
+      this->_indexCentroid(bestSoFarIndex);
+    }
+    if (this->hashing) {
+      this->_hashCentroid(bestSoFarIndex);
+    }
+    if (this->meanOrdered) {
+      auto entry = std::make_pair(meanOf(this->groups[bestSoFarIndex].getCentroid()), bestSoFarIndex);
+      this->centroidMeans.insert(
+        std::upper_bound(this->centroidMeans.begin(), this->centroidMeans.end(), entry), entry);
+    }
+  }
+
+  this->groups[bestSoFarIndex].addMember(idx, start, length);
+  this->groups[bestSoFarIndex].addToBounds(
+    this->dataset.getTimeSeries(idx, start, start + length), created ? 0 : bestSoFar);
+  this->stats.subsequences++;
+
+  if (this->incremental)
+  {
+    long p = this->_slot(idx, start, length);
+    this->assignedDistance[p] = created ? 0 : bestSoFar;
+    if (this->previous != nullptr)
+    {
+      long q = this->previous->_slot(idx, start, this->previous->length);
+      int g = this->previous->memberMap[q].groupIndex;
+      const TimeSeries& centroid = this->previous->groups[g].getCentroid();
+      if (created && centroid.getIndex() == idx && centroid.getStart() == start) {
+        this->extendedGroup[g] = bestSoFarIndex;
+      }
+      this->lastJoined[g] = bestSoFarIndex;
+    }
+  }
+}
 
 int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t threshold)
 {
-  auto nowInSec = duration_cast<seconds>(system_clock::now().time_since_epoch()).count();
-  auto elapsedSeconds = nowInSec - gLastTime;
-  auto doLog = false;
-  if (elapsedSeconds >= LOG_EVERY_S) {
-    doLog = true;
-    gLastTime = nowInSec;
+  if (this->sampleRatio > 0 || this->refineIterations > 0 ||
+      (this->batched && pairwiseDistance == getDistanceFromName("euclidean"))) {
+    return this->generateGroups(pairwiseDistance, threshold, nullptr, true);
   }
+  this->_allocateMemberMap();
+  this->_prepareHashing(pairwiseDistance, threshold);
+  group_stats_t since = pairwiseWork();
+  auto doLog = shouldLog();
   if (doLog) {
     cout << "Processing time series space of length " << this->length << endl;
   }
-  auto totalTimeSeries = this->subTimeSeriesCount * dataset.getItemCount();
+  auto totalTimeSeries = this->lengthCount * this->subTimeSeriesCount * dataset.getItemCount();
   int counter = 0;
-  for (int start = 0; start < this->subTimeSeriesCount; start++)
+  for (int length = this->length; length < this->length + this->lengthCount; length++)
   {
-    for (int idx = 0; idx < dataset.getItemCount(); idx++)
+    for (int start = 0; start < this->subTimeSeriesCount; start++)
     {
-      counter++;
-      if (doLog) {
-        if (counter % (totalTimeSeries / LOG_FREQ) == 0) {
-          cout << "  Grouping progress... " << counter << "/" << totalTimeSeries 
-               << " (" << counter*100/totalTimeSeries << "%)" << endl;
+      for (int idx = 0; idx < dataset.getItemCount(); idx++)
+      {
+        counter++;
+        if (doLog) {
+          if (counter % (totalTimeSeries / LOG_FREQ) == 0) {
+            cout << "  Grouping progress... " << counter << "/" << totalTimeSeries 
+                 << " (" << counter*100/totalTimeSeries << "%)" << endl;
+          }
         }
+        if (!this->_isGrouped(idx, start, length)) {
+          continue;
+        }
+        TimeSeries query = this->_subsequence(idx, start, length);
+
+        data_t bestSoFar;
+        int bestSoFarIndex;
+        this->_seed(idx, start, length, query, pairwiseDistance, threshold / 2, groups.size(),
+                    bestSoFar, bestSoFarIndex);
+        this->_nearestCentroid(
+          query, pairwiseDistance, threshold / 2, groups.size(), bestSoFar, bestSoFarIndex);
+
+        this->_assign(idx, start, length, pairwiseDistance, threshold, bestSoFar, bestSoFarIndex);
       }
-      if (start + this->length > dataset.getItemLength(idx)) {
-        continue;
-      }
-      TimeSeries query = dataset.getTimeSeries(idx, start, start + this->length);
+    }
+  }
+  addWorkSince(this->stats, since);
+
+  this->_finishHashing();
+  vector< std::pair<data_t, int> >().swap(this->centroidMeans);
+  this->compactMembers();
+  this->_buildSuperGroups(pairwiseDistance, threshold);
+  this->_buildLevels(pairwiseDistance);
+  return this->getNumberOfGroups();
+}
+
+void LocalLengthGroupSpace::_groupSample(const dist_t pairwiseDistance, data_t threshold)
+{
+  // The sample is grouped like all subsequences are, in the same order
+  std::mt19937 random(this->sampleSeed);
+  std::bernoulli_distribution pick(this->sampleRatio);
+  long total = (long)this->lengthCount * this->subTimeSeriesCount * dataset.getItemCount();
+  vector<long> positions;
+  for (long p = 0; p < total; p++)
+  {
+    int idx, start, length;
+    this->_decodePosition(p, idx, start, length);
+    if (this->_isGrouped(idx, start, length) && pick(random)) {
+      positions.push_back(p);
+    }
+  }
+  this->_groupFirst(positions, pairwiseDistance, threshold);
+  this->stats.sampledGroups += this->groups.size();
+}
+
+void LocalLengthGroupSpace::_groupFirst(const vector<long>& positions,
+  const dist_t pairwiseDistance, data_t threshold)
+{
+  long total = (long)this->lengthCount * this->subTimeSeriesCount * dataset.getItemCount();
+  this->sampled.assign(total, false);
+  for (long p : positions)
+  {
+    int idx, start, length;
+    this->_decodePosition(p, idx, start, length);
+    this->sampled[p] = true;
+    TimeSeries query = this->_subsequence(idx, start, length);
+
+    data_t bestSoFar;
+    int bestSoFarIndex;
+    this->_seed(idx, start, length, query, pairwiseDistance, threshold / 2, groups.size(),
+                bestSoFar, bestSoFarIndex);
+    this->_nearestCentroid(
+      query, pairwiseDistance, threshold / 2, groups.size(), bestSoFar, bestSoFarIndex);
+
+    this->_assign(idx, start, length, pairwiseDistance, threshold, bestSoFar, bestSoFarIndex);
+  }
+}
+
+void LocalLengthGroupSpace::_matchRange(const dist_t pairwiseDistance, data_t threshold,
+  long from, long to, int numGroups, bool batch, data_t* bestDist, int* bestIndex) const
+{
+  if (batch) {
+    this->_matchRangeBatched(pairwiseDistance, threshold, from, to, numGroups, bestDist, bestIndex);
+    return;
+  }
+
+  for (long p = from; p < to; p++)
+  {
+    int idx, start, length;
+    this->_decodePosition(p, idx, start, length);
+    data_t bestSoFar = INF;
+    int bestSoFarIndex = -1;
+    if (this->_isGrouped(idx, start, length) && !this->_isSampled(p)) {
+      TimeSeries query = this->_subsequence(idx, start, length);
+      this->_seed(idx, start, length, query, pairwiseDistance, threshold / 2, numGroups,
+                  bestSoFar, bestSoFarIndex);
+      this->_nearestCentroid(
+        query, pairwiseDistance, threshold / 2, numGroups, bestSoFar, bestSoFarIndex);
+    }
+    bestDist[p - from] = bestSoFar;
+    bestIndex[p - from] = bestSoFarIndex;
+  }
+}
 
-      data_t bestSoFar = INF;
-      int bestSoFarIndex;
+void LocalLengthGroupSpace::_matchRangeBatched(const dist_t pairwiseDistance, data_t threshold,
+  long from, long to, int numGroups, data_t* bestDist, int* bestIndex) const
+{
+  // Valid subsequences of the range are copied into aligned rows with their
+  // norms, like the centroids
+  CentroidMatrix batch(this->length);
+  vector<long> positions;
+  for (long p = from; p < to; p++)
+  {
+    int idx, start, length;
+    this->_decodePosition(p, idx, start, length);
+    bestDist[p - from] = INF;
+    bestIndex[p - from] = -1;
+    if (this->_isGrouped(idx, start, length) && !this->_isSampled(p)) {
+      batch.add(this->_subsequence(idx, start, length));
+      positions.push_back(p);
+    }
+  }
+  int n = batch.size();
+  if (n == 0 || numGroups == 0) {
+    return;
+  }
 
-      for (auto i = 0; i < groups.size(); i++)
+  // ||q - c||^2 = ||q||^2 + ||c||^2 - 2 q.c bounds the euclidean distance of
+  // every pair; only centroids that may be within the dropout are compared
+  data_t dropout = threshold / 2;
+  int stride = this->centroids.getStride();
+  vector<data_t> dots((size_t)n * BATCH_CENTROID_BLOCK);
+  for (int gb = 0; gb < numGroups; gb += BATCH_CENTROID_BLOCK)
+  {
+    int rows = std::min(BATCH_CENTROID_BLOCK, numGroups - gb);
+    dotProducts(batch.getRow(0), n, stride, this->centroids.getRow(gb), rows, stride,
+                this->length, dots.data(), BATCH_CENTROID_BLOCK);
+    for (int q = 0; q < n; q++)
+    {
+      long i = positions[q] - from;
+      data_t nq = batch.getNorm(q);
+      TimeSeries query(batch.getRow(q), this->length);
+      const data_t* dot = dots.data() + (size_t)q * BATCH_CENTROID_BLOCK;
+      for (int j = 0; j < rows; j++)
       {
-        auto dist = this->groups[i]->distanceFromCentroid(query, pairwiseDistance, bestSoFar);
-        if (dist < bestSoFar)
+        data_t bound = std::min(bestDist[i], dropout);
+        data_t nc = this->centroids.getNorm(gb + j);
+        data_t squared = nq + nc - 2 * dot[j];
+        if (squared > bound * bound * this->length + (nq + nc) * BATCH_TOLERANCE) {
+          continue;
+        }
+        auto dist = this->groups[gb + j].distanceFromCentroid(query, pairwiseDistance, bound);
+        if (dist < bestDist[i] && dist <= dropout)
         {
-          bestSoFar = dist;
-          bestSoFarIndex = i;
+          bestDist[i] = dist;
+          bestIndex[i] = gb + j;
         }
       }
+    }
+  }
+}
+
+int LocalLengthGroupSpace::generateGroups(const dist_t pairwiseDistance, data_t threshold,
+  WorkStealingPool* pool, bool deterministic)
+{
+  bool batch = this->batched && pairwiseDistance == getDistanceFromName("euclidean");
+  bool sample = this->sampleRatio > 0;
+  if (!batch && !sample && this->refineIterations == 0 && (pool == nullptr || pool->size() <= 1)) {
+    return this->generateGroups(pairwiseDistance, threshold);
+  }
+  if (this->refineIterations == 0) {
+    this->_groupAll(pairwiseDistance, threshold, pool, deterministic, nullptr);
+    this->_buildSuperGroups(pairwiseDistance, threshold);
+    this->_buildLevels(pairwiseDistance);
+    return this->getNumberOfGroups();
+  }
+
+  auto started = steady_clock::now();
+  this->_groupAll(pairwiseDistance, threshold, pool, deterministic, nullptr);
+  auto grouped = steady_clock::now();
+  this->stats.unrefinedGroups = this->groups.size();
+  this->stats.unrefinedRadius = this->_radiusSum();
+  for (int i = 0; i < this->refineIterations; i++) {
+    this->_refine(pairwiseDistance, threshold, pool, deterministic);
+  }
+  this->stats.refinedRadius = this->_radiusSum();
+  this->stats.groupingSeconds = duration<double>(grouped - started).count();
+  this->stats.refinementSeconds = duration<double>(steady_clock::now() - grouped).count();
+  this->_buildSuperGroups(pairwiseDistance, threshold);
+  this->_buildLevels(pairwiseDistance);
+  return this->getNumberOfGroups();
+}
+
+void LocalLengthGroupSpace::_groupAll(const dist_t pairwiseDistance, data_t threshold,
+  WorkStealingPool* pool, bool deterministic, const vector<long>* seeds)
+{
+  bool batch = this->batched && pairwiseDistance == getDistanceFromName("euclidean");
+  this->_allocateMemberMap();
+  this->_prepareHashing(pairwiseDistance, threshold);
+  if (seeds != nullptr) {
+    group_stats_t since = pairwiseWork();
+    this->_groupFirst(*seeds, pairwiseDistance, threshold);
+    addWorkSince(this->stats, since);
+  }
+  else if (this->sampleRatio > 0) {
+    group_stats_t since = pairwiseWork();
+    this->_groupSample(pairwiseDistance, threshold);
+    addWorkSince(this->stats, since);
+  }
+  // Batches are matched against the centroids existing at the start of a round,
+  // like chunks, so the merge always continues over the new centroids
+  deterministic = deterministic || batch;
+  int numThreads = pool == nullptr ? 1 : pool->size();
+
+  if (shouldLog()) {
+    cout << "Processing time series space of length " << this->length << endl;
+  }
+
+  long total = (long)this->lengthCount * this->subTimeSeriesCount * dataset.getItemCount();
+
+  // Rounds start small since nothing can be matched before the first centroids
+  // exist, then grow so that each round keeps every thread busy
+  long maxRoundSize = (long)GROUP_CHUNK_SIZE * numThreads * GROUP_CHUNKS_PER_THREAD;
+  long roundSize = this->groups.empty() ? GROUP_CHUNK_SIZE : maxRoundSize;
+  vector<data_t> bestDist;
+  vector<int> bestIndex;
+
+  for (long from = 0; from < total; from += roundSize, roundSize = std::min(roundSize * 2, maxRoundSize))
+  {
+    long to = std::min(total, from + roundSize);
+    int numGroups = this->groups.size();
+    bestDist.resize(to - from);
+    bestIndex.resize(to - from);
+
+    vector< std::future<void> > chunks;
+    vector<group_stats_t> chunkWork((to - from + GROUP_CHUNK_SIZE - 1) / GROUP_CHUNK_SIZE);
+    if (numGroups == 0) {
+      this->_matchRange(pairwiseDistance, threshold, from, to, 0, false, bestDist.data(), bestIndex.data());
+    }
+    for (long c = from; numGroups > 0 && c < to; c += GROUP_CHUNK_SIZE) {
+      long cto = std::min(to, c + GROUP_CHUNK_SIZE);
+      data_t* dist = bestDist.data() + (c - from);
+      int* index = bestIndex.data() + (c - from);
+      group_stats_t* work = &chunkWork[(c - from) / GROUP_CHUNK_SIZE];
+      auto task = [this, pairwiseDistance, threshold, c, cto, numGroups, batch, dist, index, work] {
+        group_stats_t since = pairwiseWork();
+        this->_matchRange(pairwiseDistance, threshold, c, cto, numGroups, batch, dist, index);
+        addWorkSince(*work, since);
+      };
+      if (numThreads > 1) {
+        chunks.push_back(pool->submit(task));
+      }
+      else {
+        task();
+      }
+    }
+    for (auto& f : chunks) {
+      pool->wait(f);
+    }
+    for (auto& w : chunkWork) {
+      this->stats.comparisons += w.comparisons;
+      this->stats.points += w.points;
+    }
+    group_stats_t since = pairwiseWork();
 
-      if (bestSoFar > threshold / 2 || this->groups.size() == 0)
+    // Merge in sequential order. Groups from numGroups onwards were created in
+    // this round and have not been seen by the chunks yet.
+    for (long p = from; p < to; p++)
+    {
+      int idx, start, length;
+      this->_decodePosition(p, idx, start, length);
+      if (!this->_isGrouped(idx, start, length) || this->_isSampled(p)) {
+        continue;
+      }
+      data_t bestSoFar = bestDist[p - from];
+      int bestSoFarIndex = bestIndex[p - from];
+      if ((deterministic || bestSoFar > threshold / 2) && numGroups < this->groups.size())
       {
-        bestSoFarIndex = this->groups.size();
-        auto newGroupIndex = this->groups.size();
-        this->groups.push_back(new Group(newGroupIndex
-                                         , this->length
-                                         , this->subTimeSeriesCount
-                                         , this->dataset
-                                         , this->memberMap));
-        this->groups[bestSoFarIndex]->setCentroid(idx, start);
+        TimeSeries query = this->_subsequence(idx, start, length);
+        for (auto i = numGroups; i < groups.size(); i++)
+        {
+          auto dist = this->groups[i].distanceFromCentroid(query, pairwiseDistance, bestSoFar);
+          if (dist < bestSoFar)
+          {
+            bestSoFar = dist;
+            bestSoFarIndex = i;
+          }
+        }
       }
+      this->_assign(idx, start, length, pairwiseDistance, threshold, bestSoFar, bestSoFarIndex);
+    }
+    addWorkSince(this->stats, since);
+  }
+
+  this->_finishHashing();
+  vector<bool>().swap(this->sampled);
+  vector< std::pair<data_t, int> >().swap(this->centroidMeans);
+  this->compactMembers();
+}
 
-      this->groups[bestSoFarIndex]->addMember(idx, start);
+void LocalLengthGroupSpace::_refine(const dist_t pairwiseDistance, data_t threshold,
+  WorkStealingPool* pool, bool deterministic)
+{
+  int numGroups = this->groups.size();
+  vector<long> medoids(numGroups);
+  int numThreads = pool == nullptr ? 1 : pool->size();
+  vector< std::future<void> > chunks;
+  vector<group_stats_t> chunkWork((numGroups + MEDOID_CHUNK_SIZE - 1) / MEDOID_CHUNK_SIZE);
+  for (int from = 0; from < numGroups; from += MEDOID_CHUNK_SIZE)
+  {
+    int to = std::min(numGroups, from + MEDOID_CHUNK_SIZE);
+    group_stats_t* work = &chunkWork[from / MEDOID_CHUNK_SIZE];
+    auto task = [this, pairwiseDistance, from, to, work, &medoids] {
+      group_stats_t since = pairwiseWork();
+      for (int i = from; i < to; i++) {
+        medoids[i] = this->_medoid(this->groups[i], pairwiseDistance);
+      }
+      addWorkSince(*work, since);
+    };
+    if (numThreads > 1) {
+      chunks.push_back(pool->submit(task));
+    }
+    else {
+      task();
     }
   }
+  for (auto& f : chunks) {
+    pool->wait(f);
+  }
 
-  return this->getNumberOfGroups();
+  // Work is counted over all passes, the rest only for the last one
+  group_stats_t kept = this->stats;
+  for (auto& w : chunkWork) {
+    kept.comparisons += w.comparisons;
+    kept.points += w.points;
+  }
+  this->reset();
+  this->stats = kept;
+  this->stats.subsequences = 0;
+  this->_groupAll(pairwiseDistance, threshold, pool, deterministic, &medoids);
+  this->stats.sampledGroups = kept.sampledGroups;
+}
+
+long LocalLengthGroupSpace::_medoid(const Group& group, const dist_t pairwiseDistance) const
+{
+  vector<TimeSeries> members;
+  vector<long> positions;
+  for (auto& m : group.getMembers()) {
+    members.push_back(this->_subsequence(m.getIndex(), m.getStart(), m.getLength()));
+    positions.push_back(this->_position(m.getIndex(), m.getStart(), m.getLength()));
+  }
+  int count = members.size();
+
+  // Large groups only try the members closest to the centroid
+  vector< std::pair<data_t, int> > candidates;
+  for (int i = 0; i < count; i++) {
+    data_t dist = count > MEDOID_CANDIDATES
+      ? group.distanceFromCentroid(members[i], pairwiseDistance, INF) : 0;
+    candidates.push_back(std::make_pair(dist, i));
+  }
+  if (count > MEDOID_CANDIDATES) {
+    std::partial_sort(candidates.begin(), candidates.begin() + MEDOID_CANDIDATES, candidates.end());
+    candidates.resize(MEDOID_CANDIDATES);
+  }
+
+  data_t bestSum = INF;
+  int best = 0;
+  for (auto& c : candidates)
+  {
+    int i = c.second;
+    data_t sum = 0;
+    for (int j = 0; j < count && sum < bestSum; j++) {
+      if (j != i) {
+        sum += pairwiseDistance(members[i], members[j], INF, gNoMatching);
+      }
+    }
+    // Equal sums go to the earliest subsequence
+    if (sum < bestSum || (sum == bestSum && positions[i] < positions[best]))
+    {
+      bestSum = sum;
+      best = i;
+    }
+  }
+  return positions[best];
+}
+
+data_t LocalLengthGroupSpace::_radiusSum() const
+{
+  data_t sum = 0;
+  for (auto& g : this->groups) {
+    sum += g.getRadius();
+  }
+  return sum;
+}
+
+vector<super_group_t> LocalLengthGroupSpace::_clusterCentroids(const vector<int>& below,
+  data_t reach, bool withEnvelope, const dist_t pairwiseDistance)
+{
+  // Each centroid joins the closest cluster whose centroid is within reach,
+  // or starts a new one
+  vector<super_group_t> clusters;
+  for (auto i = 0; i < below.size(); i++)
+  {
+    const TimeSeries& centroid = this->groups[below[i]].getCentroid();
+    data_t best = reach;
+    int bestIndex = -1;
+    for (auto s = 0; s < clusters.size(); s++) {
+      auto dist = this->groups[clusters[s].centroid].distanceFromCentroid(
+        centroid, pairwiseDistance, best);
+      if (dist < best) {
+        best = dist;
+        bestIndex = s;
+      }
+    }
+    if (bestIndex < 0) {
+      bestIndex = clusters.size();
+      best = 0;
+      clusters.emplace_back();
+      clusters.back().centroid = below[i];
+      clusters.back().radius = 0;
+    }
+    super_group_t& s = clusters[bestIndex];
+    s.groups.push_back(i);
+    s.radius = std::max(s.radius, best);
+    if (withEnvelope) {
+      s.envelope.add(centroid);
+    }
+  }
+  return clusters;
+}
+
+void LocalLengthGroupSpace::_countMembers(vector<super_group_t>& clusters,
+  const vector<super_group_t>* below) const
+{
+  for (auto& s : clusters) {
+    s.members = 0;
+    for (auto i : s.groups) {
+      s.members += below == nullptr ? this->groups[i].getCount() : (*below)[i].members;
+    }
+  }
+}
+
+void LocalLengthGroupSpace::_buildSuperGroups(const dist_t pairwiseDistance, data_t threshold)
+{
+  this->superGroups.clear();
+  if (this->superGroupRatio <= 1) {
+    return;
+  }
+
+  group_stats_t since = pairwiseWork();
+  vector<int> all(this->groups.size());
+  for (auto i = 0; i < all.size(); i++) {
+    all[i] = i;
+  }
+  this->superGroups = this->_clusterCentroids(
+    all, this->superGroupRatio * threshold / 2, true, pairwiseDistance);
+  this->_countMembers(this->superGroups, nullptr);
+  addWorkSince(this->stats, since);
+  this->stats.superGroups = this->superGroups.size();
+}
+
+vector< std::pair<data_t, int> >
+LocalLengthGroupSpace::_rankSuperGroups(const TimeSeries& query) const
+{
+  vector< std::pair<data_t, int> > ranked;
+  ranked.reserve(this->superGroups.size());
+  for (auto s = 0; s < this->superGroups.size(); s++) {
+    ranked.emplace_back(this->superGroups[s].envelope.lowerBound(query), s);
+  }
+  std::sort(ranked.begin(), ranked.end());
+  return ranked;
+}
+
+void LocalLengthGroupSpace::_buildLevels(const dist_t pairwiseDistance)
+{
+  this->levels.clear();
+  group_stats_t since = pairwiseWork();
+  for (auto l = 0; l < this->levelThresholds.size(); l++)
+  {
+    // Clusters of the level below, each represented by the centroid of a group
+    vector<int> below;
+    if (l == 0) {
+      for (auto i = 0; i < this->groups.size(); i++) {
+        below.push_back(i);
+      }
+    }
+    else {
+      for (auto& s : this->levels[l - 1]) {
+        below.push_back(s.centroid);
+      }
+    }
+    this->levels.push_back(
+      this->_clusterCentroids(below, this->levelThresholds[l] / 2, false, pairwiseDistance));
+    this->_countMembers(this->levels.back(), l == 0 ? nullptr : &this->levels[l - 1]);
+  }
+  addWorkSince(this->stats, since);
+}
+
+vector<int> LocalLengthGroupSpace::_descend(const TimeSeries& query,
+  const dist_t warpedDistance, int level, int k) const
+{
+  vector<int> candidates(this->levels[level - 1].size());
+  for (auto i = 0; i < candidates.size(); i++) {
+    candidates[i] = i;
+  }
+  for (auto l = level; l >= 1; l--)
+  {
+    // The closest clusters holding k subsequences, at least one
+    const vector<super_group_t>& clusters = this->levels[l - 1];
+    vector< std::pair<data_t, int> > ranked;
+    for (auto c : candidates) {
+      const TimeSeries& centroid = this->groups[clusters[c].centroid].getCentroid();
+      ranked.emplace_back(
+        warpedDistance == cascadeDistance ? keoghLowerBound(centroid, query, INF) : 0, c);
+    }
+    // Visiting the centroids by increasing lower bound tightens the dropout early
+    std::sort(ranked.begin(), ranked.end());
+
+    vector<group_index_t> closest;
+    int missing = std::max(k, 1);
+    for (auto& r : ranked) {
+      auto dropout = missing <= 0 ? closest.front().dist : INF;
+      if (r.first > dropout) {
+        break;
+      }
+      auto dist = this->groups[clusters[r.second].centroid].distanceFromCentroid(
+        query, warpedDistance, dropout);
+      keepClosest(group_index_t(this->length, r.second, clusters[r.second].members, dist),
+                  closest, missing);
+    }
+
+    vector<int> next;
+    for (auto& c : closest) {
+      const vector<int>& children = clusters[c.index].groups;
+      next.insert(next.end(), children.begin(), children.end());
+    }
+    candidates.swap(next);
+  }
+  std::sort(candidates.begin(), candidates.end());
+  return candidates;
+}
+
+void LocalLengthGroupSpace::compactMembers()
+{
+  // Members of group i are encoded from offsets[i], newest first like the
+  // member list threaded through memberMap, after their distances to the
+  // centroid are measured unless loaded. Groups may still read the old bytes
+  // while encoding, so they are replaced at the end.
+  vector<size_t> offsets;
+  offsets.reserve(this->groups.size());
+  vector<uint8_t> bytes;
+  for (auto& g : this->groups) {
+    if (!g.hasMemberDistances()) {
+      g.measureMembers();
+    }
+    offsets.push_back(bytes.size());
+    g.encodeMembers(bytes);
+  }
+  bytes.shrink_to_fit();
+  this->memberBytes.swap(bytes);
+  for (auto i = 0; i < this->groups.size(); i++) {
+    this->groups[i].setEncodedMembers(this->memberBytes.data() + offsets[i]);
+  }
+
+  // The next length still looks up the group of each prefix while seeding
+  if (!this->incremental) {
+    vector<group_membership_t>().swap(this->memberMap);
+  }
+}
+
+void LocalLengthGroupSpace::_allocateMemberMap()
+{
+  size_t size = (size_t)this->lengthCount * this->dataset.getItemCount() * this->subTimeSeriesCount;
+  // Members are linked through the map by 32-bit slots (see group_membership_t)
+  if (size > (size_t)INT32_MAX) {
+    throw GenexException("Too many subsequences to group in one space");
+  }
+  if (this->memberMap.size() != size) {
+    this->memberMap = vector<group_membership_t>(size, group_membership_t(-1, -1));
+  }
 }
 
 int LocalLengthGroupSpace::getNumberOfGroups(void) const
@@ -119,17 +1633,20 @@ const Group* LocalLengthGroupSpace::getGroup(int idx) const
   if (idx < 0 || idx >= this->getNumberOfGroups()) {
     throw GenexException("Group index is out of range");
   }
-  return this->groups[idx];
+  return &this->groups[idx];
 }
 
 void LocalLengthGroupSpace::saveGroupsOld(ofstream &fout, bool groupSizeOnly) const 
 {
+  if (this->lengthCount > 1 && !groupSizeOnly) {
+    throw GenexException("Groups of several lengths cannot be saved in the old format");
+  }
   // Number of groups having time series of this length
   fout << groups.size() << endl;
   if (groupSizeOnly) {
     for (auto i = 0; i < groups.size(); i++) 
     {
-      fout << groups[i]->getCount() << " ";
+      fout << groups[i].getCount() << " ";
     }
     fout << endl;
   }
@@ -137,7 +1654,7 @@ void LocalLengthGroupSpace::saveGroupsOld(ofstream &fout, bool groupSizeOnly) co
   {
     for (auto i = 0; i < groups.size(); i++) 
     {
-      groups[i]->saveGroupOld(fout);
+      groups[i].saveGroupOld(fout);
     }
   }
 }
@@ -145,78 +1662,133 @@ void LocalLengthGroupSpace::saveGroupsOld(ofstream &fout, bool groupSizeOnly) co
 int LocalLengthGroupSpace::loadGroupsOld(ifstream &fin)
 {
   reset();
+  this->_allocateMemberMap();
   int numberOfGroups;
   fin >> numberOfGroups;
   for (auto i = 0; i < numberOfGroups; i++)
   {
-    auto grp = new Group(i
-                         , this->length
-                         , this->subTimeSeriesCount
-                         , this->dataset
-                         , this->memberMap);
-    grp->loadGroupOld(fin);
-    this->groups.push_back(grp);
+    this->groups.emplace_back(i
+                              , this->length
+                              , this->subTimeSeriesCount
+                              , this->dataset
+                              , this->memberMap);
+    this->groups.back().loadGroupOld(fin);
+    this->_storeCentroid(i);
   }
+  this->compactMembers();
   return numberOfGroups;
 }
 
-candidate_group_t LocalLengthGroupSpace::getBestGroup(const TimeSeries& query,
+candidate_group_t LocalLengthGroupSpace::getBestGroup(const TimeSeries& original,
   const dist_t warpedDistance,
-  data_t dropout) const
+  data_t dropout,
+  int level) const
 {
+  TimeSeries scaled(0);
+  const TimeSeries& query = this->_scaledQuery(original, scaled);
+  // The envelopes are shared by every query, so cascade queries take turns
+  std::unique_lock<std::mutex> envelopes(this->envelopeMutex, std::defer_lock);
+  if (warpedDistance == cascadeDistance) {
+    envelopes.lock();
+    this->_prepareEnvelopes(query);
+  }
+  // Spaces built with fewer levels are searched from their top level
+  level = std::min(level, this->getNumberOfLevels() - 1);
+  if (level > 0) {
+    data_t best = dropout;
+    const Group* bestGroup = nullptr;
+    for (auto i : this->_descend(query, warpedDistance, level, 1)) {
+      auto dist = this->groups[i].distanceFromCentroid(query, warpedDistance, best);
+      if (dist < best) {
+        best = dist;
+        bestGroup = &this->groups[i];
+      }
+    }
+    return std::make_pair(bestGroup, best);
+  }
+  if (!this->superGroups.empty() && warpedDistance == cascadeDistance) {
+    data_t best = dropout;
+    int bestIndex = -1;
+    for (auto& ranked : this->_rankSuperGroups(query))
+    {
+      // Every centroid of this and later super-groups is farther than the best
+      if (ranked.first > best) {
+        break;
+      }
+      for (auto i : this->superGroups[ranked.second].groups) {
+        auto dist = this->groups[i].distanceFromCentroid(query, warpedDistance, best);
+        if (dist < best || (dist == best && bestIndex >= 0 && i < bestIndex)) {
+          best = dist;
+          bestIndex = i;
+        }
+      }
+    }
+    const Group* bestGroup = bestIndex < 0 ? nullptr : &this->groups[bestIndex];
+    return std::make_pair(bestGroup, best);
+  }
+  if (this->hasCentroidIndex() && this->keoghIndex && warpedDistance == cascadeDistance) {
+    best_group_visitor_t visitor(query, this->groups, this->length, warpedDistance, dropout);
+    this->centroidIndex->search(visitor);
+    const Group* bestGroup = visitor.bestIndex < 0 ? nullptr : &this->groups[visitor.bestIndex];
+    return std::make_pair(bestGroup, visitor.best);
+  }
+
   auto bestSoFarDist = dropout;
   const Group* bestSoFarGroup = nullptr;
   for (auto i = 0; i < groups.size(); i++) {
-    auto dist = groups[i]->distanceFromCentroid(query, warpedDistance, bestSoFarDist);
+    auto dist = groups[i].distanceFromCentroid(query, warpedDistance, bestSoFarDist);
     if (dist < bestSoFarDist) {
       bestSoFarDist = dist;
-      bestSoFarGroup = groups[i];
+      bestSoFarGroup = &groups[i];
     }
   }
 
   return std::make_pair(bestSoFarGroup, bestSoFarDist);
 }
 
-int LocalLengthGroupSpace::interLevelKSim(const TimeSeries& query, 
+int LocalLengthGroupSpace::interLevelKSim(const TimeSeries& original, 
     const dist_t warpedDistance,
     std::vector<group_index_t> &bestSoFar,
-    int k)
+    int k,
+    int level)
 {
-  for (auto i = 0; i < groups.size(); i++) {
-      if (k <= 0) // if heap is full, keep only sum-k groups
-      {
-        auto bestSoFarDist = bestSoFar.front().dist;
-        auto dist = groups[i]->distanceFromCentroid(query, warpedDistance, bestSoFarDist);
-        if (dist < bestSoFarDist) {
-          auto membersAdded = groups[i]->getCount();
-          bestSoFar.push_back(group_index_t(this->length, i, membersAdded, dist));
-          std::push_heap(bestSoFar.begin(), bestSoFar.end());
-          k -= membersAdded;
-          // If the worst (furthest) group can be removed, with keeping at least k elements
-          // tracked, remove it.
-          while(k + bestSoFar.front().members <= 0) { 
-            k += bestSoFar.front().members;
-            std::pop_heap(bestSoFar.begin(), bestSoFar.end());
-            bestSoFar.pop_back();
-          }
-        }
+  TimeSeries scaled(0);
+  const TimeSeries& query = this->_scaledQuery(original, scaled);
+  // The envelopes are shared by every query, so cascade queries take turns
+  std::unique_lock<std::mutex> envelopes(this->envelopeMutex, std::defer_lock);
+  if (warpedDistance == cascadeDistance) {
+    envelopes.lock();
+    this->_prepareEnvelopes(query);
+  }
+  // Spaces built with fewer levels are searched from their top level
+  level = std::min(level, this->getNumberOfLevels() - 1);
+  if (level > 0) {
+    for (auto i : this->_descend(query, warpedDistance, level, k)) {
+      offerGroup(this->length, i, this->groups[i], query, warpedDistance, bestSoFar, k);
+    }
+    return k;
+  }
+  if (!this->superGroups.empty() && warpedDistance == cascadeDistance) {
+    for (auto& ranked : this->_rankSuperGroups(query))
+    {
+      if (k <= 0 && ranked.first > bestSoFar.front().dist) {
+        break;
       }
-      else // heap is not full, directly add to heap.
-      {
-        auto membersAdded = groups[i]->getCount();
-        auto dist = groups[i]->distanceFromCentroid(query, warpedDistance, INF);
-        bestSoFar.push_back(group_index_t(this->length, i, membersAdded, dist));
-        k -= membersAdded;
-        if (k <= 0) {
-          // heapify the heap exactly once when it becomes full.
-          std::make_heap(bestSoFar.begin(), bestSoFar.end());
-          while(k + bestSoFar.front().members <= 0) { 
-            k += bestSoFar.front().members;
-            std::pop_heap(bestSoFar.begin(), bestSoFar.end());
-            bestSoFar.pop_back();
-          }
-        }
+      for (auto i : this->superGroups[ranked.second].groups) {
+        offerGroup(this->length, i, this->groups[i], query, warpedDistance, bestSoFar, k);
       }
+    }
+    return k;
+  }
+  if (this->hasCentroidIndex() && this->keoghIndex && warpedDistance == cascadeDistance) {
+    k_best_groups_visitor_t visitor(
+      query, this->groups, this->length, warpedDistance, bestSoFar, k);
+    this->centroidIndex->search(visitor);
+    return k;
+  }
+
+  for (auto i = 0; i < groups.size(); i++) {
+    offerGroup(this->length, i, this->groups[i], query, warpedDistance, bestSoFar, k);
   }
   return k;
 }
@@ -1,22 +1,172 @@
 #ifndef LOCAL_LENGTH_GROUP_SPACE_H
 #define LOCAL_LENGTH_GROUP_SPACE_H
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 #include <functional>
+#include <mutex>
 #include <queue>
+#include <unordered_map>
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/split_member.hpp>
+#include <boost/serialization/version.hpp>
 
 #include "TimeSeries.hpp"
 #include "distance/Distance.hpp"
+#include "group/CentroidMatrix.hpp"
+#include "group/Envelope.hpp"
 #include "group/Group.hpp"
+#include "group/VPTree.hpp"
 
 using std::vector;
 
 namespace genex {
 
+class WorkStealingPool;
+
 typedef std::pair<const Group*, data_t> candidate_group_t;
 
+/**
+ *  @brief options controlling how a dataset is grouped
+ */
+struct group_options_t
+{
+  // number of threads used to group; lengths and chunks of subsequences
+  // within a length are balanced across them
+  int numThreads = 1;
+
+  // group the largest length only
+  bool wholeSeriesOnly = false;
+
+  // when grouping with multiple threads, produce exactly the groups of
+  // single-threaded grouping
+  bool deterministic = false;
+
+  // index centroids in a VP-tree when the distance is a metric
+  bool centroidIndex = true;
+
+  // skip centroid comparisons using the triangle inequality when the distance
+  // is a metric
+  bool triangleBounds = true;
+
+  // group lengths in increasing order, seeding each subsequence with the group
+  // its prefix joined at the previous length
+  bool incremental = false;
+
+  // match subsequences to centroids in batches when the distance is euclidean
+  bool batched = false;
+
+  // try the group of the previous start of a series first, then visit the
+  // other centroids by increasing lower bound when the distance allows it
+  bool ordered = false;
+
+  // if positive, compare each subsequence only with the centroids sharing a
+  // bucket with it in one of this many random-projection hash tables, when the
+  // distance is euclidean; buckets are lshWidth * threshold wide. Faster with
+  // many centroids, but some subsequences join another group than the closest
+  // one. With lshVerify, every assignment is also checked against a full scan
+  int lshTables = 0;
+  double lshWidth = 2;
+  bool lshVerify = false;
+
+  // if above 1, group the lengths from lo to lo * bucketRatio together,
+  // resampled to lo, so that fewer spaces are built and visited by queries
+  double bucketRatio = 1;
+
+  // group only the starts at multiples of this; queries also compare the
+  // starts around the members of the best groups
+  int stride = 1;
+
+  // if positive, choose the centroids from this fraction of the subsequences,
+  // drawn with the given seed, then match all others in parallel; fewer
+  // comparisons but groups differ from full grouping
+  double sampleRatio = 0;
+  unsigned sampleSeed = 0;
+
+  // if positive, after grouping a length, move each centroid to the medoid of
+  // its group and group all subsequences again from the medoids, this many
+  // times; tighter groups for a longer grouping
+  int refineIterations = 0;
+
+  // if above 1, cluster the centroids of each length into super-groups whose
+  // centroids are within superGroupRatio * threshold / 2 of their members;
+  // queries ranked by cascadeDistance then visit the super-groups by
+  // increasing lower bound and skip those that cannot hold a better group
+  double superGroupRatio = 1;
+
+  // increasing thresholds above the grouping threshold at which nested levels
+  // of coarser groups are built over the groups of each length; a group of a
+  // level is a union of groups of the level below. Queries then choose a
+  // level (see GlobalGroupSpace::setQueryLevel): coarser levels compare fewer
+  // centroids but may miss the best matches
+  vector<data_t> levelThresholds;
+
+  // group no length up front; the space of a length is built the first time
+  // a query visits it, on a pool of numThreads threads that also pre-builds
+  // the spaces visited by queries up to lazyPrefetch lengths shorter or longer
+  bool lazy = false;
+  int lazyPrefetch = 1;
+};
+
+/**
+ *  @brief work done while grouping one or more lengths
+ */
+struct group_stats_t
+{
+  // subsequences assigned to a group
+  long subsequences = 0;
+
+  // pairwise distances computed and points compared by them
+  // (see gPairwisePoints)
+  long comparisons = 0;
+  long points = 0;
+
+  // groups created by the sample when sampling; the others were created for
+  // subsequences not within threshold / 2 of any of them
+  long sampledGroups = 0;
+
+  // assignments checked against a scan of all centroids when hashing with
+  // verification, and those for which the scan finds another centroid within
+  // threshold / 2, or finds one where hashing found none
+  long verifiedAssignments = 0;
+  long differingAssignments = 0;
+
+  // when refining, the groups and the sum of their radii before the first
+  // pass, the sum of radii after the last one, and the seconds spent grouping
+  // before and in the passes, summed over lengths
+  long unrefinedGroups = 0;
+  double unrefinedRadius = 0;
+  double refinedRadius = 0;
+  double groupingSeconds = 0;
+  double refinementSeconds = 0;
+
+  // super-groups built over the centroids
+  long superGroups = 0;
+};
+
+/**
+ *  @brief a cluster of groups of one length whose centroids are close
+ *
+ *  Also makes up the levels of enableLevels, where it clusters the clusters
+ *  of the level below.
+ */
+struct super_group_t
+{
+  // group whose centroid is the centroid of the super-group
+  int centroid;
+  // largest pairwise distance between that centroid and the centroid of a
+  // group (or of a cluster of the level below); INF if unknown
+  data_t radius;
+  // indices of the groups, or of the clusters of the level below
+  vector<int> groups;
+  // number of subsequences in all of those groups
+  long members = 0;
+  // smallest and largest value of the centroids of the groups; empty in the
+  // levels of enableLevels
+  Envelope envelope;
+};
+
 class LocalLengthGroupSpace
 {
 public:
@@ -26,10 +176,18 @@ public:
    *  this class contains all the groups of a given length
    *  for a TimeSeriesSet
    *
+   *  With a length count above 1, the space also groups the subsequences up to
+   *  lengthCount - 1 points longer, each uniformly resampled to the length
+   *  (see TimeSeries::resample). Shorter lengths are grouped first, and queries
+   *  within that range of lengths are resampled the same way to find groups.
+   *
    *  @param dataset the dataset that the class creates groups for
    *  @param length the length of each time series in each group
+   *  @param lengthCount number of lengths grouped, from length on
+   *  @throw GenexException if the length count is not positive, or if the
+   *         space holds more than INT32_MAX subsequences
    */
-  LocalLengthGroupSpace(const TimeSeriesSet& dataset, int length);
+  LocalLengthGroupSpace(const TimeSeriesSet& dataset, int length, int lengthCount = 1);
 
   /**
    * @brief deconstructor for LocalLengthGroupSpace
@@ -44,6 +202,257 @@ public:
    */
   int getNumberOfGroups(void) const;
 
+  /**
+   *  @brief indexes the centroids of this length in a VP-tree
+   *
+   *  The index is kept up to date by generateGroups, which then finds the closest
+   *  centroid of each subsequence without scanning all of them. Queries ranked by
+   *  cascadeDistance over a euclidean index skip centroids using the Keogh lower
+   *  bound of the query envelope. Existing groups are indexed right away.
+   *
+   *  @param pairwiseDistance a metric pairwise distance used to build the index
+   */
+  void enableCentroidIndex(const dist_t pairwiseDistance);
+
+  /**
+   *  @return true if centroids are indexed
+   */
+  bool hasCentroidIndex() const;
+
+  /**
+   *  @brief prunes centroid comparisons with the triangle inequality
+   *
+   *  Each centroid keeps the list of centroids within threshold of it, sorted by
+   *  distance and updated whenever a centroid is created. Once a subsequence is
+   *  found within d of a centroid A, its closest centroid B satisfies
+   *  dist(A, B) <= 2d, so generateGroups only checks the neighbours of A instead
+   *  of the remaining centroids. Requires a metric pairwise distance; the
+   *  resulting groups do not change.
+   */
+  void enableTriangleBounds();
+
+  /**
+   *  @brief matches subsequences to centroids in batches when grouping with
+   *         the euclidean distance
+   *
+   *  Subsequences are processed in rounds like parallel grouping. The dot
+   *  products of a chunk of subsequences with all centroids are computed as a
+   *  blocked matrix product (see dotProducts) and, with the norms kept by the
+   *  centroid matrix, give the distance of every pair up to rounding. Only the
+   *  centroids that may be within threshold / 2 are then compared exactly, so
+   *  the resulting groups do not change. Other distances are not affected.
+   */
+  void enableBatching();
+
+  /**
+   *  @brief matches subsequences to the centroids found by random-projection
+   *         LSH when grouping with the euclidean distance
+   *
+   *  Each table keys a centroid by LSH_HASHES_PER_TABLE random projections,
+   *  each cut into buckets of width * threshold. A subsequence is compared with
+   *  the centroids sharing its key in any table, then, if none of them is
+   *  within threshold / 2, with the most recently created centroids. The
+   *  closest centroid may be missed, so a subsequence can join another group
+   *  or start a new one. Takes precedence over the centroid index and the
+   *  ordered search; other distances are not affected.
+   *
+   *  @param tables number of hash tables
+   *  @param width width of the buckets relative to the grouping threshold
+   *  @param verify if true, also scan all centroids for each subsequence and
+   *         count the assignments that differ (see group_stats_t)
+   *  @throw GenexException if tables or width is not positive
+   */
+  void enableHashing(int tables, double width, bool verify);
+
+  /**
+   *  @brief groups only the starts at multiples of a stride
+   *
+   *  Subsequences at adjacent starts of a smooth series are nearly identical,
+   *  so skipping them shrinks the groups and the time to build them by about
+   *  the stride. The best match and the k best matches within a group then also
+   *  compare the starts within stride - 1 of each member (see Group::setStride).
+   *
+   *  @param stride the spacing of grouped starts
+   *  @throw GenexException if the stride is not positive
+   */
+  void setStride(int stride);
+
+  /**
+   *  @return the spacing of grouped starts
+   */
+  int getStride() const;
+
+  /**
+   *  @brief chooses the centroids from a random sample of the subsequences
+   *
+   *  generateGroups first groups a sample of the subsequences, each drawn with
+   *  the given probability, in the usual order. All other subsequences are then
+   *  matched in parallel against the centroids of the sample, in rounds like
+   *  parallel grouping, and one within threshold / 2 of none of them starts a
+   *  new group which later subsequences may join. Far fewer comparisons depend
+   *  on earlier ones, but the groups differ from those of full grouping.
+   *
+   *  @param ratio the fraction of subsequences in the sample, in (0, 1]
+   *  @param seed the seed drawing the sample
+   *  @throw GenexException if the ratio is out of range
+   */
+  void enableSampling(double ratio, unsigned seed);
+
+  /**
+   *  @brief refines the groups once generateGroups has built them
+   *
+   *  Each pass moves the centroid of every group to its medoid, the member
+   *  with the smallest sum of pairwise distances to the other members, then
+   *  groups all subsequences again with the medoids grouped first, in group
+   *  order. Medoids sit in the middle of their groups, so members join tighter
+   *  groups and members on the border of two groups can move; close medoids
+   *  merge. In groups above MEDOID_CANDIDATES members, only that many members
+   *  closest to the centroid are tried as medoid. Medoids are found in
+   *  parallel with the pool given to generateGroups.
+   *
+   *  @param iterations number of passes
+   *  @throw GenexException if the number of passes is not positive
+   */
+  void enableRefinement(int iterations);
+
+  /**
+   *  @brief clusters the centroids into super-groups once generateGroups has
+   *         built the groups
+   *
+   *  Centroids are visited in group order, and each joins the closest
+   *  super-group whose centroid is within ratio * threshold / 2 of it, or
+   *  starts a new one. Each super-group keeps the envelope of the centroids
+   *  of its groups. getBestGroup and interLevelKSim with cascadeDistance then
+   *  rank the super-groups by the Keogh lower bound of the query against their
+   *  envelopes (see Envelope::lowerBound), and stop once that bound exceeds
+   *  the best distance found. Takes precedence over the centroid index for
+   *  queries; the results do not change.
+   *
+   *  @param ratio radius of the super-groups relative to threshold / 2
+   *  @throw GenexException if the ratio is not above 1
+   */
+  void enableSuperGroups(double ratio);
+
+  /**
+   *  @return the number of super-groups; 0 if they are not built
+   */
+  int getNumberOfSuperGroups() const;
+
+  /**
+   *  @return a super-group with given index
+   *  @throw GenexException if the index is out of range
+   */
+  const super_group_t& getSuperGroup(int idx) const;
+
+  /**
+   *  @brief builds nested levels of coarser groups once generateGroups has
+   *         built the groups
+   *
+   *  Level 0 is made of the groups. Level l clusters the clusters of level
+   *  l - 1 like enableSuperGroups, each one joining the closest cluster whose
+   *  centroid is within thresholds[l - 1] / 2 of its centroid, so a cluster
+   *  of any level is a union of groups. A query at level l compares the
+   *  centroids of all clusters of level l, then at each level below only the
+   *  centroids of the closest clusters of the level above holding enough
+   *  subsequences (see getBestGroup and interLevelKSim).
+   *
+   *  @param thresholds the thresholds of levels 1 and up
+   *  @throw GenexException if the thresholds are not positive and increasing
+   */
+  void enableLevels(const vector<data_t>& thresholds);
+
+  /**
+   *  @return the number of levels, including the groups; 1 if enableLevels
+   *          was not called
+   */
+  int getNumberOfLevels() const;
+
+  /**
+   *  @return the number of clusters of a level above 0
+   *  @throw GenexException if the level is out of range
+   */
+  int getLevelSize(int level) const;
+
+  /**
+   *  @return a cluster of a level above 0, whose groups are clusters of the
+   *          level below
+   *  @throw GenexException if the level or the index is out of range
+   */
+  const super_group_t& getLevelGroup(int level, int idx) const;
+
+  /**
+   *  @brief orders the centroids compared with each subsequence so that the
+   *         dropout of the pairwise distance tightens early
+   *
+   *  Consecutive starts of a series usually fall into the same group, so the
+   *  group of the previous start is compared first (after the seed of
+   *  enableIncremental, if any). With a distance bounded by the difference of
+   *  means (see isMeanBoundedDistance), the other centroids are then visited by
+   *  increasing difference between their mean and the mean of the subsequence,
+   *  and the search stops once that difference exceeds the best distance. The
+   *  centroid index takes precedence over the ordered search. The resulting
+   *  groups do not change.
+   *
+   *  @param meanBound true if the pairwise distance is bounded by the difference of means
+   */
+  void enableOrdering(bool meanBound);
+
+  /**
+   *  @return number of lengths grouped, from the length of this space on
+   */
+  int getLengthCount() const;
+
+  /**
+   *  @return the work done by generateGroups so far
+   */
+  const group_stats_t& getGroupStats() const;
+
+  /**
+   *  @brief seeds generateGroups with the groups of the previous length
+   *
+   *  A subsequence of length L is first compared with the group of length L whose
+   *  centroid extends the centroid of the group its prefix joined at length L - 1,
+   *  or else with the last group joined by a subsequence sharing that prefix group.
+   *  With an extension function, the distance to an extended centroid is updated
+   *  from the distance of the prefix by one term. A seed within threshold / 2
+   *  bounds the search for the closest centroid, which usually ends after one or
+   *  two distance computations; the resulting groups do not change (up to rounding).
+   *
+   *  The distance of each subsequence to its centroid is kept until
+   *  finishIncremental is called, for the next length to seed from.
+   *
+   *  @param previous the grouped space of length - 1; nullptr for the shortest length
+   *  @param extend extends the pairwise distance by one point; may be nullptr
+   */
+  void enableIncremental(const LocalLengthGroupSpace* previous, extend_t extend);
+
+  /**
+   *  @brief releases the memory used by incremental grouping, including the
+   *         member map kept for the next length
+   */
+  void finishIncremental();
+
+  /**
+   *  @brief copies the centroids of all groups from the dataset again
+   *
+   *  Centroids are kept in a matrix of copied values (see CentroidMatrix), which
+   *  goes stale when the values of the dataset change.
+   */
+  void refreshCentroids();
+
+  /**
+   *  @brief lays out the members of all groups in one contiguous array
+   *
+   *  The distances of the members to the centroid are first measured (see
+   *  Group::measureMembers), then the members are delta/varint encoded (see
+   *  Group::encodeMembers), group after group, and each group then scans its
+   *  members sequentially instead of following the member list threaded
+   *  through memberMap. The member map is released, unless incremental
+   *  grouping still needs it until finishIncremental. Called once grouping or loading finishes; grouping
+   *  again allocates the member map back.
+   */
+  void compactMembers();
+
    /**
    *  @return a group with given index
    */
@@ -61,27 +470,183 @@ public:
    */
   int generateGroups(const dist_t pairwiseDistance, data_t threshold);
 
+  /**
+   *  @brief generates all the groups for the timeseries of this length using a pool
+   *
+   *  Subsequences are processed in rounds. Within a round, chunks of subsequences
+   *  are matched in parallel against the centroids existing at the start of the
+   *  round. The round is then merged in sequential order: a subsequence which
+   *  matched nothing is checked against the centroids created earlier in the same
+   *  round before starting a new group. In deterministic mode every subsequence
+   *  continues its scan over those new centroids, which gives exactly the groups
+   *  of the sequential version.
+   *
+   *  @param pairwiseDistance the distance to use when computing the groups
+   *  @param threshold the threshold to use when splitting into new groups
+   *  @param pool the pool running the chunks; nullptr to run sequentially
+   *  @param deterministic if true, produce the same groups as the sequential version
+   *  @return number of generated groups
+   */
+  int generateGroups(const dist_t pairwiseDistance, data_t threshold,
+                     WorkStealingPool* pool, bool deterministic);
+
   /**
    *  @brief gets the group closest to a query (measured from the centroid)
    *
    *  @param query the time series we're operating with
    *  @param metric the metric that determines the distance between ts
    *  @param dropout the dropout optimization param
+   *
+   *  A space of several lengths (see the constructor) compares the query
+   *  resampled to its length.
+   *
+   *  Above level 0 (see enableLevels), only the groups of the closest cluster
+   *  at each level are compared. A level above the top one searches from the
+   *  top one.
+   *
+   *  Queries may run concurrently; those with cascadeDistance take turns
+   *  over the centroid envelopes.
+   *
+   *  @param level the level searched
    */
   candidate_group_t getBestGroup(const TimeSeries& query,
                                  const dist_t warpedDistance,
-                                 data_t dropout) const;
+                                 data_t dropout,
+                                 int level = 0) const;
 
+  /**
+   *  @brief offers the groups closest to a query to a heap of best groups
+   *
+   *  Above level 0 (see enableLevels), only the groups of the closest clusters
+   *  at each level holding at least k subsequences (at least one cluster) are
+   *  offered.
+   *
+   *  @param level the level searched
+   */
   int interLevelKSim(const TimeSeries& query, 
                      const dist_t warpedDistance, 
                      vector<group_index_t> &bestSoFar, 
-                     int k);
+                     int k,
+                     int level = 0);
     
 private:
   int length, subTimeSeriesCount;
+  // number of lengths grouped, each resampled to length (see the constructor)
+  int lengthCount;
   const TimeSeriesSet& dataset;
-  vector<Group*> groups;
+  vector<Group> groups;
+  // group and previous member of each subsequence while grouping
   vector<group_membership_t> memberMap;
+  // encoded members of all groups, group after group (see compactMembers)
+  vector<uint8_t> memberBytes;
+  // values of all centroids, which the centroid of each group reads from;
+  // the envelopes are prepared on demand by queries, which hold envelopeMutex
+  // while preparing and reading them
+  mutable CentroidMatrix centroids;
+  mutable std::mutex envelopeMutex;
+
+  VPTree* centroidIndex = nullptr;
+  dist_t indexDistance = nullptr;
+  bool keoghIndex = false;
+  bool triangleBounds = false;
+  bool batched = false;
+  bool ordered = false;
+  // mean and index of each centroid, by increasing mean, when ordering by means
+  bool meanOrdered = false;
+  vector< std::pair<data_t, int> > centroidMeans;
+  // fraction and seed of the sample, and the subsequences grouped with it
+  double sampleRatio = 0;
+  unsigned sampleSeed = 0;
+  vector<bool> sampled;
+  // number of refinement passes (see enableRefinement)
+  int refineIterations = 0;
+  // radius of super-groups relative to threshold / 2 (see enableSuperGroups),
+  // and the super-groups; the envelopes are rebuilt by refreshCentroids
+  double superGroupRatio = 0;
+  vector<super_group_t> superGroups;
+  // thresholds of levels 1 and up, and their clusters (see enableLevels);
+  // levels[l - 1] holds level l
+  vector<data_t> levelThresholds;
+  vector< vector<super_group_t> > levels;
+  // hash tables of centroids (see enableHashing); projections has one row of
+  // length values per hash, and offsets one shift per hash in bucket widths
+  int lshTables = 0;
+  double lshWidth = 0;
+  bool lshVerify = false;
+  bool hashing = false;
+  data_t bucketWidth = 0;
+  vector<data_t> projections;
+  vector<data_t> offsets;
+  vector< std::unordered_map< uint64_t, vector<int> > > hashTables;
+  mutable std::atomic<long> verifiedAssignments{0};
+  mutable std::atomic<long> differingAssignments{0};
+  int stride = 1;
+  group_stats_t stats;
+  // centroids within threshold of each centroid, by increasing distance
+  vector< vector< std::pair<data_t, int> > > neighbours;
+
+  bool incremental = false;
+  const LocalLengthGroupSpace* previous = nullptr;
+  extend_t extend = nullptr;
+  // distance of each subsequence to the centroid of its group
+  vector<data_t> assignedDistance;
+  // for each group of the previous length, the group whose centroid extends its
+  // centroid and the last group joined by a subsequence whose prefix is a member
+  vector<int> extendedGroup;
+  vector<int> lastJoined;
+
+  void _allocateMemberMap();
+  void _groupAll(const dist_t pairwiseDistance, data_t threshold, WorkStealingPool* pool,
+                 bool deterministic, const vector<long>* seeds);
+  void _groupSample(const dist_t pairwiseDistance, data_t threshold);
+  void _groupFirst(const vector<long>& positions, const dist_t pairwiseDistance, data_t threshold);
+  void _refine(const dist_t pairwiseDistance, data_t threshold, WorkStealingPool* pool,
+               bool deterministic);
+  long _medoid(const Group& group, const dist_t pairwiseDistance) const;
+  data_t _radiusSum() const;
+  void _buildSuperGroups(const dist_t pairwiseDistance, data_t threshold);
+  vector< std::pair<data_t, int> > _rankSuperGroups(const TimeSeries& query) const;
+  vector<super_group_t> _clusterCentroids(const vector<int>& below, data_t reach,
+                                          bool withEnvelope, const dist_t pairwiseDistance);
+  void _countMembers(vector<super_group_t>& clusters, const vector<super_group_t>* below) const;
+  void _buildLevels(const dist_t pairwiseDistance);
+  vector<int> _descend(const TimeSeries& query, const dist_t warpedDistance, int level,
+                       int k) const;
+  long _position(int idx, int start, int length) const;
+  bool _isGrouped(int idx, int start, int length) const;
+  long _slot(int idx, int start, int length) const;
+  void _decodePosition(long p, int& idx, int& start, int& length) const;
+  TimeSeries _subsequence(int idx, int start, int length) const;
+  const TimeSeries& _scaledQuery(const TimeSeries& query, TimeSeries& scaled) const;
+  bool _isSampled(long p) const { return !this->sampled.empty() && this->sampled[p]; }
+  void _matchRange(const dist_t pairwiseDistance, data_t threshold, long from, long to,
+                   int numGroups, bool batch, data_t* bestDist, int* bestIndex) const;
+  void _matchRangeBatched(const dist_t pairwiseDistance, data_t threshold, long from, long to,
+                          int numGroups, data_t* bestDist, int* bestIndex) const;
+  void _nearestCentroid(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout,
+                        int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _nearestByMean(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout,
+                      int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _nearestByHash(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout,
+                      int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _verifyAssignment(const TimeSeries& query, const dist_t pairwiseDistance, data_t dropout,
+                         int numGroups, int bestSoFarIndex) const;
+  void _prepareHashing(const dist_t pairwiseDistance, data_t threshold);
+  void _hashKeys(const TimeSeries& ts, uint64_t* keys) const;
+  void _hashCentroid(int groupIndex);
+  void _finishHashing();
+  void _storeCentroid(int groupIndex);
+  void _prepareEnvelopes(const TimeSeries& query) const;
+  void _indexCentroid(int groupIndex);
+  void _addNeighbours(int groupIndex, const dist_t pairwiseDistance, data_t threshold);
+  void _refineWithNeighbours(const TimeSeries& query, const dist_t pairwiseDistance,
+                             int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _seed(int idx, int start, int length, const TimeSeries& query, const dist_t pairwiseDistance,
+             data_t dropout, int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _seedFromPrefix(int idx, int start, const TimeSeries& query, const dist_t pairwiseDistance,
+                       data_t dropout, int numGroups, data_t& bestSoFar, int& bestSoFarIndex) const;
+  void _assign(int idx, int start, int length, const dist_t pairwiseDistance, data_t threshold,
+               data_t bestSoFar, int bestSoFarIndex);
 
   /*************************
    *  Start serialization
@@ -90,27 +655,106 @@ private:
   template<class A>
   void save(A & ar, unsigned) const
   {
+    ar << this->lengthCount;
     ar << groups.size();
-    for (auto g : groups) {
-      ar << *g;
+    for (auto& g : groups) {
+      ar << g;
+    }
+    bool hasIndex = this->centroidIndex != nullptr;
+    ar << hasIndex;
+    if (hasIndex) {
+      ar << *(this->centroidIndex);
+    }
+    ar << this->stride;
+    this->_saveClusters(ar, this->superGroups);
+    ar << this->levelThresholds;
+    for (auto& level : this->levels) {
+      this->_saveClusters(ar, level);
     }
   }
 
   template<class A>
-  void load(A & ar, unsigned)
+  void load(A & ar, unsigned version)
   {
+    // Versions before 3 group one length
+    if (version >= 3) {
+      ar >> this->lengthCount;
+    }
     size_t numberOfGroups;
     ar >> numberOfGroups;
+    this->_allocateMemberMap();
     
     for (int i = 0; i < numberOfGroups; i++)
     {
-      auto g = new Group(i
-                         , this->length
-                         , this->subTimeSeriesCount
-                         , this->dataset
-                         , this->memberMap);
-      ar >> *g;
-      this->groups.push_back(g);
+      this->groups.emplace_back(i
+                                , this->length
+                                , this->subTimeSeriesCount
+                                , this->dataset
+                                , this->memberMap);
+      this->groups.back().setLengthCount(this->lengthCount);
+      ar >> this->groups.back();
+      this->_storeCentroid(i);
+    }
+    this->compactMembers();
+
+    // Version 0 has no centroid index
+    bool hasIndex = false;
+    if (version >= 1) {
+      ar >> hasIndex;
+    }
+    if (hasIndex) {
+      delete this->centroidIndex;
+      this->centroidIndex = new VPTree();
+      ar >> *(this->centroidIndex);
+    }
+
+    // Versions before 2 group every start
+    int stride = 1;
+    if (version >= 2) {
+      ar >> stride;
+    }
+    this->setStride(stride);
+
+    // Versions before 4 have no super-groups, and versions before 5 no levels
+    this->superGroups.clear();
+    if (version >= 4) {
+      this->_loadClusters(ar, this->superGroups);
+    }
+    this->levelThresholds.clear();
+    if (version >= 5) {
+      ar >> this->levelThresholds;
+    }
+    this->levels.assign(this->levelThresholds.size(), vector<super_group_t>());
+    for (auto& level : this->levels) {
+      this->_loadClusters(ar, level);
+    }
+
+    // Member counts are not saved
+    this->_countMembers(this->superGroups, nullptr);
+    for (auto l = 0; l < this->levels.size(); l++) {
+      this->_countMembers(this->levels[l], l == 0 ? nullptr : &this->levels[l - 1]);
+    }
+  }
+
+  template<class A>
+  void _saveClusters(A & ar, const vector<super_group_t>& clusters) const
+  {
+    ar << clusters.size();
+    for (auto& s : clusters) {
+      ar << s.centroid << s.radius << s.groups;
+      ar << s.envelope.getLower() << s.envelope.getUpper();
+    }
+  }
+
+  template<class A>
+  void _loadClusters(A & ar, vector<super_group_t>& clusters)
+  {
+    size_t numberOfClusters;
+    ar >> numberOfClusters;
+    clusters.resize(numberOfClusters);
+    for (auto& s : clusters) {
+      ar >> s.centroid >> s.radius >> s.groups;
+      ar >> s.envelope.getLower() >> s.envelope.getUpper();
     }
   }
 
@@ -123,4 +767,6 @@ private:
 
 } // namespace genex
 
+BOOST_CLASS_VERSION(genex::LocalLengthGroupSpace, 5)
+
 #endif //LOCAL_LENGTH_GROUP_SPACE_H
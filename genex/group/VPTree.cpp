@@ -0,0 +1,87 @@
+#include "group/VPTree.hpp"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+// A leaf is split into a vantage node once it holds more items than this
+#define VP_LEAF_SIZE 16
+
+namespace genex {
+
+void VPTree::insert(int item, const item_distance_t& distance)
+{
+  this->count++;
+  if (this->nodes.empty()) {
+    this->nodes.push_back(node_t());
+  }
+
+  int n = 0;
+  while (this->nodes[n].vantage >= 0)
+  {
+    data_t d = distance(item, this->nodes[n].vantage);
+    int s = d < this->nodes[n].radius ? 0 : 1;
+    if (this->nodes[n].child[s] < 0) {
+      this->nodes[n].child[s] = this->nodes.size();
+      this->nodes[n].lo[s] = d;
+      this->nodes[n].hi[s] = d;
+      this->nodes.push_back(node_t());
+    }
+    else {
+      this->nodes[n].lo[s] = std::min(this->nodes[n].lo[s], d);
+      this->nodes[n].hi[s] = std::max(this->nodes[n].hi[s], d);
+    }
+    n = this->nodes[n].child[s];
+  }
+
+  this->nodes[n].bucket.push_back(item);
+  if (this->nodes[n].bucket.size() > VP_LEAF_SIZE) {
+    this->_split(n, distance);
+  }
+}
+
+void VPTree::_split(int n, const item_distance_t& distance)
+{
+  std::vector<int> items;
+  items.swap(this->nodes[n].bucket);
+  int vantage = items[0];
+
+  std::vector< std::pair<data_t, int> > byDistance;
+  for (auto i = 1; i < items.size(); i++) {
+    byDistance.push_back(std::make_pair(distance(items[i], vantage), items[i]));
+  }
+  std::sort(byDistance.begin(), byDistance.end());
+
+  node_t node;
+  node.vantage = vantage;
+  node.radius = byDistance[byDistance.size() / 2].first;
+  node_t side[2];
+  for (auto& p : byDistance) {
+    int s = p.first < node.radius ? 0 : 1;
+    if (side[s].bucket.empty()) {
+      node.lo[s] = p.first;
+    }
+    node.hi[s] = p.first;
+    side[s].bucket.push_back(p.second);
+  }
+  for (int s = 0; s < 2; s++) {
+    if (!side[s].bucket.empty()) {
+      node.child[s] = this->nodes.size();
+      this->nodes.push_back(std::move(side[s]));
+    }
+  }
+  this->nodes[n] = std::move(node);
+}
+
+void VPTree::clear()
+{
+  this->nodes.clear();
+  this->count = 0;
+}
+
+int VPTree::size() const
+{
+  return this->count;
+}
+
+} // namespace genex
@@ -0,0 +1,141 @@
+#ifndef VP_TREE_HPP
+#define VP_TREE_HPP
+
+#include <functional>
+#include <vector>
+
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/vector.hpp>
+
+#include "TimeSeries.hpp"
+
+namespace genex {
+
+/**
+ *  @brief a vantage-point tree over the items (e.g. group centroids) of a metric space
+ *
+ *  Items are integer ids; distances between items are supplied by the caller when
+ *  inserting. Each internal node keeps a vantage item and splits the items below
+ *  it by their distance to the vantage. For each side, the minimum and maximum of
+ *  these distances are tracked, so that items can be inserted one at a time while
+ *  the tree stays exact: for a query q at distance d from the vantage, every item
+ *  x on a side with range [lo, hi] satisfies dist(q, x) >= max(d - hi, lo - d).
+ */
+class VPTree
+{
+public:
+  typedef std::function<data_t(int, int)> item_distance_t;
+
+  /**
+   *  @brief inserts an item
+   *
+   *  @param item id of the item
+   *  @param distance the distance between two items given their ids
+   */
+  void insert(int item, const item_distance_t& distance);
+
+  /**
+   *  @brief removes all items
+   */
+  void clear();
+
+  /**
+   *  @return number of items in the tree
+   */
+  int size() const;
+
+  /**
+   *  @brief visits the items that a visitor cannot rule out
+   *
+   *  The visitor provides three methods:
+   *    data_t visit(int item, data_t reach) - examines an item and returns its key,
+   *        usually its distance to the query. Keys further than bound() + reach
+   *        may be returned as INF.
+   *    data_t lowerBound(data_t key, data_t lo, data_t hi) - a lower bound of the
+   *        value of any item within [lo, hi] of a vantage with the given key.
+   *    data_t bound() - subtrees whose lower bound exceeds this are skipped.
+   *
+   *  The closer side of each node is visited first.
+   */
+  template<class V>
+  void search(V& visitor) const
+  {
+    if (!this->nodes.empty()) {
+      this->_search(0, visitor);
+    }
+  }
+
+private:
+  struct node_t
+  {
+    // vantage item; -1 for a leaf
+    int vantage = -1;
+    // split distance; items closer than it go to the inner side
+    data_t radius = 0;
+    // node index of the inner and outer side; -1 if empty
+    int child[2] = { -1, -1 };
+    // range of distances to the vantage on each side
+    data_t lo[2] = { 0, 0 };
+    data_t hi[2] = { 0, 0 };
+    // items of a leaf
+    std::vector<int> bucket;
+
+    template<class A>
+    void serialize(A & ar, unsigned)
+    {
+      ar & vantage & radius & child[0] & child[1] & lo[0] & lo[1] & hi[0] & hi[1] & bucket;
+    }
+  };
+
+  std::vector<node_t> nodes;
+  int count = 0;
+
+  void _split(int n, const item_distance_t& distance);
+
+  template<class V>
+  void _search(int n, V& visitor) const
+  {
+    const node_t& node = this->nodes[n];
+    if (node.vantage < 0) {
+      for (auto item : node.bucket) {
+        visitor.visit(item, 0);
+      }
+      return;
+    }
+
+    data_t reach = 0;
+    data_t lb[2];
+    for (int s = 0; s < 2; s++) {
+      if (node.child[s] >= 0) {
+        reach = std::max(reach, node.hi[s]);
+      }
+    }
+    data_t key = visitor.visit(node.vantage, reach);
+    for (int s = 0; s < 2; s++) {
+      lb[s] = node.child[s] < 0 ? INF : visitor.lowerBound(key, node.lo[s], node.hi[s]);
+    }
+    int first = lb[0] <= lb[1] ? 0 : 1;
+    for (int s : { first, 1 - first }) {
+      if (node.child[s] >= 0 && lb[s] <= visitor.bound()) {
+        this->_search(node.child[s], visitor);
+      }
+    }
+  }
+
+  /*************************
+   *  Start serialization
+   *************************/
+  friend class boost::serialization::access;
+  template<class A>
+  void serialize(A & ar, unsigned)
+  {
+    ar & this->count & this->nodes;
+  }
+  /*************************
+   *  End serialization
+   *************************/
+};
+
+} // namespace genex
+
+#endif // VP_TREE_HPP
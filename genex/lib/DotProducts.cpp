@@ -0,0 +1,94 @@
+#include "lib/DotProducts.hpp"
+
+#include <algorithm>
+#include <vector>
+
+// Rows of a and b in a register tile of products
+#define TILE_A 4
+#define TILE_B 4
+// Rows of b and values of each row in a cache block
+#define BLOCK_B 64
+#define BLOCK_K 256
+
+namespace genex {
+
+/**
+ *  Copies rows [jb, jb + rows) and values [kb, kb + len) of b into tiles of
+ *  TILE_B rows, value-major within a tile: packed[(t * len + k) * TILE_B + j].
+ *  Rows past the end of b are zero.
+ */
+static void packBlock(const data_t* b, int rowsB, int strideB,
+                      int jb, int rows, int kb, int len, data_t* packed)
+{
+  for (int t = 0; t * TILE_B < rows; t++) {
+    for (int j = 0; j < TILE_B; j++) {
+      int row = jb + t * TILE_B + j;
+      data_t* out = packed + (size_t)t * len * TILE_B + j;
+      if (row < rowsB) {
+        const data_t* in = b + (size_t)row * strideB + kb;
+        for (int k = 0; k < len; k++) {
+          out[k * TILE_B] = in[k];
+        }
+      }
+      else {
+        for (int k = 0; k < len; k++) {
+          out[k * TILE_B] = 0;
+        }
+      }
+    }
+  }
+}
+
+void dotProducts(const data_t* a, int rowsA, int strideA,
+                 const data_t* b, int rowsB, int strideB,
+                 int length, data_t* out, int strideOut)
+{
+  for (int i = 0; i < rowsA; i++) {
+    std::fill(out + (size_t)i * strideOut, out + (size_t)i * strideOut + rowsB, 0);
+  }
+
+  std::vector<data_t> packed((size_t)BLOCK_B * BLOCK_K);
+  for (int kb = 0; kb < length; kb += BLOCK_K)
+  {
+    int len = std::min(BLOCK_K, length - kb);
+    for (int jb = 0; jb < rowsB; jb += BLOCK_B)
+    {
+      int rows = std::min(BLOCK_B, rowsB - jb);
+      packBlock(b, rowsB, strideB, jb, rows, kb, len, packed.data());
+
+      for (int i = 0; i < rowsA; i += TILE_A)
+      {
+        // Rows past the end of a repeat the last row and are not written
+        const data_t* ra[TILE_A];
+        for (int ii = 0; ii < TILE_A; ii++) {
+          ra[ii] = a + (size_t)std::min(i + ii, rowsA - 1) * strideA + kb;
+        }
+
+        for (int t = 0; t * TILE_B < rows; t++)
+        {
+          const data_t* p = packed.data() + (size_t)t * len * TILE_B;
+          data_t acc[TILE_A][TILE_B] = {};
+          for (int k = 0; k < len; k++) {
+            for (int ii = 0; ii < TILE_A; ii++) {
+              data_t x = ra[ii][k];
+              for (int j = 0; j < TILE_B; j++) {
+                acc[ii][j] += x * p[k * TILE_B + j];
+              }
+            }
+          }
+
+          int col = jb + t * TILE_B;
+          int cols = std::min(TILE_B, rowsB - col);
+          for (int ii = 0; ii < TILE_A && i + ii < rowsA; ii++) {
+            data_t* o = out + (size_t)(i + ii) * strideOut + col;
+            for (int j = 0; j < cols; j++) {
+              o[j] += acc[ii][j];
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+} // namespace genex
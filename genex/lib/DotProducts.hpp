@@ -0,0 +1,33 @@
+#ifndef DOT_PRODUCTS_H
+#define DOT_PRODUCTS_H
+
+#include "TimeSeries.hpp"
+
+namespace genex {
+
+/**
+ *  @brief computes the dot products of every row of a with every row of b
+ *
+ *  out[i * strideOut + j] = sum over k < length of a[i * strideA + k] * b[j * strideB + k]
+ *
+ *  This is the matrix product a * transpose(b). It is cache-blocked over the
+ *  rows of b and the length, and each block of b is packed so that a register
+ *  tile of products is updated with contiguous loads.
+ *
+ *  @param a first row of a
+ *  @param rowsA number of rows of a
+ *  @param strideA number of values between the starts of two rows of a
+ *  @param b first row of b
+ *  @param rowsB number of rows of b
+ *  @param strideB number of values between the starts of two rows of b
+ *  @param length number of values of each row taking part in the products
+ *  @param out first row of the result
+ *  @param strideOut number of values between the starts of two rows of out
+ */
+void dotProducts(const data_t* a, int rowsA, int strideA,
+                 const data_t* b, int rowsB, int strideB,
+                 int length, data_t* out, int strideOut);
+
+} // namespace genex
+
+#endif // DOT_PRODUCTS_H
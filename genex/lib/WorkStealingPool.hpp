@@ -0,0 +1,208 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace genex {
+
+/**
+ *  @brief a fixed-size pool of workers that balance load by stealing tasks
+ *
+ *  Tasks submitted from outside the pool go to a shared queue. Tasks submitted
+ *  by a worker go to the back of that worker's own deque; the owner pops from
+ *  the back while idle workers steal from the front of other deques. A worker
+ *  waiting for a future through wait() keeps running nested tasks instead of
+ *  blocking, so a task may safely fan out sub-tasks and wait for them.
+ */
+class WorkStealingPool
+{
+public:
+  /**
+   *  @brief starts the pool
+   *
+   *  @param numThreads number of worker threads
+   */
+  explicit WorkStealingPool(int numThreads)
+    : stop(false), queued(0)
+  {
+    if (numThreads <= 0) {
+      throw std::invalid_argument("Number of threads must be positive");
+    }
+    for (int i = 0; i < numThreads; i++) {
+      this->queues.emplace_back(new task_queue_t());
+    }
+    for (int i = 0; i < numThreads; i++) {
+      this->workers.emplace_back([this, i] { this->_work(i); });
+    }
+  }
+
+  /**
+   *  @brief finishes all queued tasks and joins the workers
+   */
+  ~WorkStealingPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(this->sleepMutex);
+      this->stop = true;
+    }
+    this->wake.notify_all();
+    for (auto& w : this->workers) {
+      w.join();
+    }
+  }
+
+  /**
+   *  @brief number of worker threads
+   */
+  int size() const { return this->workers.size(); }
+
+  /**
+   *  @brief schedules a task
+   *
+   *  @param f a callable taking no argument
+   *  @return a future holding the result of f
+   */
+  template<class F>
+  std::future<typename std::result_of<F()>::type> submit(F f)
+  {
+    typedef typename std::result_of<F()>::type return_t;
+    auto task = std::make_shared< std::packaged_task<return_t()> >(std::move(f));
+    std::future<return_t> res = task->get_future();
+
+    int self = this->_currentWorker();
+    task_queue_t& q = self >= 0 ? *this->queues[self] : this->shared;
+    {
+      std::lock_guard<std::mutex> lock(q.mutex);
+      q.tasks.emplace_back([task] { (*task)(); });
+    }
+    this->queued++;
+    {
+      std::lock_guard<std::mutex> lock(this->sleepMutex);
+    }
+    this->wake.notify_one();
+    return res;
+  }
+
+  /**
+   *  @brief waits for a future returned by submit
+   *
+   *  On a worker of this pool, nested tasks are executed while waiting. On
+   *  any other thread this simply blocks.
+   */
+  template<class T>
+  T wait(std::future<T>& f)
+  {
+    int self = this->_currentWorker();
+    if (self >= 0) {
+      while (f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        if (!this->_runNested(self)) {
+          f.wait_for(std::chrono::microseconds(50));
+        }
+      }
+    }
+    return f.get();
+  }
+
+private:
+  struct task_queue_t
+  {
+    std::mutex mutex;
+    std::deque< std::function<void()> > tasks;
+  };
+
+  std::vector< std::unique_ptr<task_queue_t> > queues;
+  task_queue_t shared;
+  std::vector<std::thread> workers;
+
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool stop;
+  std::atomic<int> queued;
+
+  struct worker_slot_t
+  {
+    const WorkStealingPool* pool;
+    int index;
+  };
+
+  static worker_slot_t& _slot()
+  {
+    static thread_local worker_slot_t slot = { nullptr, -1 };
+    return slot;
+  }
+
+  int _currentWorker() const
+  {
+    const worker_slot_t& slot = _slot();
+    return slot.pool == this ? slot.index : -1;
+  }
+
+  bool _take(task_queue_t& q, bool back, std::function<void()>& task)
+  {
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty()) {
+      return false;
+    }
+    if (back) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    }
+    else {
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    this->queued--;
+    return true;
+  }
+
+  // Own deque first (newest task, hot in cache), then steal the oldest task
+  // of another worker
+  bool _runNested(int self)
+  {
+    std::function<void()> task;
+    bool found = this->_take(*this->queues[self], true, task);
+    int n = this->queues.size();
+    for (int k = 1; !found && k < n; k++) {
+      found = this->_take(*this->queues[(self + k) % n], false, task);
+    }
+    if (found) {
+      task();
+    }
+    return found;
+  }
+
+  void _work(int self)
+  {
+    _slot() = { this, self };
+    for (;;)
+    {
+      if (this->_runNested(self)) {
+        continue;
+      }
+      std::function<void()> task;
+      if (this->_take(this->shared, false, task)) {
+        task();
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(this->sleepMutex);
+      this->wake.wait(lock, [this] { return this->stop || this->queued > 0; });
+      if (this->stop && this->queued == 0) {
+        return;
+      }
+    }
+  }
+};
+
+} // namespace genex
+
+#endif // WORK_STEALING_POOL_H
@@ -1,3 +1,5 @@
+// The group function takes more arguments than the default limit of 15
+#define BOOST_PYTHON_MAX_ARITY 23
 #include <boost/python.hpp>
 
 #include "GenexAPI.hpp"
@@ -57,6 +59,8 @@ py::dict candidateTimeSeriesToPythonDict(const candidate_time_series_t & cts)
  *  @param startCol columns before startCol, in 0-based index, are discarded
  *  @param hasNameCol whether the first column (starting from startCol) is the one
  *         with names for each time series
+ *  @param numThreads number of threads parsing the files if path is a directory
+ *         or a glob pattern
  *  @return a dict containing information of the loaded dataset:
  *			{ 
  *			  "name": <dataset name>,
@@ -72,14 +76,16 @@ py::dict loadDataset(const string& name
                    , const string& separators
                    , int maxNumRow
                    , int startCol
-                   , bool hasNameCol)
+                   , bool hasNameCol
+                   , int numThreads)
 {
   dataset_metadata_t info = genexAPI.loadDataset(name
                                                 , path
                                                 , separators
                                                 , maxNumRow
                                                 , startCol
-                                                , hasNameCol);
+                                                , hasNameCol
+                                                , numThreads);
   py::dict pinfo;
   pinfo["name"] = info.name;
   pinfo["count"] = info.itemCount;
@@ -103,14 +109,18 @@ void unloadDataset(const string& name)
  *  @param name name of the dataset
  *  @param filePath path to a text file
  *  @param separator a character to separate entries in the file
+ *  @param numThreads number of threads formatting the text file
+ *  @param binary if set to true, the dataset is saved in the binary format
  *
  *  @throw GenexException if cannot read from the given file
  */
 void saveDataset(const string& name
                  , const string& filePath
-                 , const string& separator)
+                 , const string& separator
+                 , int numThreads
+                 , bool binary)
 {
-  genexAPI.saveDataset(name, filePath, separator[0]);
+  genexAPI.saveDataset(name, filePath, separator[0], numThreads, binary);
 }
 
 /**
@@ -122,12 +132,13 @@ void saveDataset(const string& name
  *  across the whole dataset.
  *
  *  @param name name of the dataset to be normalized
+ *  @param numThreads number of threads used to normalize the dataset
  *  @return a tuple (min, max) - the minimum and maximum value across
  *          the whole dataset before being normalized.
  */
-py::tuple normalize(const string& name)
+py::tuple normalize(const string& name, int numThreads)
 {
-  std::pair<data_t, data_t> val = genexAPI.normalizeDataset(name);
+  std::pair<data_t, data_t> val = genexAPI.normalizeDataset(name, numThreads);
   return py::make_tuple(val.first, val.second);
 }
 
@@ -163,16 +174,76 @@ int getTimeSeriesLength(const string& name, int index)
  *  @param distanceName the distance to use when grouping the data
  *  @param numThreads number of threads used to group
  *  @param wholeSeriesOnly if set to true group the largest length only
+ *  @param deterministic if true, multi-threaded grouping gives the same groups as single-threaded
+ *  @param centroidIndex if true, index centroids in a VP-tree when the distance is a metric
+ *  @param triangleBounds if true, skip centroid comparisons with the triangle inequality
+ *  @param incremental if true, seed each length with the groups of the previous length
+ *  @param batched if true, match subsequences to centroids in batches with the euclidean distance
+ *  @param ordered if true, compare subsequences with the likeliest centroids first
+ *  @param stride group only the starts at multiples of this
+ *  @param sampleRatio if positive, choose centroids from this fraction of the subsequences
+ *  @param sampleSeed seed drawing the sample
+ *  @param bucketRatio if above 1, group the lengths from l to l * bucketRatio together
+ *  @param lshTables if positive, match subsequences to centroids with this many LSH tables
+ *  @param lshWidth width of the LSH buckets relative to the threshold
+ *  @param lshVerify if true, count the LSH assignments that differ from a full scan
+ *  @param refineIterations number of passes moving centroids to the medoids of their groups
+ *  @param superGroupRatio if above 1, cluster centroids into super-groups of this radius
+ *         relative to the group radius
+ *  @param levelThresholds increasing thresholds of nested levels of coarser groups
+ *  @param lazy if true, group each length the first time a query needs it
+ *  @param lazyPrefetch with lazy, also group the lengths needed by queries up to this
+ *         many lengths longer or shorter
  *  @return the number of groups created
  */
 int group(const string& name
           , data_t threshold
           , const string& distanceName
           , int numThreads
-          , bool wholeSeriesOnly)
+          , bool wholeSeriesOnly
+          , bool deterministic
+          , bool centroidIndex
+          , bool triangleBounds
+          , bool incremental
+          , bool batched
+          , bool ordered
+          , int stride
+          , double sampleRatio
+          , unsigned sampleSeed
+          , double bucketRatio
+          , int lshTables
+          , double lshWidth
+          , bool lshVerify
+          , int refineIterations
+          , double superGroupRatio
+          , const py::list& levelThresholds
+          , bool lazy
+          , int lazyPrefetch)
 {
-  return genexAPI.groupDataset(
-    name, threshold, distanceName, numThreads, wholeSeriesOnly);
+  group_options_t options;
+  options.numThreads = numThreads;
+  options.wholeSeriesOnly = wholeSeriesOnly;
+  options.deterministic = deterministic;
+  options.centroidIndex = centroidIndex;
+  options.triangleBounds = triangleBounds;
+  options.incremental = incremental;
+  options.batched = batched;
+  options.ordered = ordered;
+  options.stride = stride;
+  options.sampleRatio = sampleRatio;
+  options.sampleSeed = sampleSeed;
+  options.bucketRatio = bucketRatio;
+  options.lshTables = lshTables;
+  options.lshWidth = lshWidth;
+  options.lshVerify = lshVerify;
+  options.refineIterations = refineIterations;
+  options.superGroupRatio = superGroupRatio;
+  for (int i = 0; i < py::len(levelThresholds); i++) {
+    options.levelThresholds.push_back(py::extract<data_t>(levelThresholds[i]));
+  }
+  options.lazy = lazy;
+  options.lazyPrefetch = lazyPrefetch;
+  return genexAPI.groupDataset(name, threshold, distanceName, options);
 }
 
 /**
@@ -430,6 +501,17 @@ py::list getAllDistances()
   return distList;
 }
 
+/**
+ *  @brief chooses the level of groups searched by queries on a dataset
+ *
+ *  @param name name of the grouped dataset
+ *  @param level 0 for the groups, or a level of coarser groups
+ */
+void setQueryLevel(const string& name, int level)
+{
+  genexAPI.setQueryLevel(name, level);
+}
+
 void setWarpignBandRatio(double ratio) {
   genexAPI.setWarpingBandRatio(ratio);
 }
@@ -440,16 +522,38 @@ BOOST_PYTHON_MODULE(pygenex)
           (py::arg("separators")=" "
           , py::arg("maxNumRow")=0
           , py::arg("startCol")=0
-          , py::arg("hasNameCol")=false));
+          , py::arg("hasNameCol")=false
+          , py::arg("numThreads")=1));
   py::def("unloadDataset", unloadDataset);
-  py::def("saveDataset", saveDataset);
-  py::def("normalize", normalize);
+  py::def("saveDataset", saveDataset,
+          (py::arg("separator")=" "
+          , py::arg("numThreads")=1
+          , py::arg("binary")=false));
+  py::def("normalize", normalize, (py::arg("numThreads")=1));
   py::def("getTimeSeriesName", getTimeSeriesName);
   py::def("getTimeSeriesLength", getTimeSeriesLength);
   py::def("group", group,
           (py::arg("distanceName")="euclidean"
           , py::arg("numThreads")=1
-          , py::arg("wholeSeriesOnly")=false));
+          , py::arg("wholeSeriesOnly")=false
+          , py::arg("deterministic")=false
+          , py::arg("centroidIndex")=true
+          , py::arg("triangleBounds")=true
+          , py::arg("incremental")=false
+          , py::arg("batched")=false
+          , py::arg("ordered")=false
+          , py::arg("stride")=1
+          , py::arg("sampleRatio")=0.0
+          , py::arg("sampleSeed")=0
+          , py::arg("bucketRatio")=1.0
+          , py::arg("lshTables")=0
+          , py::arg("lshWidth")=2.0
+          , py::arg("lshVerify")=false
+          , py::arg("refineIterations")=0
+          , py::arg("superGroupRatio")=1.0
+          , py::arg("levelThresholds")=py::list()
+          , py::arg("lazy")=false
+          , py::arg("lazyPrefetch")=1));
   py::def("preparePAA", preparePAA);
   py::def("saveGroups", saveGroups);
   py::def("saveGroupsSize", saveGroupsSize);
@@ -463,4 +567,5 @@ BOOST_PYTHON_MODULE(pygenex)
   py::def("getTimeSeries", getTimeSeries, (py::arg("start")=-1, py::arg("end")=-1));
   py::def("getAllDistances", getAllDistances);
   py::def("setWarpingBandRatio", setWarpingBandRatio);
+  py::def("setQueryLevel", setQueryLevel);
 }
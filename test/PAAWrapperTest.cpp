@@ -127,28 +127,31 @@ BOOST_AUTO_TEST_CASE( create_paa_wrapper ) {
 //     }
 // }
 
-// BOOST_AUTO_TEST_CASE( get_paa, *boost::unit_test::tolerance(TOLERANCE) ) {
-//     TimeSeriesSet tsSet;
-//     tsSet.loadData(test_10_20_space, -1, 0, " ");
-//     PAAWrapper paa(tsSet);
-
-//     paa.generatePAAMatrix(3);
-    
-//     vector<data_t> actual1 {3.25, 2.973632813, 1.155395508, 4.03125};
-//     TimeSeries paa1 = paa.getPAA(5, 0, 10);
-//     boostCheckTimeSeries( paa1, actual1 );
-
-//     vector<data_t> actual2 {1.308105469, 2.358723958};
-//     TimeSeries paa2 = paa.getPAA(7, 12, 18);
-//     boostCheckTimeSeries( paa2, actual2 );
-
-//     vector<data_t> actual3 {3.624023438};
-//     TimeSeries paa3 = paa.getPAA(1, 4, 6);
-//     boostCheckTimeSeries( paa3, actual3 );
-
-//     paa.generatePAAMatrix(4);
-//     vector<data_t> actual4 {1.737579346, 2.723388672, 2.108886719, 1.959960937};
-//     TimeSeries paa4 = paa.getPAA(3, 2, 17);
-//     boostCheckTimeSeries( paa4, actual4 );
-
-// }
+BOOST_AUTO_TEST_CASE( get_paa, *boost::unit_test::tolerance(TOLERANCE) ) {
+    TimeSeriesSet tsSet;
+    tsSet.loadData(test_10_20_space, -1, 0, " ");
+    PAAWrapper paa(tsSet);
+
+    // Check the on-the-fly averages first, then the ones from prefix sums
+    for (int pass = 0; pass < 2; pass++) {
+        tsSet.setKeepPrefixSums(pass == 1);
+        paa.generatePAAMatrix(3);
+
+        vector<data_t> actual1 {3.25, 2.973632813, 1.155395508, 4.03125};
+        TimeSeries paa1 = paa.getPAA(5, 0, 10);
+        boostCheckTimeSeries( paa1, actual1 );
+
+        vector<data_t> actual2 {1.308105469, 2.358723958};
+        TimeSeries paa2 = paa.getPAA(7, 12, 18);
+        boostCheckTimeSeries( paa2, actual2 );
+
+        vector<data_t> actual3 {3.624023438};
+        TimeSeries paa3 = paa.getPAA(1, 4, 6);
+        boostCheckTimeSeries( paa3, actual3 );
+
+        paa.generatePAAMatrix(4);
+        vector<data_t> actual4 {1.737579346, 2.723388672, 2.108886719, 1.959960937};
+        TimeSeries paa4 = paa.getPAA(3, 2, 17);
+        boostCheckTimeSeries( paa4, actual4 );
+    }
+}
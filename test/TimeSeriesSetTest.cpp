@@ -7,7 +7,13 @@
 #include "TimeSeries.hpp"
 #include "distance/Euclidean.hpp"
 
+#include <cstdio>
+#include <iomanip>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 #define TOLERANCE 1e-9
 
@@ -27,8 +33,24 @@ struct MockDataset
   std::string test_3_10_space = "datasets/test/test_3_10_space.txt";
   std::string test_3_uneven_space = "datasets/test/test_3_uneven_space.txt";
   std::string test_3_11_space = "datasets/test/test_3_11_space.txt";
+  std::string test_10_20_space_gz = "datasets/test/test_10_20_space.txt.gz";
+  std::string test_3_uneven_space_zlib = "datasets/test/test_3_uneven_space.txt.z";
 } data;
 
+void checkSameData(const TimeSeriesSet& a, const TimeSeriesSet& b)
+{
+  BOOST_REQUIRE_EQUAL( a.getItemCount(), b.getItemCount() );
+  BOOST_CHECK_EQUAL( a.getMaxLength(), b.getMaxLength() );
+  for (int i = 0; i < a.getItemCount(); i++) {
+    BOOST_REQUIRE_EQUAL( a.getItemLength(i), b.getItemLength(i) );
+    auto x = a.getTimeSeries(i);
+    auto y = b.getTimeSeries(i);
+    for (int j = 0; j < x.getLength(); j++) {
+      BOOST_CHECK_EQUAL( x[j], y[j] );
+    }
+  }
+}
+
 BOOST_AUTO_TEST_CASE( time_series_set_load_space, *boost::unit_test::tolerance(TOLERANCE) )
 {
   TimeSeriesSet tsSet;
@@ -84,6 +106,114 @@ BOOST_AUTO_TEST_CASE( time_series_set_load_uneven_rows )
   BOOST_TEST( ts2[ts2.getLength() - 1] == 10.0 );
 }
 
+BOOST_AUTO_TEST_CASE( time_series_set_load_compressed )
+{
+  TimeSeriesSet plain, compressed;
+  plain.loadData(data.test_10_20_space, 0, 0, " ");
+  compressed.loadData(data.test_10_20_space_gz, 0, 0, " ");
+  checkSameData(plain, compressed);
+  BOOST_CHECK( compressed.getFilePath() == data.test_10_20_space_gz );
+
+  plain.loadData(data.test_10_20_space, 4, 2, " ");
+  compressed.loadData(data.test_10_20_space_gz, 4, 2, " ");
+  BOOST_CHECK_EQUAL( compressed.getItemCount(), 4 );
+  BOOST_CHECK_EQUAL( compressed.getMaxLength(), 18 );
+  checkSameData(plain, compressed);
+
+  plain.loadData(data.test_3_uneven_space, 0, 0, " ");
+  compressed.loadData(data.test_3_uneven_space_zlib, 0, 0, " ");
+  checkSameData(plain, compressed);
+
+  // Plain text is not a valid gzip stream
+  std::string fname = "time_series_set_load_compressed.txt.gz";
+  std::ofstream(fname) << "1 2 3" << std::endl;
+  BOOST_CHECK_THROW( compressed.loadData(fname, 0, 0, " "), GenexException );
+  BOOST_CHECK( !compressed.isLoaded() );
+  remove(fname.c_str());
+  BOOST_CHECK_THROW( compressed.loadData("unicorn.txt.gz", 0, 0, " "), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( time_series_set_load_stdin )
+{
+  std::ifstream f(data.test_15_20_comma);
+  auto oldBuffer = std::cin.rdbuf(f.rdbuf());
+  TimeSeriesSet plain, piped;
+  piped.loadData("-", 0, 0, ",");
+  std::cin.rdbuf(oldBuffer);
+  plain.loadData(data.test_15_20_comma, 0, 0, ",");
+  checkSameData(plain, piped);
+}
+
+BOOST_AUTO_TEST_CASE( time_series_set_load_many_files, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  // A directory with one file per row of the 10x20 dataset, written out of
+  // order, plus a file holding several rows
+  std::string dir = "time_series_set_load_many_files";
+  mkdir(dir.c_str(), 0755);
+  TimeSeriesSet whole;
+  whole.loadData(data.test_10_20_space, 0, 0, " ");
+  vector<std::string> files;
+  for (int i = 9; i >= 0; i--) {
+    std::string fname = dir + "/device" + std::to_string(i) + ".txt";
+    std::ofstream f(fname);
+    auto ts = whole.getTimeSeries(i);
+    for (int j = 0; j < ts.getLength(); j++) {
+      f << std::setprecision(17) << ts[j] << " ";
+    }
+    f << std::endl;
+    files.push_back(fname);
+  }
+  std::string multi = dir + "/multi.csv";
+  std::ofstream(multi) << "1,2,3\n4,5\n";
+  files.push_back(multi);
+
+  for (int numThreads : {1, 4}) {
+    TimeSeriesSet tsSet;
+    tsSet.loadDataFiles(dir + "/device*.txt", 0, 0, " ", false, numThreads);
+    BOOST_CHECK( TimeSeriesSet::isMultiFilePath(dir + "/device*.txt") );
+    checkSameData(whole, tsSet);
+    for (int i = 0; i < 10; i++) {
+      BOOST_CHECK_EQUAL( tsSet.getTimeSeriesName(i), "device" + std::to_string(i) );
+    }
+
+    tsSet.loadDataFiles(dir, 0, 0, " ,", false, numThreads);
+    BOOST_CHECK( TimeSeriesSet::isMultiFilePath(dir) );
+    BOOST_CHECK_EQUAL( tsSet.getItemCount(), 12 );
+    BOOST_CHECK_EQUAL( tsSet.getTimeSeriesName(10), "multi:0" );
+    BOOST_CHECK_EQUAL( tsSet.getTimeSeriesName(11), "multi:1" );
+    BOOST_CHECK_EQUAL( tsSet.getItemLength(11), 2 );
+    BOOST_TEST( tsSet.getTimeSeries(11)[1] == 5.0 );
+
+    tsSet.loadDataFiles(dir, 3, 0, " ,", false, numThreads);
+    BOOST_CHECK_EQUAL( tsSet.getItemCount(), 3 );
+
+    // A file cut short keeps the names of a file of several rows
+    tsSet.loadDataFiles(dir, 11, 0, " ,", false, numThreads);
+    BOOST_CHECK_EQUAL( tsSet.getItemCount(), 11 );
+    BOOST_CHECK_EQUAL( tsSet.getTimeSeriesName(10), "multi:0" );
+  }
+
+  // Files after the first rows are not read
+  std::string unread = dir + "/zz.txt";
+  std::ofstream(unread) << "1 2 unicorn" << std::endl;
+  TimeSeriesSet firstRows;
+  firstRows.loadDataFiles(dir, 3, 0, " ,");
+  BOOST_CHECK_EQUAL( firstRows.getItemCount(), 3 );
+  remove(unread.c_str());
+
+  TimeSeriesSet tsSet;
+  BOOST_CHECK( !TimeSeriesSet::isMultiFilePath(data.test_10_20_space) );
+  BOOST_CHECK_THROW( tsSet.loadDataFiles(dir + "/unicorn*", 0, 0, " "), GenexException );
+  std::ofstream(dir + "/bad.txt") << "1 2 unicorn" << std::endl;
+  files.push_back(dir + "/bad.txt");
+  BOOST_CHECK_THROW( tsSet.loadDataFiles(dir, 0, 0, " ", false, 2), GenexException );
+
+  for (auto& f : files) {
+    remove(f.c_str());
+  }
+  rmdir(dir.c_str());
+}
+
 BOOST_AUTO_TEST_CASE( time_series_set_load_text_only )
 {
   TimeSeriesSet tsSet;
@@ -197,6 +327,197 @@ BOOST_AUTO_TEST_CASE( normalize_2, *boost::unit_test::tolerance(TOLERANCE) )
   }
 }
 
+BOOST_AUTO_TEST_CASE( prefix_sums, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_uneven_space, 20, 0, " ");
+  BOOST_CHECK( !tsSet.hasPrefixSums() );
+  BOOST_CHECK( !tsSet.getTimeSeries(0).hasPrefixSums() );
+
+  vector<data_t> averages, deviations;
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    for (int start = 0; start < tsSet.getItemLength(i) - 1; start++) {
+      TimeSeries ts = tsSet.getTimeSeries(i, start, tsSet.getItemLength(i));
+      averages.push_back(ts.average());
+      deviations.push_back(ts.stddev());
+    }
+  }
+
+  tsSet.setKeepPrefixSums(true);
+  BOOST_CHECK( tsSet.hasPrefixSums() );
+  int k = 0;
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    for (int start = 0; start < tsSet.getItemLength(i) - 1; start++, k++) {
+      TimeSeries ts = tsSet.getTimeSeries(i, start, tsSet.getItemLength(i));
+      BOOST_CHECK( ts.hasPrefixSums() );
+      BOOST_TEST( ts.average() == averages[k] );
+      BOOST_TEST( ts.stddev() == deviations[k] );
+    }
+  }
+
+  // Prefix sums follow the data through normalization and reloading
+  tsSet.loadData(data.test_3_11_space, 11, 0, " ");
+  BOOST_CHECK( tsSet.hasPrefixSums() );
+  tsSet.normalize();
+  TimeSeries t = tsSet.getTimeSeries(0, 0, 11);
+  BOOST_TEST( t.average() == 0.25 );
+
+  tsSet.setKeepPrefixSums(false);
+  BOOST_CHECK( !tsSet.hasPrefixSums() );
+}
+
+BOOST_AUTO_TEST_CASE( normalize_multithreaded, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet single, multi;
+  single.loadData(data.test_15_20_comma, -1, 0, ",");
+  multi.loadData(data.test_15_20_comma, -1, 0, ",");
+  auto min_max = single.normalize();
+  auto min_max_2 = multi.normalize(4);
+  BOOST_TEST( min_max.first == min_max_2.first );
+  BOOST_TEST( min_max.second == min_max_2.second );
+  for (int i = 0; i < single.getItemCount(); i++) {
+    auto a = single.getTimeSeries(i);
+    auto b = multi.getTimeSeries(i);
+    for (int j = 0; j < a.getLength(); j++) {
+      BOOST_CHECK_EQUAL( a[j], b[j] );
+    }
+  }
+  BOOST_CHECK_THROW( multi.normalize(0), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( series_statistics, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_3_uneven_space, 20, 0, " ");
+  BOOST_CHECK( !tsSet.hasStatistics() );
+  BOOST_CHECK_THROW( tsSet.getSeriesStats(0), GenexException );
+
+  tsSet.computeStatistics(2);
+  BOOST_CHECK( tsSet.hasStatistics() );
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    auto ts = tsSet.getTimeSeries(i);
+    auto st = tsSet.getSeriesStats(i);
+    BOOST_TEST( st.mean == ts.average() );
+    BOOST_TEST( st.std == ts.stddev() );
+  }
+  auto st = tsSet.getSeriesStats(1);
+  BOOST_TEST( st.min == 1.0 );
+  BOOST_TEST( st.max == 11.0 );
+  BOOST_CHECK_EQUAL( st.longestConstantRun, 1 );
+
+  // Statistics follow normalization
+  tsSet.normalize(3);
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    auto ts = tsSet.getTimeSeries(i);
+    auto st = tsSet.getSeriesStats(i);
+    BOOST_TEST( st.mean == ts.average() );
+    BOOST_TEST( st.std == ts.stddev() );
+  }
+  BOOST_TEST( tsSet.getSeriesStats(1).min == 0.0 );
+
+  tsSet.loadData(data.test_3_11_space, 11, 0, " ");
+  BOOST_CHECK( !tsSet.hasStatistics() );
+  tsSet.computeStatistics();
+  BOOST_CHECK_EQUAL( tsSet.getSeriesStats(1).longestConstantRun, 2 );
+  BOOST_CHECK_THROW( tsSet.getSeriesStats(3), GenexException );
+}
+
+// Exposes the data of a dataset to write values that are hard to format
+class WritableTimeSeriesSet : public TimeSeriesSet
+{
+public:
+  void setValues(const vector<data_t>& values)
+  {
+    this->clearData();
+    this->data = new data_t[values.size()];
+    std::copy(values.begin(), values.end(), this->data);
+    this->itemCount = 1;
+    this->maxCol = values.size();
+    this->lengths.push_back(values.size());
+  }
+};
+
+std::string readFile(const std::string& path)
+{
+  std::ifstream f(path);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  return ss.str();
+}
+
+std::string formatWithStream(const TimeSeriesSet& tsSet, char separator)
+{
+  std::ostringstream ss;
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    auto ts = tsSet.getTimeSeries(i);
+    for (int j = 0; j < ts.getLength(); j++) {
+      ss << ts[j] << separator;
+    }
+    ss << std::endl;
+  }
+  return ss.str();
+}
+
+BOOST_AUTO_TEST_CASE( save_text_matches_stream_formatting )
+{
+  std::string fname = "save_text_matches_stream_formatting.txt";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_15_20_comma, -1, 0, ",");
+  for (int numThreads : {1, 3}) {
+    tsSet.saveData(fname, ',', numThreads);
+    BOOST_CHECK_EQUAL( readFile(fname), formatWithStream(tsSet, ',') );
+  }
+  tsSet.normalize();
+  tsSet.saveData(fname, ' ', 2);
+  BOOST_CHECK_EQUAL( readFile(fname), formatWithStream(tsSet, ' ') );
+
+  WritableTimeSeriesSet hard;
+  hard.setValues({0, -0.0, 1, -1, 0.5, 1e-4, 9.99999e-5, -0.00012345678, 123456.5,
+                  999999.4, 999999.5, 1e6, 1.234565, 2.5e-7, 1e300, 9.9999951,
+                  0.001, 0.1, 100, 65536.25, 3.14159265358979});
+  hard.saveData(fname, ' ');
+  BOOST_CHECK_EQUAL( readFile(fname), formatWithStream(hard, ' ') );
+  remove(fname.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( save_load_binary, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  std::string fname = "save_load_binary.bin";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.test_5_10_comma_with_names, -1, 0, ",", true);
+  tsSet.normalize();
+  tsSet.saveDataBinary(fname);
+  BOOST_CHECK( TimeSeriesSet::isBinaryDataFile(fname) );
+  BOOST_CHECK( !TimeSeriesSet::isBinaryDataFile(data.test_5_10_space) );
+
+  TimeSeriesSet loaded;
+  loaded.loadDataBinary(fname);
+  BOOST_CHECK_EQUAL( loaded.getItemCount(), tsSet.getItemCount() );
+  BOOST_CHECK_EQUAL( loaded.getMaxLength(), tsSet.getMaxLength() );
+  BOOST_CHECK( loaded.isNormalized() );
+  for (int i = 0; i < tsSet.getItemCount(); i++) {
+    BOOST_CHECK_EQUAL( loaded.getTimeSeriesName(i), tsSet.getTimeSeriesName(i) );
+    BOOST_CHECK_EQUAL( loaded.getItemLength(i), tsSet.getItemLength(i) );
+    auto a = tsSet.getTimeSeries(i);
+    auto b = loaded.getTimeSeries(i);
+    for (int j = 0; j < a.getLength(); j++) {
+      BOOST_CHECK_EQUAL( a[j], b[j] );
+    }
+  }
+
+  // Uneven rows without names
+  tsSet.loadData(data.test_3_uneven_space, -1, 0, " ");
+  tsSet.saveDataBinary(fname);
+  loaded.loadDataBinary(fname);
+  BOOST_CHECK_EQUAL( loaded.getItemLength(0), 8 );
+  BOOST_CHECK_EQUAL( loaded.getTimeSeriesName(0), "0" );
+  BOOST_TEST( loaded.getTimeSeries(2, 3, 7)[0] == tsSet.getTimeSeries(2, 3, 7)[0] );
+
+  BOOST_CHECK_THROW( loaded.loadDataBinary(data.test_5_10_space), GenexException );
+  BOOST_CHECK( !loaded.isLoaded() );
+  remove(fname.c_str());
+}
+
 BOOST_AUTO_TEST_CASE( normalize_exception )
 {
   TimeSeriesSet tsSet;
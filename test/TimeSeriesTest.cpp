@@ -2,6 +2,7 @@
 
 #include <boost/test/unit_test.hpp>
 #include <cstdio>
+#include <cmath>
 #include "IO.hpp"
 #include "Exception.hpp"
 #include "TimeSeries.hpp"
@@ -70,6 +71,36 @@ BOOST_AUTO_TEST_CASE( time_series_addition, *boost::unit_test::tolerance(EPS) )
   }
 }
 
+BOOST_AUTO_TEST_CASE( time_series_average_stddev, *boost::unit_test::tolerance(EPS) )
+{
+  MockData data;
+  TimeSeries ts(data.dat, 0, 1, 6);
+  BOOST_TEST( ts.average() == 4.0 );
+  BOOST_TEST( ts.stddev() == sqrt(2.0) );
+
+  // Prefix sums of dat3 (one extra leading element)
+  data_t sum[11] = {0}, sumSquared[11] = {0};
+  for (int i = 0; i < 10; i++) {
+    sum[i + 1] = sum[i] + data.dat3[i];
+    sumSquared[i + 1] = sumSquared[i] + data.dat3[i] * data.dat3[i];
+  }
+  TimeSeries ts3(data.dat3, 0, 2, 9);
+  data_t expectedAverage = ts3.average();
+  data_t expectedStddev = ts3.stddev();
+  ts3.setPrefixSums(sum, sumSquared);
+  BOOST_CHECK( ts3.hasPrefixSums() );
+  BOOST_TEST( ts3.average() == expectedAverage );
+  BOOST_TEST( ts3.stddev() == expectedStddev );
+
+  TimeSeries constant(data.dat3, 0, 2, 3);
+  BOOST_TEST( constant.stddev() == 0.0 );
+
+  // Values far from zero keep their small deviation
+  data_t far[3] = {1e9, 1e9 + 1, 1e9 + 2};
+  TimeSeries offset(far, 0, 0, 3);
+  BOOST_TEST( offset.stddev() == sqrt(2.0 / 3) );
+}
+
 BOOST_AUTO_TEST_CASE( time_series_keogh_upper_lower, *boost::unit_test::tolerance(EPS) )
 {
   MockData data;
@@ -135,4 +166,24 @@ BOOST_AUTO_TEST_CASE( time_series_check_equal, *boost::unit_test::tolerance(EPS)
   TimeSeries ts1(data.dat, 7);
   TimeSeries ts2(data.dat, 7);
   TimeSeries ts3(7);
-}
\ No newline at end of file
+}
+BOOST_AUTO_TEST_CASE( time_series_resample, *boost::unit_test::tolerance(EPS) )
+{
+  MockData data;
+  // dat is linear, so it stays linear at any length
+  TimeSeries ts(data.dat, 0, 1, 6);
+  TimeSeries longer = ts.resample(9);
+  BOOST_CHECK_EQUAL( longer.getLength(), 9 );
+  for (int i = 0; i < 9; i++) {
+    BOOST_TEST( longer[i] == 2 + i * 0.5 );
+  }
+
+  TimeSeries ts3(data.dat3, 10);
+  TimeSeries shorter = ts3.resample(4);
+  data_t expected[4] = {0, 5, 3, 5};
+  for (int i = 0; i < 4; i++) {
+    BOOST_TEST( shorter[i] == expected[i] );
+  }
+  BOOST_CHECK( ts3.resample(10) == ts3 );
+  BOOST_CHECK_THROW( ts3.resample(0), GenexException );
+}
@@ -204,6 +204,55 @@ BOOST_AUTO_TEST_CASE( get_distance_metric, *boost::unit_test::tolerance(TOLERANC
   BOOST_CHECK(d);
 }
 
+BOOST_AUTO_TEST_CASE( znorm_distance, *boost::unit_test::tolerance(TOLERANCE) )
+{
+  MockData data;
+  data_t scaled[7];
+  for (int i = 0; i < 7; i++) {
+    scaled[i] = 3 * data.dat_11[i] - 7;
+  }
+  TimeSeries a{data.dat_11, 7};
+  TimeSeries b{scaled, 7};
+  TimeSeries c{data.dat_12, 7};
+
+  for (auto name : {"euclidean", "manhattan", "chebyshev", "cosine", "sorensen"}) {
+    BOOST_CHECK( getDistanceFromName(string(name) + ZNORM_SUFFIX) );
+    BOOST_CHECK( getDistanceFromName(string(name) + ZNORM_SUFFIX + DTW_SUFFIX) );
+    BOOST_CHECK( isZNormalizedDistance(string(name) + ZNORM_SUFFIX) );
+    BOOST_CHECK( !isZNormalizedDistance(name) );
+  }
+
+  // Shifted and scaled copies have the same shape
+  for (auto name : {"euclidean_znorm", "manhattan_znorm", "chebyshev_znorm"}) {
+    const dist_t pairwise = getDistanceFromName(name);
+    const dist_t warped = getDistanceFromName(string(name) + DTW_SUFFIX);
+    BOOST_TEST( pairwise(a, b, INF, gNoMatching) == 0.0 );
+    BOOST_TEST( warped(a, b, INF, gNoMatching) == 0.0 );
+    BOOST_CHECK( pairwise(a, c, INF, gNoMatching) > 0.0 );
+  }
+  BOOST_CHECK( data.euclidean_dist(a, b, INF, gNoMatching) > 0.0 );
+
+  // Compare against explicitly z-normalized copies
+  data_t meanA = a.average(), stdA = a.stddev();
+  data_t meanC = c.average(), stdC = c.stddev();
+  data_t normA[7], normC[7];
+  for (int i = 0; i < 7; i++) {
+    normA[i] = (data.dat_11[i] - meanA) / stdA;
+    normC[i] = (data.dat_12[i] - meanC) / stdC;
+  }
+  TimeSeries na{normA, 7};
+  TimeSeries nc{normC, 7};
+  BOOST_TEST( getDistanceFromName("euclidean_znorm")(a, c, INF, gNoMatching) ==
+              data.euclidean_dist(na, nc, INF, gNoMatching) );
+  BOOST_TEST( getDistanceFromName("manhattan_znorm_dtw")(a, c, INF, gNoMatching) ==
+              data.manhattan_warped_dist(na, nc, INF, gNoMatching) );
+
+  // A constant sequence is read as all zeros
+  TimeSeries constant{data.dat_7, 4};
+  TimeSeries zeros{data.dat_9, 4};
+  BOOST_TEST( getDistanceFromName("euclidean_znorm")(constant, zeros, INF, gNoMatching) == 0.0 );
+}
+
 BOOST_AUTO_TEST_CASE( distance_not_found )
 {
   BOOST_CHECK_THROW( getDistanceFromName("oracle"), GenexException );
@@ -0,0 +1,76 @@
+#define BOOST_TEST_MODULE "Test CentroidMatrix class"
+
+#include <boost/test/unit_test.hpp>
+#include <cstdint>
+
+#include "group/CentroidMatrix.hpp"
+#include "TimeSeriesSet.hpp"
+
+using namespace genex;
+
+BOOST_AUTO_TEST_CASE( centroid_matrix_rows )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+  int length = 13;
+  CentroidMatrix matrix(length);
+  BOOST_CHECK_EQUAL( matrix.getStride(), 16 );
+
+  // Enough rows to grow the matrix a few times
+  int count = 0;
+  for (int idx = 0; idx < tsSet.getItemCount(); idx++) {
+    BOOST_CHECK_EQUAL( matrix.add(tsSet.getTimeSeries(idx, 5, 5 + length)), count++ );
+  }
+  BOOST_CHECK_EQUAL( matrix.size(), count );
+
+  for (int idx = 0; idx < tsSet.getItemCount(); idx++) {
+    TimeSeries ts = tsSet.getTimeSeries(idx, 5, 5 + length);
+    const data_t* row = matrix.getRow(idx);
+    BOOST_CHECK_EQUAL( reinterpret_cast<std::uintptr_t>(row) % 64, 0 );
+    data_t norm = 0;
+    for (int i = 0; i < length; i++) {
+      BOOST_CHECK_EQUAL( row[i], ts[i] );
+      norm += ts[i] * ts[i];
+    }
+    BOOST_CHECK_CLOSE( matrix.getNorm(idx), norm, 1e-9 );
+    for (int i = length; i < matrix.getStride(); i++) {
+      BOOST_CHECK_EQUAL( row[i], 0 );
+    }
+  }
+
+  matrix.clear();
+  BOOST_CHECK_EQUAL( matrix.size(), 0 );
+}
+
+BOOST_AUTO_TEST_CASE( centroid_matrix_envelopes )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 20, 0, " ");
+  int length = 20;
+  CentroidMatrix matrix(length);
+  for (int idx = 0; idx < 10; idx++) {
+    matrix.add(tsSet.getTimeSeries(idx, 0, length));
+  }
+
+  for (int band : { 2, 5 }) {
+    BOOST_CHECK( matrix.prepareEnvelopes(band) );
+    BOOST_CHECK( !matrix.prepareEnvelopes(band) );
+    for (int idx = 0; idx < 10; idx++) {
+      TimeSeries ts = tsSet.getTimeSeries(idx, 0, length);
+      const data_t* lower = ts.getKeoghLower(band);
+      const data_t* upper = ts.getKeoghUpper(band);
+      for (int i = 0; i < length; i++) {
+        BOOST_CHECK_EQUAL( matrix.getLower(idx)[i], lower[i] );
+        BOOST_CHECK_EQUAL( matrix.getUpper(idx)[i], upper[i] );
+      }
+    }
+  }
+
+  // Only new rows are computed
+  matrix.add(tsSet.getTimeSeries(10, 0, length));
+  BOOST_CHECK( matrix.prepareEnvelopes(5) );
+  TimeSeries ts = tsSet.getTimeSeries(10, 0, length);
+  for (int i = 0; i < length; i++) {
+    BOOST_CHECK_EQUAL( matrix.getLower(10)[i], ts.getKeoghLower(5)[i] );
+  }
+}
@@ -1,7 +1,11 @@
 #define BOOST_TEST_MODULE "Test LocalLengthGroupSpace class"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <thread>
 #include "IO.hpp"
 #include "group/GlobalGroupSpace.hpp"
 #include "TimeSeriesSet.hpp"
@@ -130,4 +134,463 @@ BOOST_AUTO_TEST_CASE( global_group_space_save_load )
   BOOST_CHECK_EQUAL( ggs.getThreshold(), ggs2.getThreshold() );
   BOOST_CHECK_EQUAL( ggs.getTotalNumberOfGroups(), ggs2.getTotalNumberOfGroups() );
   remove(fname.c_str());
-}
\ No newline at end of file
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_deterministic_multi_threaded )
+{
+  MockData data;
+  std::string seqName = "global_group_space_deterministic_seq.txt";
+  std::string parName = "global_group_space_deterministic_par.txt";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 99, 0, " ");
+
+  GlobalGroupSpace seq(tsSet);
+  int seqCount = seq.group("euclidean", 0.3);
+
+  group_options_t options;
+  options.numThreads = 4;
+  options.deterministic = true;
+  GlobalGroupSpace par(tsSet);
+  int parCount = par.group("euclidean", 0.3, options);
+  BOOST_CHECK_EQUAL( seqCount, parCount );
+
+  // Same centroids and the same members in the same order
+  std::ofstream seqOut(seqName), parOut(parName);
+  seq.saveGroupsOld(seqOut, false);
+  par.saveGroupsOld(parOut, false);
+  seqOut.close();
+  parOut.close();
+
+  std::ifstream seqIn(seqName), parIn(parName);
+  std::string seqText((std::istreambuf_iterator<char>(seqIn)), std::istreambuf_iterator<char>());
+  std::string parText((std::istreambuf_iterator<char>(parIn)), std::istreambuf_iterator<char>());
+  BOOST_CHECK( seqText == parText );
+  remove(seqName.c_str());
+  remove(parName.c_str());
+}
+
+// Number of members over all groups, read back from the group size dump
+long countMembers(const GlobalGroupSpace& ggs)
+{
+  std::string fname = "global_group_space_count_members.txt";
+  std::ofstream fout(fname);
+  ggs.saveGroupsOld(fout, true);
+  fout.close();
+
+  std::ifstream fin(fname);
+  int minLen, maxLen;
+  std::string distance;
+  fin >> minLen >> maxLen >> distance;
+  long total = 0;
+  for (int len = minLen; len < maxLen; len++) {
+    int numGroups, count;
+    fin >> numGroups;
+    for (int i = 0; i < numGroups; i++) {
+      fin >> count;
+      total += count;
+    }
+  }
+  remove(fname.c_str());
+  return total;
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_intra_length_multi_threaded )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 99, 0, " ");
+  int n = tsSet.getItemCount();
+  int m = tsSet.getMaxLength();
+
+  // A single length still spreads over the threads
+  group_options_t options;
+  options.numThreads = 4;
+  options.wholeSeriesOnly = true;
+  GlobalGroupSpace gSet(tsSet);
+  BOOST_CHECK( gSet.group("euclidean", 0.3, options) > 0 );
+  BOOST_CHECK_EQUAL( countMembers(gSet), n );
+
+  // Every subsequence of every length lands in exactly one group
+  options.wholeSeriesOnly = false;
+  BOOST_CHECK( gSet.group("euclidean", 0.3, options) > 0 );
+  long expected = 0;
+  for (int len = 2; len <= m; len++) {
+    expected += (long)n * (m - len + 1);
+  }
+  BOOST_CHECK_EQUAL( countMembers(gSet), expected );
+
+  options.numThreads = 0;
+  BOOST_CHECK_THROW( gSet.group("euclidean", 0.3, options), GenexException );
+}
+
+// Centroids and members of all groups, as written by saveGroupsOld
+std::string groupText(const GlobalGroupSpace& ggs)
+{
+  std::string fname = "global_group_space_group_text.txt";
+  std::ofstream fout(fname);
+  ggs.saveGroupsOld(fout, false);
+  fout.close();
+
+  std::ifstream fin(fname);
+  std::string text((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+  remove(fname.c_str());
+  return text;
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_incremental )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 99, 0, " ");
+
+  // Extended distances, plain distances and non-metric distances
+  for (std::string distance : { "euclidean", "manhattan", "chebyshev", "cosine" }) {
+    GlobalGroupSpace plain(tsSet);
+    int plainCount = plain.group(distance, 0.3);
+
+    group_options_t options;
+    options.incremental = true;
+    GlobalGroupSpace incremental(tsSet);
+    BOOST_CHECK_EQUAL( incremental.group(distance, 0.3, options), plainCount );
+    BOOST_CHECK( groupText(plain) == groupText(incremental) );
+
+    options.centroidIndex = false;
+    options.triangleBounds = false;
+    BOOST_CHECK_EQUAL( incremental.group(distance, 0.3, options), plainCount );
+    BOOST_CHECK( groupText(plain) == groupText(incremental) );
+
+    options.numThreads = 4;
+    options.deterministic = true;
+    BOOST_CHECK_EQUAL( incremental.group(distance, 0.3, options), plainCount );
+    BOOST_CHECK( groupText(plain) == groupText(incremental) );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_sampled )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 99, 0, " ");
+
+  GlobalGroupSpace full(tsSet);
+  int fullCount = full.group("euclidean", 0.3);
+
+  // A sample of everything groups like full grouping
+  group_options_t options;
+  options.sampleRatio = 1;
+  GlobalGroupSpace sampled(tsSet);
+  BOOST_CHECK_EQUAL( sampled.group("euclidean", 0.3, options), fullCount );
+  BOOST_CHECK( groupText(full) == groupText(sampled) );
+  BOOST_CHECK_EQUAL( sampled.getGroupStats().sampledGroups, fullCount );
+
+  // Every subsequence is still grouped, into a comparable number of groups
+  options.sampleRatio = 0.2;
+  options.sampleSeed = 7;
+  options.deterministic = true;
+  int count = sampled.group("euclidean", 0.3, options);
+  group_stats_t stats = sampled.getGroupStats();
+  BOOST_CHECK_EQUAL( stats.subsequences, full.getGroupStats().subsequences );
+  BOOST_CHECK( stats.sampledGroups > 0 );
+  BOOST_CHECK( stats.sampledGroups <= count );
+  BOOST_CHECK( count > fullCount / 2 );
+  BOOST_CHECK( count < fullCount * 2 );
+  std::string text = groupText(sampled);
+
+  // The same sample gives the same groups with multiple threads
+  options.numThreads = 4;
+  BOOST_CHECK_EQUAL( sampled.group("euclidean", 0.3, options), count );
+  BOOST_CHECK( groupText(sampled) == text );
+
+  options.sampleRatio = 1.5;
+  BOOST_CHECK_THROW( sampled.group("euclidean", 0.3, options), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_stride )
+{
+  MockData data;
+  std::string fname = "global_group_space_stride.z";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace full(tsSet);
+  full.group("euclidean", 0.2);
+
+  group_options_t options;
+  options.stride = 3;
+  GlobalGroupSpace strided(tsSet);
+  strided.group("euclidean", 0.2, options);
+
+  // About a third of the subsequences are grouped
+  long all = full.getGroupStats().subsequences;
+  long grouped = strided.getGroupStats().subsequences;
+  BOOST_CHECK( grouped * 2 < all );
+  BOOST_CHECK( grouped * 4 > all );
+  BOOST_CHECK( strided.getTotalNumberOfGroups() < full.getTotalNumberOfGroups() );
+
+  // The stride is saved with the groups
+  saveToFile(strided, fname);
+  GlobalGroupSpace loaded(tsSet);
+  loadFromFile(loaded, fname);
+  auto query = tsSet.getTimeSeries(3, 7, 19);
+  bool same = strided.getBestMatch(query) == loaded.getBestMatch(query);
+  BOOST_TEST( same );
+  remove(fname.c_str());
+
+  options.stride = 0;
+  BOOST_CHECK_THROW( strided.group("euclidean", 0.2, options), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_stride_k_best )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  group_options_t options;
+  options.stride = 2;
+  GlobalGroupSpace strided(tsSet);
+  strided.group("euclidean", 0.2, options);
+
+  // Odd starts are not grouped, but are compared around the members of
+  // every group k-NN visits. Scanning only the members of the groups after
+  // the top one misses these exact matches
+  vector< std::pair<int, int> > queries = { {0, 5}, {0, 7}, {11, 1}, {11, 3}, {13, 7} };
+  for (auto& q : queries) {
+    auto query = tsSet.getTimeSeries(q.first, q.second, q.second + 12);
+    auto best = strided.getKBestMatches(query, 20);
+    bool exact = std::any_of(best.begin(), best.end(), [&](const candidate_time_series_t& c) {
+      return c.dist < EPS && c.data.getIndex() == q.first && c.data.getStart() == q.second;
+    });
+    BOOST_CHECK( exact );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_buckets )
+{
+  MockData data;
+  std::string fname = "global_group_space_buckets.z";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace full(tsSet);
+  full.group("euclidean", 0.2);
+
+  group_options_t options;
+  options.bucketRatio = 1.5;
+  GlobalGroupSpace bucketed(tsSet);
+  bucketed.group("euclidean", 0.2, options);
+
+  // Every subsequence is grouped, into fewer groups
+  BOOST_CHECK_EQUAL( bucketed.getGroupStats().subsequences, full.getGroupStats().subsequences );
+  BOOST_CHECK( bucketed.getTotalNumberOfGroups() < full.getTotalNumberOfGroups() );
+
+  // Groups are chosen by resampled centroids, so a subsequence is not always
+  // found exactly, but within the radius of a group
+  for (int length = 5; length <= 24; length += 4) {
+    auto query = tsSet.getTimeSeries(3, 0, length);
+    BOOST_TEST( bucketed.getBestMatch(query).dist <= 0.1 );
+  }
+  auto query = tsSet.getTimeSeries(3, 2, 19);
+  auto best = bucketed.getKBestMatches(query, 3);
+  BOOST_CHECK_EQUAL( best.size(), 3 );
+
+  // The buckets are saved with the groups
+  saveToFile(bucketed, fname);
+  GlobalGroupSpace loaded(tsSet);
+  loadFromFile(loaded, fname);
+  BOOST_CHECK_EQUAL( loaded.getTotalNumberOfGroups(), bucketed.getTotalNumberOfGroups() );
+  bool same = bucketed.getBestMatch(query) == loaded.getBestMatch(query);
+  BOOST_TEST( same );
+  remove(fname.c_str());
+
+  options.incremental = true;
+  BOOST_CHECK_THROW( bucketed.group("euclidean", 0.2, options), GenexException );
+  options.incremental = false;
+  options.bucketRatio = 0.5;
+  BOOST_CHECK_THROW( bucketed.group("euclidean", 0.2, options), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_k_best_pruned )
+{
+  MockData data;
+  std::string fname = "global_group_space_k_best_pruned.txt";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace ggs(tsSet);
+  ggs.group("euclidean", 0.2);
+
+  // Groups in the old format have no member envelope, so none is skipped
+  std::ofstream fout(fname);
+  ggs.saveGroupsOld(fout, false);
+  fout.close();
+  GlobalGroupSpace unbounded(tsSet);
+  std::ifstream fin(fname);
+  unbounded.loadGroupsOld(fin);
+  fin.close();
+
+  auto byDistance = [](const candidate_time_series_t& a, const candidate_time_series_t& b) {
+    return a.dist < b.dist;
+  };
+  int k = 5;
+  for (int length = 6; length <= 24; length += 6) {
+    auto query = tsSet.getTimeSeries(4, 0, length);
+    auto pruned = ggs.getKBestMatches(query, k);
+    auto all = unbounded.getKBestMatches(query, k);
+    BOOST_REQUIRE( pruned.size() >= k );
+    BOOST_CHECK( pruned.size() <= all.size() );
+    std::sort(pruned.begin(), pruned.end(), byDistance);
+    std::sort(all.begin(), all.end(), byDistance);
+    for (int i = 0; i < k; i++) {
+      BOOST_CHECK_CLOSE( pruned[i].dist, all[i].dist, TOLERANCE );
+    }
+  }
+  remove(fname.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_refined )
+{
+  MockData data;
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace full(tsSet);
+  full.group("euclidean", 0.2);
+
+  group_options_t options;
+  options.refineIterations = 1;
+  options.deterministic = true;
+  GlobalGroupSpace refined(tsSet);
+  int count = refined.group("euclidean", 0.2, options);
+  group_stats_t stats = refined.getGroupStats();
+  BOOST_CHECK_EQUAL( stats.subsequences, full.getGroupStats().subsequences );
+  BOOST_CHECK_EQUAL( stats.unrefinedGroups, full.getTotalNumberOfGroups() );
+  BOOST_CHECK( stats.refinedRadius > 0 );
+  std::string text = groupText(refined);
+
+  // Medoids are found the same way with multiple threads
+  options.numThreads = 4;
+  BOOST_CHECK_EQUAL( refined.group("euclidean", 0.2, options), count );
+  BOOST_CHECK( groupText(refined) == text );
+
+  // Subsequences of the dataset are still found exactly
+  auto query = tsSet.getTimeSeries(3, 2, 19);
+  BOOST_TEST( refined.getBestMatch(query).dist < EPS );
+
+  options.refineIterations = -1;
+  BOOST_CHECK_THROW( refined.group("euclidean", 0.2, options), GenexException );
+  options.refineIterations = 1;
+  options.incremental = true;
+  BOOST_CHECK_THROW( refined.group("euclidean", 0.2, options), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_levels )
+{
+  MockData data;
+  std::string fname = "global_group_space_levels.z";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace plain(tsSet);
+  plain.group("euclidean", 0.2);
+
+  group_options_t options;
+  options.levelThresholds = { 0.4, 0.8 };
+  GlobalGroupSpace leveled(tsSet);
+  BOOST_CHECK_EQUAL( leveled.group("euclidean", 0.2, options), plain.getTotalNumberOfGroups() );
+  BOOST_REQUIRE_EQUAL( leveled.getNumberOfLevels(), 3 );
+  BOOST_CHECK_EQUAL( leveled.getLevelThreshold(0), 0.2 );
+  BOOST_CHECK_EQUAL( leveled.getLevelThreshold(2), 0.8 );
+
+  // Level 0 answers exactly, levels above with matches no closer
+  auto query = tsSet.getTimeSeries(3, 2, 19);
+  auto exact = plain.getBestMatch(query);
+  auto exactK = plain.getKBestMatches(query, 5);
+  BOOST_CHECK( leveled.getBestMatch(query) == exact );
+  BOOST_CHECK_EQUAL( leveled.getKBestMatches(query, 5).size(), exactK.size() );
+  for (int level = 1; level < 3; level++) {
+    leveled.setQueryLevel(level);
+    BOOST_CHECK( leveled.getBestMatch(query).dist >= exact.dist );
+    BOOST_CHECK( leveled.getKBestMatches(query, 5).size() >= 5 );
+  }
+  BOOST_CHECK_THROW( leveled.setQueryLevel(3), GenexException );
+  BOOST_CHECK_THROW( leveled.setQueryLevel(-1), GenexException );
+
+  // The levels are saved, and loading searches level 0 again
+  saveToFile(leveled, fname);
+  GlobalGroupSpace loaded(tsSet);
+  loadFromFile(loaded, fname);
+  BOOST_REQUIRE_EQUAL( loaded.getNumberOfLevels(), 3 );
+  BOOST_CHECK( loaded.getBestMatch(query) == exact );
+  loaded.setQueryLevel(2);
+  BOOST_CHECK( loaded.getBestMatch(query) == leveled.getBestMatch(query) );
+  remove(fname.c_str());
+
+  options.levelThresholds = { 0.1 };
+  BOOST_CHECK_THROW( leveled.group("euclidean", 0.2, options), GenexException );
+  options.levelThresholds = { 0.8, 0.4 };
+  BOOST_CHECK_THROW( leveled.group("euclidean", 0.2, options), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( global_group_space_lazy )
+{
+  MockData data;
+  std::string fname = "global_group_space_lazy.z";
+  TimeSeriesSet tsSet;
+  tsSet.loadData(data.ItalyPowerDemand, 20, 0, " ");
+
+  GlobalGroupSpace eager(tsSet);
+  eager.group("euclidean", 0.2);
+
+  group_options_t options;
+  options.lazy = true;
+  options.numThreads = 2;
+  GlobalGroupSpace lazy(tsSet);
+  BOOST_CHECK_EQUAL( lazy.group("euclidean", 0.2, options), 0 );
+  BOOST_CHECK_EQUAL( lazy.getTotalNumberOfGroups(), 0 );
+
+  // Only the lengths around the query are built, with the groups of eager grouping
+  auto query = tsSet.getTimeSeries(3, 2, 12);
+  BOOST_CHECK( lazy.getBestMatch(query) == eager.getBestMatch(query) );
+  BOOST_CHECK( lazy.getTotalNumberOfGroups() > 0 );
+  BOOST_CHECK( lazy.getTotalNumberOfGroups() < eager.getTotalNumberOfGroups() );
+
+  // Concurrent queries of a length not built yet
+  auto longQuery = tsSet.getTimeSeries(5, 0, 20);
+  auto longBest = eager.getBestMatch(longQuery);
+  auto longKBest = eager.getKBestMatches(longQuery, 3);
+  vector<candidate_time_series_t> found(4);
+  vector<std::thread> threads;
+  for (auto i = 0; i < found.size(); i++) {
+    threads.emplace_back([&lazy, &longQuery, &found, i] {
+      found[i] = lazy.getBestMatch(longQuery);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  for (auto i = 0; i < found.size(); i++) {
+    BOOST_CHECK( found[i] == longBest );
+  }
+  BOOST_CHECK_EQUAL( lazy.getKBestMatches(longQuery, 3).size(), longKBest.size() );
+
+  // Saving needs all lengths
+  BOOST_CHECK_THROW( saveToFile(lazy, fname), GenexException );
+  lazy.buildAllSpaces();
+  BOOST_CHECK_EQUAL( lazy.getTotalNumberOfGroups(), eager.getTotalNumberOfGroups() );
+  saveToFile(lazy, fname);
+  GlobalGroupSpace loaded(tsSet);
+  loadFromFile(loaded, fname);
+  BOOST_CHECK_EQUAL( loaded.getTotalNumberOfGroups(), eager.getTotalNumberOfGroups() );
+  remove(fname.c_str());
+
+  // Grouping again drops the builds of the previous grouping
+  lazy.getBestMatch(tsSet.getTimeSeries(1, 0, 8));
+  BOOST_CHECK_EQUAL( lazy.group("euclidean", 0.2, options), 0 );
+
+  options.incremental = true;
+  BOOST_CHECK_THROW( lazy.group("euclidean", 0.2, options), GenexException );
+  options.incremental = false;
+  options.lazyPrefetch = -1;
+  BOOST_CHECK_THROW( lazy.group("euclidean", 0.2, options), GenexException );
+}
@@ -80,6 +80,32 @@ BOOST_AUTO_TEST_CASE( groupable_time_series_save_load )
   remove(fname.c_str());  
 }
 
+BOOST_AUTO_TEST_CASE( groupable_time_series_znorm_group_save_load )
+{
+  GroupableTimeSeriesSet tsSet;
+  std::string fname = "groupable_time_series_znorm_group_save_load.z";
+  tsSet.loadData(data.test_3_10_space, 0, 0, " ");
+  tsSet.groupAllLengths("euclidean_znorm", 0.5, 1, false);
+  BOOST_CHECK( tsSet.hasPrefixSums() );
+  candidate_time_series_t best = tsSet.getBestMatch(tsSet.getTimeSeries(0));
+  BOOST_TEST( best.dist == 0.0 );
+
+  saveToFile(tsSet, fname);
+
+  GroupableTimeSeriesSet tsSet2;
+  tsSet2.loadData(data.test_3_10_space, 0, 0, " ");
+  loadFromFile(tsSet2, fname);
+  BOOST_CHECK_EQUAL( tsSet2.getDistanceName(), "euclidean_znorm" );
+  BOOST_CHECK( tsSet2.hasPrefixSums() );
+  BOOST_CHECK_EQUAL( tsSet.getTotalNumberOfGroups(), tsSet2.getTotalNumberOfGroups() );
+
+  auto results = tsSet2.getKBestMatches(tsSet2.getTimeSeries(1), 1, 5);
+  auto bruteForce = tsSet2.getKBestMatchesBruteForce(tsSet2.getTimeSeries(1), 1, "euclidean_znorm");
+  BOOST_TEST( results[0].dist == 0.0 );
+  BOOST_TEST( bruteForce[0].dist == 0.0 );
+  remove(fname.c_str());
+}
+
 BOOST_AUTO_TEST_CASE( groupable_time_series_save_load_incompatible )
 {
  GroupableTimeSeriesSet tsSet;
@@ -142,3 +142,42 @@ BOOST_AUTO_TEST_CASE( group_save_and_load , *boost::unit_test::tolerance(EPS) )
   delete group;
   delete group2;
 }
+
+BOOST_AUTO_TEST_CASE( group_encoded_members )
+{
+  MockData data;
+  auto dataset = TimeSeriesSet();
+  dataset.loadData(data.test_3_10_space, 0, 0, " ");
+  int length = 4;
+  int subTimeSeriesCount = dataset.getMaxLength() - length + 1;
+  auto memberMap = std::vector<group_membership_t>(dataset.getItemCount() * subTimeSeriesCount);
+  Group group(0, length, subTimeSeriesCount, dataset, memberMap);
+  group.setCentroid(1, 2);
+  group.addMember(0, 0);
+  group.addMember(2, 4);
+  group.addMember(1, 3);
+  group.addMember(0, 6);
+
+  std::vector<uint8_t> bytes;
+  group.encodeMembers(bytes);
+  // One byte per member for small steps between positions
+  BOOST_CHECK_EQUAL( bytes.size(), 4 );
+
+  auto listed = group.getMembers();
+  group.setEncodedMembers(bytes.data());
+  // The member map is no longer read
+  std::fill(memberMap.begin(), memberMap.end(), group_membership_t(-1, -1));
+  auto decoded = group.getMembers();
+  BOOST_REQUIRE_EQUAL( listed.size(), decoded.size() );
+  for (auto i = 0; i < listed.size(); i++) {
+    BOOST_CHECK_EQUAL( listed[i], decoded[i] );
+  }
+
+  // Adding a member goes back to the member list
+  group.addMember(2, 0);
+  auto members = group.getMembers();
+  BOOST_REQUIRE_EQUAL( members.size(), 5 );
+  BOOST_CHECK_EQUAL( members[0], dataset.getTimeSeries(2, 0, 4) );
+  BOOST_CHECK_EQUAL( members[1], listed[0] );
+  BOOST_CHECK_EQUAL( members[4], listed[3] );
+}
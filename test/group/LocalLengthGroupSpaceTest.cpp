@@ -1,7 +1,9 @@
 #define BOOST_TEST_MODULE "Test LocalLengthGroupSpace class"
 
 #include <boost/test/unit_test.hpp>
+#include <algorithm>
 #include <cstdio>
+#include <future>
 #include "IO.hpp"
 #include "group/LocalLengthGroupSpace.hpp"
 #include "TimeSeriesSet.hpp"
@@ -9,6 +11,7 @@
 #include "distance/Distance.hpp"
 #include "Exception.hpp"
 #include "group/Group.hpp"
+#include "lib/DotProducts.hpp"
 
 using namespace genex;
 
@@ -104,4 +107,674 @@ BOOST_AUTO_TEST_CASE( groups_save_and_load, *boost::unit_test::tolerance(EPS) )
   BOOST_CHECK_EQUAL( groups.getNumberOfGroups(), groups2.getNumberOfGroups() );
 
   remove(fname.c_str());
-}
\ No newline at end of file
+}
+
+void checkSameGroups(const LocalLengthGroupSpace& a, const LocalLengthGroupSpace& b)
+{
+  BOOST_REQUIRE_EQUAL( a.getNumberOfGroups(), b.getNumberOfGroups() );
+  for (int i = 0; i < a.getNumberOfGroups(); i++) {
+    const TimeSeries& c1 = a.getGroup(i)->getCentroid();
+    const TimeSeries& c2 = b.getGroup(i)->getCentroid();
+    BOOST_CHECK_EQUAL( c1.getIndex(), c2.getIndex() );
+    BOOST_CHECK_EQUAL( c1.getStart(), c2.getStart() );
+
+    auto m1 = a.getGroup(i)->getMembers();
+    auto m2 = b.getGroup(i)->getMembers();
+    BOOST_REQUIRE_EQUAL( m1.size(), m2.size() );
+    for (int j = 0; j < m1.size(); j++) {
+      BOOST_CHECK_EQUAL( m1[j].getIndex(), m2[j].getIndex() );
+      BOOST_CHECK_EQUAL( m1[j].getStart(), m2[j].getStart() );
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_centroid_index )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+  setWarpingBandRatio(0.1);
+
+  LocalLengthGroupSpace plain(tsSet, 12);
+  plain.generateGroups(pairwise, 0.2);
+
+  LocalLengthGroupSpace indexed(tsSet, 12);
+  indexed.enableCentroidIndex(pairwise);
+  BOOST_CHECK( indexed.hasCentroidIndex() );
+  indexed.generateGroups(pairwise, 0.2);
+
+  // Same groups as scanning every centroid
+  BOOST_CHECK( plain.getNumberOfGroups() > 20 );
+  checkSameGroups(plain, indexed);
+
+  // Same ranking of groups for queries of nearby lengths
+  for (int q = 0; q < tsSet.getItemCount(); q += 5) {
+    for (int len : { 11, 12, 13 }) {
+      TimeSeries query = tsSet.getTimeSeries(q, 4, 4 + len);
+      auto best1 = plain.getBestGroup(query, cascadeDistance, INF);
+      auto best2 = indexed.getBestGroup(query, cascadeDistance, INF);
+      BOOST_REQUIRE( best1.first != nullptr );
+      BOOST_REQUIRE( best2.first != nullptr );
+      BOOST_CHECK_EQUAL( best1.first->getCentroid().getIndex(), best2.first->getCentroid().getIndex() );
+      BOOST_CHECK_EQUAL( best1.first->getCentroid().getStart(), best2.first->getCentroid().getStart() );
+      BOOST_CHECK_EQUAL( best1.second, best2.second );
+
+      std::vector<group_index_t> k1, k2;
+      int r1 = plain.interLevelKSim(query, cascadeDistance, k1, 30);
+      int r2 = indexed.interLevelKSim(query, cascadeDistance, k2, 30);
+      BOOST_CHECK_EQUAL( r1, r2 );
+      std::sort_heap(k1.begin(), k1.end());
+      std::sort_heap(k2.begin(), k2.end());
+      BOOST_REQUIRE_EQUAL( k1.size(), k2.size() );
+      for (int i = 0; i < k1.size(); i++) {
+        BOOST_CHECK_EQUAL( k1[i].index, k2[i].index );
+      }
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_centroid_index_save_load )
+{
+  std::string fname = "local_length_group_space_centroid_index_save_load.z";
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace groups(tsSet, 12);
+  groups.enableCentroidIndex(pairwise);
+  groups.generateGroups(pairwise, 0.2);
+  saveToFile(groups, fname);
+
+  LocalLengthGroupSpace groups2(tsSet, 12);
+  loadFromFile(groups2, fname);
+  BOOST_CHECK_EQUAL( groups.getNumberOfGroups(), groups2.getNumberOfGroups() );
+  groups2.enableCentroidIndex(pairwise);
+  BOOST_CHECK( groups2.hasCentroidIndex() );
+
+  TimeSeries query = tsSet.getTimeSeries(3, 2, 14);
+  auto best1 = groups.getBestGroup(query, cascadeDistance, INF);
+  auto best2 = groups2.getBestGroup(query, cascadeDistance, INF);
+  BOOST_CHECK_EQUAL( best1.second, best2.second );
+  remove(fname.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_triangle_bounds )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  for (data_t threshold : { 0.1, 0.3 }) {
+    LocalLengthGroupSpace plain(tsSet, 16);
+    plain.generateGroups(pairwise, threshold);
+
+    // Linear scan
+    LocalLengthGroupSpace bounded(tsSet, 16);
+    bounded.enableTriangleBounds();
+    bounded.generateGroups(pairwise, threshold);
+    checkSameGroups(plain, bounded);
+
+    // With the centroid index
+    LocalLengthGroupSpace both(tsSet, 16);
+    both.enableCentroidIndex(pairwise);
+    both.enableTriangleBounds();
+    both.generateGroups(pairwise, threshold);
+    checkSameGroups(plain, both);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( dot_products, *boost::unit_test::tolerance(EPS) )
+{
+  // Sizes that are not multiples of the tiles and span several blocks
+  int rowsA = 7, rowsB = 70, length = 300, strideA = 301, strideB = 304, strideOut = 71;
+  std::vector<data_t> a(rowsA * strideA), b(rowsB * strideB), out(rowsA * strideOut, -1);
+  for (int i = 0; i < a.size(); i++) {
+    a[i] = (i * 37 % 101) / 101.0 - 0.5;
+  }
+  for (int i = 0; i < b.size(); i++) {
+    b[i] = (i * 53 % 97) / 97.0 - 0.5;
+  }
+  dotProducts(a.data(), rowsA, strideA, b.data(), rowsB, strideB, length, out.data(), strideOut);
+
+  for (int i = 0; i < rowsA; i++) {
+    for (int j = 0; j < rowsB; j++) {
+      data_t expected = 0;
+      for (int k = 0; k < length; k++) {
+        expected += a[i * strideA + k] * b[j * strideB + k];
+      }
+      BOOST_TEST( out[i * strideOut + j] == expected );
+    }
+    // Values past the last row of b are not written
+    BOOST_TEST( out[i * strideOut + rowsB] == -1 );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_batched )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  for (data_t threshold : { 0.1, 0.3 }) {
+    LocalLengthGroupSpace plain(tsSet, 16);
+    plain.generateGroups(pairwise, threshold);
+
+    LocalLengthGroupSpace batched(tsSet, 16);
+    batched.enableBatching();
+    batched.generateGroups(pairwise, threshold);
+    checkSameGroups(plain, batched);
+  }
+
+  // Other distances are grouped as before
+  dist_t manhattan = getDistanceFromName("manhattan");
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(manhattan, 0.2);
+  LocalLengthGroupSpace batched(tsSet, 16);
+  batched.enableBatching();
+  batched.generateGroups(manhattan, 0.2);
+  checkSameGroups(plain, batched);
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_ordered )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  for (std::string name : { "euclidean", "manhattan", "chebyshev", "cosine" }) {
+    dist_t pairwise = getDistanceFromName(name);
+    LocalLengthGroupSpace plain(tsSet, 16);
+    plain.generateGroups(pairwise, 0.2);
+
+    LocalLengthGroupSpace ordered(tsSet, 16);
+    ordered.enableOrdering(isMeanBoundedDistance(name));
+    ordered.generateGroups(pairwise, 0.2);
+    checkSameGroups(plain, ordered);
+
+    // Every subsequence is counted. Cosine cannot abandon a comparison early,
+    // so only the other distances compare fewer points.
+    const group_stats_t& s1 = plain.getGroupStats();
+    const group_stats_t& s2 = ordered.getGroupStats();
+    BOOST_CHECK_EQUAL( s1.subsequences, tsSet.getItemCount() * (24 - 16 + 1) );
+    BOOST_CHECK_EQUAL( s1.subsequences, s2.subsequences );
+    BOOST_CHECK( s1.points > 0 );
+    if (isMeanBoundedDistance(name)) {
+      BOOST_CHECK( s2.points < s1.points );
+    }
+  }
+
+  // Combined with the centroid index and triangle bounds
+  dist_t pairwise = getDistanceFromName("euclidean");
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(pairwise, 0.2);
+  LocalLengthGroupSpace all(tsSet, 16);
+  all.enableCentroidIndex(pairwise);
+  all.enableTriangleBounds();
+  all.enableOrdering(true);
+  all.generateGroups(pairwise, 0.2);
+  checkSameGroups(plain, all);
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_sampled )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace sampled(tsSet, 16);
+  sampled.enableSampling(0.1, 3);
+  sampled.generateGroups(pairwise, 0.2);
+
+  // Each subsequence joins exactly one group, within threshold / 2 of its centroid
+  int members = 0;
+  for (int i = 0; i < sampled.getNumberOfGroups(); i++) {
+    const Group* g = sampled.getGroup(i);
+    for (auto& m : g->getMembers()) {
+      BOOST_CHECK( g->distanceFromCentroid(m, pairwise, INF) <= 0.1 + EPS );
+      members++;
+    }
+  }
+  BOOST_CHECK_EQUAL( members, tsSet.getItemCount() * (24 - 16 + 1) );
+  BOOST_CHECK( sampled.getGroupStats().sampledGroups > 0 );
+
+  BOOST_CHECK_THROW( sampled.enableSampling(0, 3), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_stride )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 20, 0, " ");
+
+  LocalLengthGroupSpace strided(tsSet, 12);
+  strided.setStride(3);
+  strided.generateGroups(pairwise, 0.2);
+  BOOST_CHECK_EQUAL( strided.getStride(), 3 );
+
+  // Only starts at multiples of the stride are members, but the starts next
+  // to a member are found within its group
+  dist_t warped = getDistanceFromName("euclidean_dtw");
+  int members = 0;
+  for (int i = 0; i < strided.getNumberOfGroups(); i++) {
+    const Group* g = strided.getGroup(i);
+    for (auto& m : g->getMembers()) {
+      BOOST_CHECK_EQUAL( m.getStart() % 3, 0 );
+      members++;
+      for (int start : { m.getStart() - 2, m.getStart() + 1 }) {
+        if (start >= 0 && start + 12 <= tsSet.getItemLength(m.getIndex())) {
+          auto best = g->getBestMatch(tsSet.getTimeSeries(m.getIndex(), start, start + 12), warped);
+          BOOST_CHECK( best.dist < EPS );
+        }
+      }
+    }
+  }
+  BOOST_CHECK_EQUAL( members, 20 * 5 );
+  BOOST_CHECK_THROW( strided.setStride(0), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_too_many_subsequences )
+{
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 20, 0, " ");
+
+  // Members are linked by 32-bit slots, which a bucket of this many lengths
+  // would overflow
+  long perLength = 20L * (tsSet.getMaxLength() - 2 + 1);
+  int lengthCount = INT32_MAX / perLength + 1;
+  BOOST_CHECK_THROW( LocalLengthGroupSpace(tsSet, 2, lengthCount), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_hashed )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+  long subsequences = tsSet.getItemCount() * (24 - 16 + 1);
+
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(pairwise, 0.2);
+
+  // Buckets wider than any projection put all centroids in one bucket, which
+  // amounts to the exact scan
+  LocalLengthGroupSpace wide(tsSet, 16);
+  wide.enableHashing(1, 1e6, true);
+  wide.generateGroups(pairwise, 0.2);
+  checkSameGroups(plain, wide);
+  BOOST_CHECK_EQUAL( wide.getGroupStats().verifiedAssignments, subsequences );
+  BOOST_CHECK_EQUAL( wide.getGroupStats().differingAssignments, 0 );
+
+  // Narrow buckets compare fewer centroids and may miss the closest one, but
+  // each subsequence still joins a group within threshold / 2
+  LocalLengthGroupSpace hashed(tsSet, 16);
+  hashed.enableHashing(2, 1, true);
+  hashed.generateGroups(pairwise, 0.2);
+  int members = 0;
+  for (int i = 0; i < hashed.getNumberOfGroups(); i++) {
+    const Group* g = hashed.getGroup(i);
+    for (auto& m : g->getMembers()) {
+      BOOST_CHECK( g->distanceFromCentroid(m, pairwise, INF) <= 0.1 + EPS );
+      members++;
+    }
+  }
+  BOOST_CHECK_EQUAL( members, subsequences );
+  const group_stats_t& stats = hashed.getGroupStats();
+  BOOST_CHECK_EQUAL( stats.verifiedAssignments, subsequences );
+  BOOST_CHECK( stats.differingAssignments <= stats.verifiedAssignments );
+  BOOST_CHECK( stats.comparisons < plain.getGroupStats().comparisons );
+
+  // Other distances are grouped as before
+  dist_t manhattan = getDistanceFromName("manhattan");
+  LocalLengthGroupSpace plainManhattan(tsSet, 16);
+  plainManhattan.generateGroups(manhattan, 0.2);
+  LocalLengthGroupSpace hashedManhattan(tsSet, 16);
+  hashedManhattan.enableHashing(2, 1, true);
+  hashedManhattan.generateGroups(manhattan, 0.2);
+  checkSameGroups(plainManhattan, hashedManhattan);
+  BOOST_CHECK_EQUAL( hashedManhattan.getGroupStats().verifiedAssignments, 0 );
+
+  BOOST_CHECK_THROW( hashed.enableHashing(0, 1, false), GenexException );
+  BOOST_CHECK_THROW( hashed.enableHashing(2, 0, false), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_bounds )
+{
+  std::string fname = "local_length_group_space_bounds.z";
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 20, 0, " ");
+
+  LocalLengthGroupSpace groups(tsSet, 12);
+  groups.generateGroups(pairwise, 0.2);
+
+  // Members are within the radius and inside the envelope, and the envelope
+  // bounds the distance from queries of any length to each member
+  std::vector<TimeSeries> queries = {
+    tsSet.getTimeSeries(3, 2, 14), tsSet.getTimeSeries(7, 0, 10), tsSet.getTimeSeries(11, 5, 20)
+  };
+  for (int i = 0; i < groups.getNumberOfGroups(); i++) {
+    const Group* g = groups.getGroup(i);
+    BOOST_REQUIRE( g->hasMemberEnvelope() );
+    BOOST_CHECK( g->getRadius() <= 0.1 );
+    for (auto& m : g->getMembers()) {
+      BOOST_CHECK( g->distanceFromCentroid(m, pairwise, INF) <= g->getRadius() + EPS );
+      BOOST_CHECK_EQUAL( g->memberLowerBound(m), 0 );
+      for (auto& q : queries) {
+        BOOST_CHECK( g->memberLowerBound(q) <= cascadeDistance(q, m, INF, gNoMatching) + EPS );
+      }
+    }
+  }
+
+  saveToFile(groups, fname);
+  LocalLengthGroupSpace groups2(tsSet, 12);
+  loadFromFile(groups2, fname);
+  for (int i = 0; i < groups.getNumberOfGroups(); i++) {
+    BOOST_CHECK_EQUAL( groups.getGroup(i)->getRadius(), groups2.getGroup(i)->getRadius() );
+    for (auto& q : queries) {
+      BOOST_CHECK_EQUAL( groups.getGroup(i)->memberLowerBound(q),
+                         groups2.getGroup(i)->memberLowerBound(q) );
+    }
+  }
+  remove(fname.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_member_distances )
+{
+  std::string fname = "local_length_group_space_member_distances.z";
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 20, 0, " ");
+  setWarpingBandRatio(0.1);
+
+  LocalLengthGroupSpace groups(tsSet, 12);
+  groups.generateGroups(pairwise, 0.4);
+
+  std::vector<TimeSeries> queries = {
+    tsSet.getTimeSeries(3, 2, 14), tsSet.getTimeSeries(7, 1, 12), tsSet.getTimeSeries(11, 5, 18)
+  };
+  for (int i = 0; i < groups.getNumberOfGroups(); i++) {
+    const Group* g = groups.getGroup(i);
+    BOOST_REQUIRE( g->hasMemberDistances() );
+
+    // Members stay newest first, in decreasing position, so that they encode
+    // in one or two bytes each
+    auto members = g->getMembers();
+    for (int j = 1; j < members.size(); j++) {
+      auto before = std::make_pair(members[j - 1].getStart(), members[j - 1].getIndex());
+      auto after = std::make_pair(members[j].getStart(), members[j].getIndex());
+      BOOST_CHECK( after < before );
+    }
+
+    // Skipping members finds the same distances as comparing every member
+    for (auto& q : queries) {
+      std::vector<data_t> all;
+      for (auto& m : members) {
+        all.push_back(cascadeDistance(q, m, INF, gNoMatching));
+      }
+      std::sort(all.begin(), all.end());
+      BOOST_CHECK_CLOSE( g->getBestMatch(q, cascadeDistance).dist, all[0], 1e-9 );
+
+      int k = std::min(3, (int)all.size());
+      auto best = g->intraGroupKSim(q, k, cascadeDistance);
+      std::sort(best.begin(), best.end());
+      BOOST_REQUIRE_EQUAL( best.size(), k );
+      for (int j = 0; j < k; j++) {
+        BOOST_CHECK_CLOSE( best[j].dist, all[j], 1e-9 );
+      }
+    }
+  }
+
+  // The distances are saved with the groups
+  saveToFile(groups, fname);
+  LocalLengthGroupSpace groups2(tsSet, 12);
+  loadFromFile(groups2, fname);
+  checkSameGroups(groups, groups2);
+  for (int i = 0; i < groups2.getNumberOfGroups(); i++) {
+    BOOST_CHECK( groups2.getGroup(i)->hasMemberDistances() );
+  }
+  remove(fname.c_str());
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_refined )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(pairwise, 0.2);
+
+  LocalLengthGroupSpace refined(tsSet, 16);
+  refined.enableRefinement(2);
+  refined.generateGroups(pairwise, 0.2);
+
+  // Each subsequence joins exactly one group, within threshold / 2 of its
+  // centroid, which is one of its members
+  int members = 0;
+  double radius = 0;
+  for (int i = 0; i < refined.getNumberOfGroups(); i++) {
+    const Group* g = refined.getGroup(i);
+    bool centroidIsMember = false;
+    for (auto& m : g->getMembers()) {
+      BOOST_CHECK( g->distanceFromCentroid(m, pairwise, INF) <= 0.1 + EPS );
+      centroidIsMember = centroidIsMember ||
+        (m.getIndex() == g->getCentroidCoord().first && m.getStart() == g->getCentroidCoord().second);
+      members++;
+    }
+    BOOST_CHECK( centroidIsMember );
+    radius += g->getRadius();
+  }
+  BOOST_CHECK_EQUAL( members, tsSet.getItemCount() * (24 - 16 + 1) );
+
+  // The stats describe the groups before and after the passes
+  const group_stats_t& stats = refined.getGroupStats();
+  BOOST_CHECK_EQUAL( stats.subsequences, members );
+  BOOST_CHECK_EQUAL( stats.unrefinedGroups, plain.getNumberOfGroups() );
+  BOOST_CHECK_CLOSE( stats.refinedRadius, radius, 1e-9 );
+  BOOST_CHECK( stats.unrefinedRadius > 0 );
+  BOOST_CHECK( stats.comparisons > plain.getGroupStats().comparisons );
+
+  BOOST_CHECK_THROW( refined.enableRefinement(0), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_super_groups )
+{
+  std::string fname = "local_length_group_space_super_groups.z";
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(pairwise, 0.1);
+  BOOST_CHECK_EQUAL( plain.getNumberOfSuperGroups(), 0 );
+
+  LocalLengthGroupSpace grouped(tsSet, 16);
+  grouped.enableSuperGroups(4);
+  grouped.generateGroups(pairwise, 0.1);
+  BOOST_CHECK_EQUAL( grouped.getNumberOfGroups(), plain.getNumberOfGroups() );
+  BOOST_CHECK( grouped.getNumberOfSuperGroups() > 1 );
+  BOOST_CHECK( grouped.getNumberOfSuperGroups() < grouped.getNumberOfGroups() );
+  BOOST_CHECK_EQUAL( grouped.getGroupStats().superGroups, grouped.getNumberOfSuperGroups() );
+
+  // Each group is in exactly one super-group, within its radius and envelope
+  std::vector<int> seen(grouped.getNumberOfGroups(), 0);
+  for (int s = 0; s < grouped.getNumberOfSuperGroups(); s++) {
+    const super_group_t& sg = grouped.getSuperGroup(s);
+    BOOST_CHECK( sg.radius <= 0.2 );
+    const Group* centroid = grouped.getGroup(sg.centroid);
+    for (auto i : sg.groups) {
+      seen[i]++;
+      const TimeSeries& c = grouped.getGroup(i)->getCentroid();
+      BOOST_CHECK( centroid->distanceFromCentroid(c, pairwise, INF) <= sg.radius + EPS );
+      BOOST_CHECK_EQUAL( sg.envelope.lowerBound(c), 0 );
+    }
+  }
+  BOOST_CHECK( std::all_of(seen.begin(), seen.end(), [](int n) { return n == 1; }) );
+
+  // Queries find the same groups as a scan of all centroids
+  std::vector<TimeSeries> queries = {
+    tsSet.getTimeSeries(3, 2, 18), tsSet.getTimeSeries(7, 0, 16),
+    tsSet.getTimeSeries(11, 8, 24), tsSet.getTimeSeries(40, 1, 17)
+  };
+  for (auto& q : queries) {
+    auto best1 = plain.getBestGroup(q, cascadeDistance, INF);
+    auto best2 = grouped.getBestGroup(q, cascadeDistance, INF);
+    BOOST_REQUIRE( best1.first != nullptr && best2.first != nullptr );
+    BOOST_CHECK( best1.first->getCentroidCoord() == best2.first->getCentroidCoord() );
+    BOOST_CHECK_EQUAL( best1.second, best2.second );
+
+    for (int k : { 1, 15, 200 }) {
+      std::vector<group_index_t> heap1, heap2;
+      plain.interLevelKSim(q, cascadeDistance, heap1, k);
+      grouped.interLevelKSim(q, cascadeDistance, heap2, k);
+      std::vector<data_t> dist1, dist2;
+      for (auto& g : heap1) dist1.push_back(g.dist);
+      for (auto& g : heap2) dist2.push_back(g.dist);
+      std::sort(dist1.begin(), dist1.end());
+      std::sort(dist2.begin(), dist2.end());
+      BOOST_CHECK( dist1 == dist2 );
+    }
+  }
+
+  // Super-groups are saved with the groups
+  saveToFile(grouped, fname);
+  LocalLengthGroupSpace loaded(tsSet, 16);
+  loadFromFile(loaded, fname);
+  BOOST_REQUIRE_EQUAL( loaded.getNumberOfSuperGroups(), grouped.getNumberOfSuperGroups() );
+  for (int s = 0; s < grouped.getNumberOfSuperGroups(); s++) {
+    BOOST_CHECK( loaded.getSuperGroup(s).groups == grouped.getSuperGroup(s).groups );
+    BOOST_CHECK_EQUAL( loaded.getSuperGroup(s).radius, grouped.getSuperGroup(s).radius );
+  }
+  for (auto& q : queries) {
+    BOOST_CHECK_EQUAL( loaded.getBestGroup(q, cascadeDistance, INF).second,
+                       grouped.getBestGroup(q, cascadeDistance, INF).second );
+  }
+  remove(fname.c_str());
+
+  BOOST_CHECK_THROW( grouped.enableSuperGroups(1), GenexException );
+  BOOST_CHECK_THROW( grouped.getSuperGroup(-1), GenexException );
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_concurrent_queries )
+{
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace groups(tsSet, 16);
+  groups.enableSuperGroups(4);
+  groups.generateGroups(pairwise, 0.1);
+
+  // Queries of different lengths prepare envelopes of different bands
+  std::vector<TimeSeries> queries = {
+    tsSet.getTimeSeries(3, 2, 18), tsSet.getTimeSeries(7, 0, 16),
+    tsSet.getTimeSeries(11, 0, 24), tsSet.getTimeSeries(40, 1, 9)
+  };
+  std::vector<data_t> expected;
+  for (auto& q : queries) {
+    expected.push_back(groups.getBestGroup(q, cascadeDistance, INF).second);
+  }
+
+  std::vector< std::future<bool> > runs;
+  for (int t = 0; t < 4; t++) {
+    runs.push_back(std::async(std::launch::async, [&, t]() {
+      bool same = true;
+      for (int r = 0; r < 50; r++) {
+        int i = (t + r) % queries.size();
+        same = same && groups.getBestGroup(queries[i], cascadeDistance, INF).second == expected[i];
+      }
+      return same;
+    }));
+  }
+  for (auto& run : runs) {
+    BOOST_CHECK( run.get() );
+  }
+}
+
+BOOST_AUTO_TEST_CASE( local_length_group_space_levels )
+{
+  std::string fname = "local_length_group_space_levels.z";
+  dist_t pairwise = getDistanceFromName("euclidean");
+  TimeSeriesSet tsSet;
+  tsSet.loadData("datasets/test/ItalyPowerDemand_DATA", 99, 0, " ");
+
+  LocalLengthGroupSpace plain(tsSet, 16);
+  plain.generateGroups(pairwise, 0.1);
+  BOOST_CHECK_EQUAL( plain.getNumberOfLevels(), 1 );
+
+  LocalLengthGroupSpace leveled(tsSet, 16);
+  leveled.enableLevels({ 0.3, 0.6 });
+  leveled.generateGroups(pairwise, 0.1);
+  BOOST_REQUIRE_EQUAL( leveled.getNumberOfLevels(), 3 );
+  BOOST_CHECK_EQUAL( leveled.getNumberOfGroups(), plain.getNumberOfGroups() );
+
+  // Each cluster of a level is in exactly one cluster of the level above,
+  // whose centroid is within threshold / 2 of its own, and the clusters of a
+  // level hold all subsequences between them
+  long subsequences = 0;
+  for (int i = 0; i < leveled.getNumberOfGroups(); i++) {
+    subsequences += leveled.getGroup(i)->getCount();
+  }
+  int below = leveled.getNumberOfGroups();
+  for (int level = 1; level < leveled.getNumberOfLevels(); level++) {
+    BOOST_CHECK( leveled.getLevelSize(level) < below );
+    std::vector<int> seen(below, 0);
+    long members = 0;
+    for (int c = 0; c < leveled.getLevelSize(level); c++) {
+      const super_group_t& cluster = leveled.getLevelGroup(level, c);
+      BOOST_CHECK( cluster.radius <= (level == 1 ? 0.15 : 0.3) );
+      for (auto i : cluster.groups) {
+        seen[i]++;
+      }
+      members += cluster.members;
+    }
+    BOOST_CHECK( std::all_of(seen.begin(), seen.end(), [](int n) { return n == 1; }) );
+    BOOST_CHECK_EQUAL( members, subsequences );
+    below = leveled.getLevelSize(level);
+  }
+
+  // Level 0 finds the groups of a scan of all centroids, and levels above
+  // find groups no closer
+  std::vector<TimeSeries> queries = {
+    tsSet.getTimeSeries(3, 2, 18), tsSet.getTimeSeries(7, 0, 16), tsSet.getTimeSeries(40, 1, 17)
+  };
+  for (auto& q : queries) {
+    auto exact = plain.getBestGroup(q, cascadeDistance, INF);
+    BOOST_CHECK_EQUAL( leveled.getBestGroup(q, cascadeDistance, INF).second, exact.second );
+    for (int level = 1; level <= 3; level++) {
+      auto approx = leveled.getBestGroup(q, cascadeDistance, INF, level);
+      BOOST_REQUIRE( approx.first != nullptr );
+      BOOST_CHECK( approx.second >= exact.second );
+    }
+
+    std::vector<group_index_t> heap;
+    int k = leveled.interLevelKSim(q, cascadeDistance, heap, 20, 2);
+    int members = 0;
+    for (auto& g : heap) {
+      members += g.members;
+    }
+    BOOST_CHECK( k <= 0 );
+    BOOST_CHECK( members >= 20 );
+  }
+
+  // Levels are saved with the groups
+  saveToFile(leveled, fname);
+  LocalLengthGroupSpace loaded(tsSet, 16);
+  loadFromFile(loaded, fname);
+  BOOST_REQUIRE_EQUAL( loaded.getNumberOfLevels(), 3 );
+  for (int level = 1; level < 3; level++) {
+    BOOST_REQUIRE_EQUAL( loaded.getLevelSize(level), leveled.getLevelSize(level) );
+    for (int c = 0; c < leveled.getLevelSize(level); c++) {
+      BOOST_CHECK( loaded.getLevelGroup(level, c).groups == leveled.getLevelGroup(level, c).groups );
+      BOOST_CHECK_EQUAL( loaded.getLevelGroup(level, c).members,
+                         leveled.getLevelGroup(level, c).members );
+    }
+  }
+  for (auto& q : queries) {
+    BOOST_CHECK_EQUAL( loaded.getBestGroup(q, cascadeDistance, INF, 2).second,
+                       leveled.getBestGroup(q, cascadeDistance, INF, 2).second );
+  }
+  remove(fname.c_str());
+
+  BOOST_CHECK_THROW( leveled.enableLevels({ 0.6, 0.3 }), GenexException );
+  BOOST_CHECK_THROW( leveled.getLevelSize(3), GenexException );
+  BOOST_CHECK_THROW( leveled.getLevelGroup(1, -1), GenexException );
+}
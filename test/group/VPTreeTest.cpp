@@ -0,0 +1,88 @@
+#define BOOST_TEST_MODULE "Test VPTree class"
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "group/VPTree.hpp"
+
+using namespace genex;
+
+struct point_t
+{
+  data_t x, y, z;
+};
+
+data_t dist(const point_t& a, const point_t& b)
+{
+  return sqrt(pow(a.x - b.x, 2) + pow(a.y - b.y, 2) + pow(a.z - b.z, 2));
+}
+
+point_t randomPoint()
+{
+  return { (data_t)rand() / RAND_MAX, (data_t)rand() / RAND_MAX, (data_t)rand() / RAND_MAX };
+}
+
+struct nearest_visitor_t
+{
+  const std::vector<point_t>& points;
+  point_t query;
+  data_t best;
+  int bestIndex;
+  int visited;
+
+  data_t visit(int i, data_t)
+  {
+    visited++;
+    data_t d = dist(points[i], query);
+    if (d < best || (d == best && i < bestIndex)) {
+      best = d;
+      bestIndex = i;
+    }
+    return d;
+  }
+
+  data_t lowerBound(data_t key, data_t lo, data_t hi) const
+  {
+    return std::max(key - hi, lo - key);
+  }
+
+  data_t bound() const { return best; }
+};
+
+BOOST_AUTO_TEST_CASE( vp_tree_nearest )
+{
+  srand(7);
+  std::vector<point_t> points;
+  VPTree tree;
+  auto itemDistance = [&points](int a, int b) { return dist(points[a], points[b]); };
+  for (int i = 0; i < 2000; i++) {
+    points.push_back(randomPoint());
+    tree.insert(i, itemDistance);
+  }
+  BOOST_CHECK_EQUAL( tree.size(), 2000 );
+
+  long visited = 0;
+  for (int q = 0; q < 200; q++) {
+    point_t query = randomPoint();
+    int expected = 0;
+    for (int i = 1; i < points.size(); i++) {
+      if (dist(points[i], query) < dist(points[expected], query)) {
+        expected = i;
+      }
+    }
+    nearest_visitor_t visitor = { points, query, INF, -1, 0 };
+    tree.search(visitor);
+    BOOST_CHECK_EQUAL( visitor.bestIndex, expected );
+    visited += visitor.visited;
+  }
+  // The tree must prune most of the points
+  BOOST_CHECK( visited < 200 * 2000 / 4 );
+
+  tree.clear();
+  BOOST_CHECK_EQUAL( tree.size(), 0 );
+  nearest_visitor_t visitor = { points, randomPoint(), INF, -1, 0 };
+  tree.search(visitor);
+  BOOST_CHECK_EQUAL( visitor.visited, 0 );
+}